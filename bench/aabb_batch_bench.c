@@ -0,0 +1,133 @@
+/**
+ * Microbenchmark of the calc overlap test: one branchy comparison per pair of
+ * boxes (the per-pair test calc used before batching) against
+ * aabb_batch_overlap on the same boxes.
+ *
+ * Usage: ./aabb_batch_bench [pairs] [rounds]
+ */
+
+#include "../src/lib/commons/aabb_batch/aabb_batch.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+  Scalar minX;
+  Scalar minY;
+  Scalar maxX;
+  Scalar maxY;
+} Box;
+
+// private functions
+static bool box_overlap(const Box *a, const Box *b);
+static void random_box(Box *box);
+static double elapsed_ns(clock_t start);
+
+int main(int argc, char *argv[]) {
+  int pairs = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+  pairs -= pairs % AABB_BATCH_SIZE;
+  if (pairs <= 0 || rounds <= 0) {
+    printf("Error: pairs must be at least %d and rounds positive\n",
+           AABB_BATCH_SIZE);
+    exit(1);
+  }
+
+  int batches = pairs / AABB_BATCH_SIZE;
+  Box *boxes = malloc(2 * (size_t)pairs * sizeof(Box));
+  AabbBatch *batchA = malloc((size_t)batches * sizeof(AabbBatch));
+  AabbBatch *batchB = malloc((size_t)batches * sizeof(AabbBatch));
+  if (boxes == NULL || batchA == NULL || batchB == NULL) {
+    printf("Error: Failed to allocate %d pairs\n", pairs);
+    exit(1);
+  }
+
+  srand(42);
+  for (int i = 0; i < pairs; i++) {
+    random_box(&boxes[2 * i]);
+    random_box(&boxes[2 * i + 1]);
+
+    AabbBatch *a = &batchA[i / AABB_BATCH_SIZE];
+    AabbBatch *b = &batchB[i / AABB_BATCH_SIZE];
+    int k = i % AABB_BATCH_SIZE;
+    (*a)[AABB_MIN_X][k] = boxes[2 * i].minX;
+    (*a)[AABB_MIN_Y][k] = boxes[2 * i].minY;
+    (*a)[AABB_MAX_X][k] = boxes[2 * i].maxX;
+    (*a)[AABB_MAX_Y][k] = boxes[2 * i].maxY;
+    (*b)[AABB_MIN_X][k] = boxes[2 * i + 1].minX;
+    (*b)[AABB_MIN_Y][k] = boxes[2 * i + 1].minY;
+    (*b)[AABB_MAX_X][k] = boxes[2 * i + 1].maxX;
+    (*b)[AABB_MAX_Y][k] = boxes[2 * i + 1].maxY;
+  }
+
+  long scalarHits = 0;
+  clock_t start = clock();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < pairs; i++) {
+      scalarHits += box_overlap(&boxes[2 * i], &boxes[2 * i + 1]);
+    }
+  }
+  double scalarNs = elapsed_ns(start);
+
+  long batchHits = 0;
+  uint64_t mask[AABB_BATCH_SIZE / 64];
+  start = clock();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < batches; i++) {
+      aabb_batch_overlap(batchA[i], batchB[i], AABB_BATCH_SIZE, mask);
+      for (int w = 0; w < AABB_BATCH_SIZE / 64; w++) {
+        uint64_t bits = mask[w];
+        while (bits != 0) {
+          bits &= bits - 1;
+          batchHits++;
+        }
+      }
+    }
+  }
+  double batchNs = elapsed_ns(start);
+
+  if (scalarHits != batchHits) {
+    printf("Error: scalar found %ld overlaps, batch found %ld\n", scalarHits,
+           batchHits);
+    exit(1);
+  }
+
+  double tested = (double)pairs * rounds;
+  printf("pairs: %d x %d rounds, overlapping: %ld\n", pairs, rounds,
+         scalarHits / rounds);
+  printf("per-pair: %.2f ns/pair\n", scalarNs / tested);
+  printf("batch (%s): %.2f ns/pair\n", aabb_batch_kernel_name(),
+         batchNs / tested);
+
+  free(boxes);
+  free(batchA);
+  free(batchB);
+  return 0;
+}
+
+/**
+ **************************
+ * Private functions
+ **************************
+ */
+
+static bool box_overlap(const Box *a, const Box *b) {
+  if (a->maxX < b->minX || b->maxX < a->minX)
+    return false;
+  if (a->maxY < b->minY || b->maxY < a->minY)
+    return false;
+  return true;
+}
+
+// Boxes scattered over a 1000 x 1000 scene; about a quarter of the pairs overlap
+static void random_box(Box *box) {
+  box->minX = (Scalar)(rand() % 1000);
+  box->minY = (Scalar)(rand() % 1000);
+  box->maxX = box->minX + (Scalar)(rand() % 600);
+  box->maxY = box->minY + (Scalar)(rand() % 600);
+}
+
+static double elapsed_ns(clock_t start) {
+  return (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC;
+}
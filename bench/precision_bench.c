@@ -0,0 +1,231 @@
+/**
+ * Benchmark of the geometry precision: runs a ted built with
+ * PRECISION=double and one built with PRECISION=single on the same
+ * generated scene and reports the wall time and the peak memory (max RSS)
+ * of each run.
+ *
+ * The scene is a .geo of mixed shapes, by default 1M, and a .qry with 10
+ * shooters on 20 loaders of 1000 shapes each, 20k shft/dsp commands and a
+ * calc. Each precision runs the .geo alone ("geo" phase) and the .geo with
+ * the .qry ("geo+qry" phase); times are the best of the rounds, memory the
+ * largest.
+ *
+ * Usage: ./precision_bench <ted-double> <ted-single> [shapes] [rounds] [dir]
+ * The scene and the outputs are written in dir, /tmp by default.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SHOOTERS 10
+#define BENCH_LOADERS 20
+#define BENCH_LOADED_SHAPES 1000
+#define BENCH_COMMANDS 20000
+
+typedef struct {
+  double seconds;
+  double maxRssMb;
+} RunResult;
+
+static unsigned long long random_state = 88172645463325252ULL;
+
+// private functions
+static double random_unit(void);
+static void write_scene(const char *geoPath, const char *qryPath, int shapes);
+static RunResult run_ted(const char *ted, const char *geoPath,
+                         const char *qryPath, const char *dir);
+static RunResult measure_child(const char *ted, const char *geoPath,
+                               const char *qryPath, const char *dir);
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printf("Usage: %s <ted-double> <ted-single> [shapes] [rounds] [dir]\n",
+           argv[0]);
+    return 1;
+  }
+  int shapes = argc > 3 ? atoi(argv[3]) : 1000000;
+  int rounds = argc > 4 ? atoi(argv[4]) : 3;
+  const char *dir = argc > 5 ? argv[5] : "/tmp";
+  if (shapes < BENCH_LOADERS * BENCH_LOADED_SHAPES || rounds < 1) {
+    printf("Error: shapes must be at least %d and rounds at least 1\n",
+           BENCH_LOADERS * BENCH_LOADED_SHAPES);
+    return 1;
+  }
+
+  char geoPath[4096];
+  char qryPath[4096];
+  snprintf(geoPath, sizeof(geoPath), "%s/precision_bench.geo", dir);
+  snprintf(qryPath, sizeof(qryPath), "%s/precision_bench.qry", dir);
+  write_scene(geoPath, qryPath, shapes);
+
+  const char *labels[] = {"double", "single"};
+  printf("%d shapes, %d shooters, %d qry commands, best of %d rounds\n",
+         shapes, BENCH_SHOOTERS, BENCH_COMMANDS, rounds);
+  printf("%-9s %-8s %10s %12s\n", "precision", "phase", "time (s)",
+         "max RSS (MB)");
+  for (int b = 0; b < 2; b++) {
+    for (int phase = 0; phase < 2; phase++) {
+      RunResult best = {0.0, 0.0};
+      for (int r = 0; r < rounds; r++) {
+        RunResult run = run_ted(argv[1 + b], geoPath,
+                                phase == 1 ? qryPath : NULL, dir);
+        if (r == 0 || run.seconds < best.seconds) {
+          best.seconds = run.seconds;
+        }
+        if (run.maxRssMb > best.maxRssMb) {
+          best.maxRssMb = run.maxRssMb;
+        }
+      }
+      printf("%-9s %-8s %10.2f %12.1f\n", labels[b],
+             phase == 1 ? "geo+qry" : "geo", best.seconds, best.maxRssMb);
+    }
+  }
+  return 0;
+}
+
+// Uniform number in [0, 1) from a xorshift generator with a fixed seed, so
+// every run writes the same scene
+static double random_unit(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return (double)(random_state >> 11) / 9007199254740992.0;
+}
+
+static void write_scene(const char *geoPath, const char *qryPath, int shapes) {
+  FILE *geo = fopen(geoPath, "w");
+  FILE *qry = fopen(qryPath, "w");
+  if (geo == NULL || qry == NULL) {
+    printf("Error: Failed to create the scene in %s\n", geoPath);
+    exit(1);
+  }
+
+  for (int i = 1; i <= shapes; i++) {
+    double x = random_unit() * 1000.0;
+    double y = random_unit() * 1000.0;
+    switch (i % 4) {
+    case 0:
+      fprintf(geo, "c %d %.3f %.3f %.3f red blue\n", i, x, y,
+              1.0 + random_unit() * 20.0);
+      break;
+    case 1:
+      fprintf(geo, "r %d %.3f %.3f %.3f %.3f green black\n", i, x, y,
+              1.0 + random_unit() * 40.0, 1.0 + random_unit() * 40.0);
+      break;
+    case 2:
+      fprintf(geo, "l %d %.3f %.3f %.3f %.3f purple\n", i, x, y,
+              random_unit() * 1000.0, random_unit() * 1000.0);
+      break;
+    default:
+      fprintf(geo, "t %d %.3f %.3f black yellow m text%d\n", i, x, y, i);
+      break;
+    }
+  }
+
+  for (int s = 1; s <= BENCH_SHOOTERS; s++) {
+    fprintf(qry, "pd %d %.3f %.3f\n", s, random_unit() * 1000.0,
+            random_unit() * 1000.0);
+  }
+  for (int l = 1; l <= BENCH_LOADERS; l++) {
+    fprintf(qry, "lc %d %d\n", l, BENCH_LOADED_SHAPES);
+  }
+  for (int s = 1; s <= BENCH_SHOOTERS; s++) {
+    fprintf(qry, "atch %d %d %d\n", s, 2 * s - 1, 2 * s);
+  }
+  for (int c = 0; c < BENCH_COMMANDS; c++) {
+    int shooter = 1 + (int)(random_unit() * BENCH_SHOOTERS);
+    if (c % 2 == 0) {
+      fprintf(qry, "shft %d %c 1\n", shooter, random_unit() < 0.5 ? 'e' : 'd');
+    } else {
+      fprintf(qry, "dsp %d %.3f %.3f i\n", shooter,
+              random_unit() * 200.0 - 100.0, random_unit() * 200.0 - 100.0);
+    }
+  }
+  fprintf(qry, "calc\n");
+
+  fclose(geo);
+  fclose(qry);
+}
+
+// Runs ted in a child of its own, so the max RSS of every run is measured
+// apart from the others
+static RunResult run_ted(const char *ted, const char *geoPath,
+                         const char *qryPath, const char *dir) {
+  // Text still buffered would be printed again by the child
+  fflush(stdout);
+  int fds[2];
+  if (pipe(fds) != 0) {
+    printf("Error: Failed to create a pipe\n");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    printf("Error: Failed to start %s\n", ted);
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    RunResult result = measure_child(ted, geoPath, qryPath, dir);
+    ssize_t written = write(fds[1], &result, sizeof(result));
+    _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  RunResult result = {0.0, 0.0};
+  ssize_t got = read(fds[0], &result, sizeof(result));
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  if (got != (ssize_t)sizeof(result) || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    printf("Error: %s failed\n", ted);
+    exit(1);
+  }
+  return result;
+}
+
+// Runs ted as the only child of this process and measures it
+static RunResult measure_child(const char *ted, const char *geoPath,
+                               const char *qryPath, const char *dir) {
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pid_t pid = fork();
+  if (pid < 0) {
+    _exit(1);
+  }
+  if (pid == 0) {
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+      _exit(1);
+    }
+    if (qryPath != NULL) {
+      execl(ted, ted, "-f", geoPath, "-o", dir, "-q", qryPath, (char *)NULL);
+    } else {
+      execl(ted, ted, "-f", geoPath, "-o", dir, (char *)NULL);
+    }
+    _exit(127);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    _exit(1);
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_CHILDREN, &usage);
+  RunResult result = {
+      (double)(end.tv_sec - start.tv_sec) +
+          (double)(end.tv_nsec - start.tv_nsec) * 1e-9,
+      // ru_maxrss is in kilobytes on Linux
+      (double)usage.ru_maxrss / 1024.0};
+  return result;
+}
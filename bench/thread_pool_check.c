@@ -0,0 +1,81 @@
+/**
+ * Check of how thread_pool_parallel_for spreads short loops: a loop with
+ * fewer indices than the pool has threads, such as two independent shooter
+ * groups or three .qry runs on a four-thread pool, must still run each
+ * index on its own thread instead of inline on the caller.
+ *
+ * Usage: ./thread_pool_check [threads]
+ * Exits with 1 if some loop ran two indices on the same thread.
+ */
+
+#include "../src/lib/commons/thread_pool/thread_pool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK_MAX_THREADS 64
+
+typedef struct {
+  pthread_t threads[CHECK_MAX_THREADS];
+  int calls[CHECK_MAX_THREADS];
+} LoopRecord;
+
+// private functions
+static void record_thread(void *ctx, int begin, int end);
+static bool check_loop(ThreadPool pool, int count);
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  if (threads < 2 || threads > CHECK_MAX_THREADS) {
+    printf("Error: threads must be between 2 and %d\n", CHECK_MAX_THREADS);
+    return 1;
+  }
+
+  ThreadPool pool = thread_pool_create(threads);
+  if (pool == NULL || thread_pool_size(pool) != threads) {
+    printf("Error: Failed to start %d threads\n", threads);
+    return 1;
+  }
+
+  bool passed = true;
+  for (int count = 2; count <= threads; count++) {
+    passed = check_loop(pool, count) && passed;
+  }
+  thread_pool_destroy(pool);
+  return passed ? 0 : 1;
+}
+
+// Records the thread running each index of the range
+static void record_thread(void *ctx, int begin, int end) {
+  LoopRecord *record = (LoopRecord *)ctx;
+  for (int i = begin; i < end; i++) {
+    record->threads[i] = pthread_self();
+    record->calls[i]++;
+  }
+}
+
+// Runs a loop of count indices and checks that each ran once, on a thread
+// of its own
+static bool check_loop(ThreadPool pool, int count) {
+  LoopRecord record = {.calls = {0}};
+  thread_pool_parallel_for(pool, count, record_thread, &record);
+
+  int distinct = 0;
+  for (int i = 0; i < count; i++) {
+    if (record.calls[i] != 1) {
+      printf("%d indices on %d threads: index %d ran %d times\n", count,
+             thread_pool_size(pool), i, record.calls[i]);
+      return false;
+    }
+    bool seen = false;
+    for (int j = 0; j < i && !seen; j++) {
+      seen = pthread_equal(record.threads[i], record.threads[j]);
+    }
+    distinct += seen ? 0 : 1;
+  }
+
+  printf("%d indices on %d threads: %d threads used\n", count,
+         thread_pool_size(pool), distinct);
+  return distinct == count;
+}
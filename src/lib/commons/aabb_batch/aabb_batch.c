@@ -0,0 +1,153 @@
+#include "aabb_batch.h"
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define AABB_BATCH_KERNEL "avx"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AABB_BATCH_KERNEL "sse2"
+#else
+#define AABB_BATCH_KERNEL "scalar"
+#endif
+
+// private functions
+static int aabb_batch_overlap_vector(AabbBatch a, AabbBatch b, int count,
+                                     uint64_t *mask);
+
+/**
+ * Tests count box pairs and writes one overlap bit per pair
+ * @param a First boxes
+ * @param b Second boxes
+ * @param count Number of pairs
+ * @param mask Output bitmask
+ */
+void aabb_batch_overlap(AabbBatch a, AabbBatch b, int count,
+                        uint64_t mask[AABB_BATCH_SIZE / 64]) {
+  memset(mask, 0, (AABB_BATCH_SIZE / 64) * sizeof(uint64_t));
+  if (count > AABB_BATCH_SIZE) {
+    count = AABB_BATCH_SIZE;
+  }
+
+  // Remaining pairs that do not fill a vector are tested one by one
+  for (int i = aabb_batch_overlap_vector(a, b, count, mask); i < count; i++) {
+    bool separated = a[AABB_MAX_X][i] < b[AABB_MIN_X][i] ||
+                     b[AABB_MAX_X][i] < a[AABB_MIN_X][i] ||
+                     a[AABB_MAX_Y][i] < b[AABB_MIN_Y][i] ||
+                     b[AABB_MAX_Y][i] < a[AABB_MIN_Y][i];
+    if (!separated) {
+      mask[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+  }
+}
+
+/**
+ * Reports the instruction set selected at compile time
+ * @return Kernel name
+ */
+const char *aabb_batch_kernel_name(void) { return AABB_BATCH_KERNEL; }
+
+/**
+**************************
+* Private functions
+**************************
+*/
+
+// Tests as many leading pairs as fill whole vectors and returns how many
+// were tested. Lane counts are powers of two dividing 64, so the bits of a
+// vector never straddle two mask words.
+#if defined(__AVX__) && defined(GEOMETRY_SINGLE_PRECISION)
+static int aabb_batch_overlap_vector(AabbBatch a, AabbBatch b, int count,
+                                     uint64_t *mask) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 sep = _mm256_or_ps(
+        _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(&a[AABB_MAX_X][i]),
+                                   _mm256_loadu_ps(&b[AABB_MIN_X][i]),
+                                   _CMP_LT_OQ),
+                     _mm256_cmp_ps(_mm256_loadu_ps(&b[AABB_MAX_X][i]),
+                                   _mm256_loadu_ps(&a[AABB_MIN_X][i]),
+                                   _CMP_LT_OQ)),
+        _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(&a[AABB_MAX_Y][i]),
+                                   _mm256_loadu_ps(&b[AABB_MIN_Y][i]),
+                                   _CMP_LT_OQ),
+                     _mm256_cmp_ps(_mm256_loadu_ps(&b[AABB_MAX_Y][i]),
+                                   _mm256_loadu_ps(&a[AABB_MIN_Y][i]),
+                                   _CMP_LT_OQ)));
+    uint64_t bits = (uint64_t)(~_mm256_movemask_ps(sep) & 0xff);
+    mask[i / 64] |= bits << (i % 64);
+  }
+  return i;
+}
+#elif defined(__AVX__)
+static int aabb_batch_overlap_vector(AabbBatch a, AabbBatch b, int count,
+                                     uint64_t *mask) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256d sep = _mm256_or_pd(
+        _mm256_or_pd(_mm256_cmp_pd(_mm256_loadu_pd(&a[AABB_MAX_X][i]),
+                                   _mm256_loadu_pd(&b[AABB_MIN_X][i]),
+                                   _CMP_LT_OQ),
+                     _mm256_cmp_pd(_mm256_loadu_pd(&b[AABB_MAX_X][i]),
+                                   _mm256_loadu_pd(&a[AABB_MIN_X][i]),
+                                   _CMP_LT_OQ)),
+        _mm256_or_pd(_mm256_cmp_pd(_mm256_loadu_pd(&a[AABB_MAX_Y][i]),
+                                   _mm256_loadu_pd(&b[AABB_MIN_Y][i]),
+                                   _CMP_LT_OQ),
+                     _mm256_cmp_pd(_mm256_loadu_pd(&b[AABB_MAX_Y][i]),
+                                   _mm256_loadu_pd(&a[AABB_MIN_Y][i]),
+                                   _CMP_LT_OQ)));
+    uint64_t bits = (uint64_t)(~_mm256_movemask_pd(sep) & 0xf);
+    mask[i / 64] |= bits << (i % 64);
+  }
+  return i;
+}
+#elif defined(__SSE2__) && defined(GEOMETRY_SINGLE_PRECISION)
+static int aabb_batch_overlap_vector(AabbBatch a, AabbBatch b, int count,
+                                     uint64_t *mask) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 sep = _mm_or_ps(
+        _mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(&a[AABB_MAX_X][i]),
+                               _mm_loadu_ps(&b[AABB_MIN_X][i])),
+                  _mm_cmplt_ps(_mm_loadu_ps(&b[AABB_MAX_X][i]),
+                               _mm_loadu_ps(&a[AABB_MIN_X][i]))),
+        _mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(&a[AABB_MAX_Y][i]),
+                               _mm_loadu_ps(&b[AABB_MIN_Y][i])),
+                  _mm_cmplt_ps(_mm_loadu_ps(&b[AABB_MAX_Y][i]),
+                               _mm_loadu_ps(&a[AABB_MIN_Y][i]))));
+    uint64_t bits = (uint64_t)(~_mm_movemask_ps(sep) & 0xf);
+    mask[i / 64] |= bits << (i % 64);
+  }
+  return i;
+}
+#elif defined(__SSE2__)
+static int aabb_batch_overlap_vector(AabbBatch a, AabbBatch b, int count,
+                                     uint64_t *mask) {
+  int i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m128d sep = _mm_or_pd(
+        _mm_or_pd(_mm_cmplt_pd(_mm_loadu_pd(&a[AABB_MAX_X][i]),
+                               _mm_loadu_pd(&b[AABB_MIN_X][i])),
+                  _mm_cmplt_pd(_mm_loadu_pd(&b[AABB_MAX_X][i]),
+                               _mm_loadu_pd(&a[AABB_MIN_X][i]))),
+        _mm_or_pd(_mm_cmplt_pd(_mm_loadu_pd(&a[AABB_MAX_Y][i]),
+                               _mm_loadu_pd(&b[AABB_MIN_Y][i])),
+                  _mm_cmplt_pd(_mm_loadu_pd(&b[AABB_MAX_Y][i]),
+                               _mm_loadu_pd(&a[AABB_MIN_Y][i]))));
+    uint64_t bits = (uint64_t)(~_mm_movemask_pd(sep) & 0x3);
+    mask[i / 64] |= bits << (i % 64);
+  }
+  return i;
+}
+#else
+static int aabb_batch_overlap_vector(AabbBatch a, AabbBatch b, int count,
+                                     uint64_t *mask) {
+  (void)a;
+  (void)b;
+  (void)count;
+  (void)mask;
+  return 0;
+}
+#endif
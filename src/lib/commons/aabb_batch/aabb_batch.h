@@ -0,0 +1,56 @@
+/**
+ * @file aabb_batch.h
+ * @brief Batched axis-aligned bounding box overlap tests
+ *
+ * This module tests many pairs of axis-aligned boxes at once. Boxes are
+ * stored as a structure of arrays (one row per box field), which lets the
+ * kernel compare several pairs per instruction with AVX or SSE2 when the
+ * compiler targets them, and fall back to plain C otherwise.
+ */
+
+#ifndef AABB_BATCH_H
+#define AABB_BATCH_H
+
+#include "../scalar/scalar.h"
+#include <stdint.h>
+
+/**
+ * @brief Maximum number of boxes in a batch
+ */
+#define AABB_BATCH_SIZE 256
+
+/**
+ * @brief Rows of an AabbBatch
+ */
+enum { AABB_MIN_X, AABB_MIN_Y, AABB_MAX_X, AABB_MAX_Y, AABB_FIELDS };
+
+/**
+ * @brief Boxes in structure-of-arrays layout: batch[AABB_MIN_X][i] is the
+ * minimum x of box i, and so on for the other rows
+ */
+typedef Scalar AabbBatch[AABB_FIELDS][AABB_BATCH_SIZE];
+
+/**
+ * @brief Tests box i of a against box i of b, for every i below count
+ *
+ * Boxes touching on an edge overlap. The result matches testing each pair
+ * with scalar comparisons. Neither batch is modified (the parameters are not
+ * const-qualified because C99 does not convert pointers to arrays to
+ * pointers to const arrays).
+ *
+ * @param a First boxes of the pairs
+ * @param b Second boxes of the pairs
+ * @param count Number of pairs, at most AABB_BATCH_SIZE
+ * @param mask Output bitmask; bit i % 64 of mask[i / 64] is set when pair
+ * i overlaps
+ */
+void aabb_batch_overlap(AabbBatch a, AabbBatch b, int count,
+                        uint64_t mask[AABB_BATCH_SIZE / 64]);
+
+/**
+ * @brief Name of the instruction set used by aabb_batch_overlap
+ * @return "avx", "sse2" or "scalar"
+ */
+const char *aabb_batch_kernel_name(void);
+
+#endif // AABB_BATCH_H
@@ -0,0 +1,162 @@
+#include "collision.h"
+
+// private functions
+static double point_segment_distance2(double px, double py, double x1,
+                                      double y1, double x2, double y2);
+static double point_box_distance2(double px, double py, double minX,
+                                  double minY, double maxX, double maxY);
+static double orientation(double ax, double ay, double bx, double by,
+                          double cx, double cy);
+static bool on_segment(double px, double py, double x1, double y1, double x2,
+                       double y2);
+static bool segments_intersect(double ax1, double ay1, double ax2, double ay2,
+                               double bx1, double by1, double bx2,
+                               double by2);
+static bool segment_crosses_box(double x1, double y1, double x2, double y2,
+                                double minX, double minY, double maxX,
+                                double maxY);
+
+bool collision_circle_circle(double ax, double ay, double ar, double bx,
+                             double by, double br) {
+  double dx = bx - ax;
+  double dy = by - ay;
+  return dx * dx + dy * dy <= (ar + br) * (ar + br);
+}
+
+bool collision_circle_box(double cx, double cy, double r, double minX,
+                          double minY, double maxX, double maxY) {
+  return point_box_distance2(cx, cy, minX, minY, maxX, maxY) <= r * r;
+}
+
+bool collision_segment_circle(double x1, double y1, double x2, double y2,
+                              double thickness, double cx, double cy,
+                              double r) {
+  double reach = r + thickness;
+  return point_segment_distance2(cx, cy, x1, y1, x2, y2) <= reach * reach;
+}
+
+bool collision_segment_box(double x1, double y1, double x2, double y2,
+                           double thickness, double minX, double minY,
+                           double maxX, double maxY) {
+  if (segment_crosses_box(x1, y1, x2, y2, minX, minY, maxX, maxY))
+    return true;
+
+  // Apart from each other, the closest points of a segment and a box are an
+  // end of the segment or a corner of the box
+  double limit = thickness * thickness;
+  return point_box_distance2(x1, y1, minX, minY, maxX, maxY) <= limit ||
+         point_box_distance2(x2, y2, minX, minY, maxX, maxY) <= limit ||
+         point_segment_distance2(minX, minY, x1, y1, x2, y2) <= limit ||
+         point_segment_distance2(maxX, minY, x1, y1, x2, y2) <= limit ||
+         point_segment_distance2(minX, maxY, x1, y1, x2, y2) <= limit ||
+         point_segment_distance2(maxX, maxY, x1, y1, x2, y2) <= limit;
+}
+
+bool collision_segment_segment(double ax1, double ay1, double ax2, double ay2,
+                               double bx1, double by1, double bx2, double by2,
+                               double thickness) {
+  if (segments_intersect(ax1, ay1, ax2, ay2, bx1, by1, bx2, by2))
+    return true;
+
+  // Disjoint segments are closest at one of the four end points
+  double limit = thickness * thickness;
+  return point_segment_distance2(ax1, ay1, bx1, by1, bx2, by2) <= limit ||
+         point_segment_distance2(ax2, ay2, bx1, by1, bx2, by2) <= limit ||
+         point_segment_distance2(bx1, by1, ax1, ay1, ax2, ay2) <= limit ||
+         point_segment_distance2(bx2, by2, ax1, ay1, ax2, ay2) <= limit;
+}
+
+/**
+ **************************
+ * Private functions
+ **************************
+ */
+
+static double point_segment_distance2(double px, double py, double x1,
+                                      double y1, double x2, double y2) {
+  double dx = x2 - x1;
+  double dy = y2 - y1;
+  double length2 = dx * dx + dy * dy;
+  double t = 0.0;
+  if (length2 > 0.0) {
+    t = ((px - x1) * dx + (py - y1) * dy) / length2;
+    if (t < 0.0)
+      t = 0.0;
+    else if (t > 1.0)
+      t = 1.0;
+  }
+  double ex = x1 + t * dx - px;
+  double ey = y1 + t * dy - py;
+  return ex * ex + ey * ey;
+}
+
+static double point_box_distance2(double px, double py, double minX,
+                                  double minY, double maxX, double maxY) {
+  double dx = px < minX ? minX - px : (px > maxX ? px - maxX : 0.0);
+  double dy = py < minY ? minY - py : (py > maxY ? py - maxY : 0.0);
+  return dx * dx + dy * dy;
+}
+
+// Positive when c is to the left of a->b, negative to the right, zero when
+// the three points are collinear
+static double orientation(double ax, double ay, double bx, double by,
+                          double cx, double cy) {
+  return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+// Whether p, known to be collinear with the segment, lies within its box
+static bool on_segment(double px, double py, double x1, double y1, double x2,
+                       double y2) {
+  return px >= (x1 < x2 ? x1 : x2) && px <= (x1 > x2 ? x1 : x2) &&
+         py >= (y1 < y2 ? y1 : y2) && py <= (y1 > y2 ? y1 : y2);
+}
+
+static bool segments_intersect(double ax1, double ay1, double ax2, double ay2,
+                               double bx1, double by1, double bx2,
+                               double by2) {
+  double o1 = orientation(ax1, ay1, ax2, ay2, bx1, by1);
+  double o2 = orientation(ax1, ay1, ax2, ay2, bx2, by2);
+  double o3 = orientation(bx1, by1, bx2, by2, ax1, ay1);
+  double o4 = orientation(bx1, by1, bx2, by2, ax2, ay2);
+
+  if (((o1 > 0.0 && o2 < 0.0) || (o1 < 0.0 && o2 > 0.0)) &&
+      ((o3 > 0.0 && o4 < 0.0) || (o3 < 0.0 && o4 > 0.0)))
+    return true;
+
+  return (o1 == 0.0 && on_segment(bx1, by1, ax1, ay1, ax2, ay2)) ||
+         (o2 == 0.0 && on_segment(bx2, by2, ax1, ay1, ax2, ay2)) ||
+         (o3 == 0.0 && on_segment(ax1, ay1, bx1, by1, bx2, by2)) ||
+         (o4 == 0.0 && on_segment(ax2, ay2, bx1, by1, bx2, by2));
+}
+
+// Clips the segment against each slab of the box (Liang-Barsky)
+static bool segment_crosses_box(double x1, double y1, double x2, double y2,
+                                double minX, double minY, double maxX,
+                                double maxY) {
+  double p[4] = {x1 - x2, x2 - x1, y1 - y2, y2 - y1};
+  double q[4] = {x1 - minX, maxX - x1, y1 - minY, maxY - y1};
+  double enter = 0.0;
+  double leave = 1.0;
+
+  for (int i = 0; i < 4; i++) {
+    if (p[i] == 0.0) {
+      // Parallel to this slab: inside it or never
+      if (q[i] < 0.0)
+        return false;
+    } else {
+      double t = q[i] / p[i];
+      if (p[i] < 0.0) {
+        if (t > leave)
+          return false;
+        if (t > enter)
+          enter = t;
+      } else {
+        if (t < enter)
+          return false;
+        if (t < leave)
+          leave = t;
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file collision.h
+ * @brief Exact overlap tests between basic shapes
+ *
+ * This module decides whether two primitives share at least one point.
+ * Circles are given by center and radius, boxes by their axis-aligned
+ * corners, and segments by their end points and a radius that thickens
+ * them into capsules (lines drawn with a stroke width). Shapes touching on
+ * their boundary overlap, as in the bounding box test.
+ */
+
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Tests two circles
+ * @param ax Center x of the first circle
+ * @param ay Center y of the first circle
+ * @param ar Radius of the first circle
+ * @param bx Center x of the second circle
+ * @param by Center y of the second circle
+ * @param br Radius of the second circle
+ * @return true if the circles overlap
+ */
+bool collision_circle_circle(double ax, double ay, double ar, double bx,
+                             double by, double br);
+
+/**
+ * @brief Tests a circle against an axis-aligned box
+ * @param cx Center x of the circle
+ * @param cy Center y of the circle
+ * @param r Radius of the circle
+ * @param minX Minimum x of the box
+ * @param minY Minimum y of the box
+ * @param maxX Maximum x of the box
+ * @param maxY Maximum y of the box
+ * @return true if the circle and the box overlap
+ */
+bool collision_circle_box(double cx, double cy, double r, double minX,
+                          double minY, double maxX, double maxY);
+
+/**
+ * @brief Tests a thick segment against a circle
+ * @param x1 Start x of the segment
+ * @param y1 Start y of the segment
+ * @param x2 End x of the segment
+ * @param y2 End y of the segment
+ * @param thickness Half of the segment width
+ * @param cx Center x of the circle
+ * @param cy Center y of the circle
+ * @param r Radius of the circle
+ * @return true if the segment and the circle overlap
+ */
+bool collision_segment_circle(double x1, double y1, double x2, double y2,
+                              double thickness, double cx, double cy,
+                              double r);
+
+/**
+ * @brief Tests a thick segment against an axis-aligned box
+ * @param x1 Start x of the segment
+ * @param y1 Start y of the segment
+ * @param x2 End x of the segment
+ * @param y2 End y of the segment
+ * @param thickness Half of the segment width
+ * @param minX Minimum x of the box
+ * @param minY Minimum y of the box
+ * @param maxX Maximum x of the box
+ * @param maxY Maximum y of the box
+ * @return true if the segment and the box overlap
+ */
+bool collision_segment_box(double x1, double y1, double x2, double y2,
+                           double thickness, double minX, double minY,
+                           double maxX, double maxY);
+
+/**
+ * @brief Tests two thick segments
+ * @param ax1 Start x of the first segment
+ * @param ay1 Start y of the first segment
+ * @param ax2 End x of the first segment
+ * @param ay2 End y of the first segment
+ * @param bx1 Start x of the second segment
+ * @param by1 Start y of the second segment
+ * @param bx2 End x of the second segment
+ * @param by2 End y of the second segment
+ * @param thickness Sum of the half widths of both segments
+ * @return true if the segments overlap
+ */
+bool collision_segment_segment(double ax1, double ay1, double ax2, double ay2,
+                               double bx1, double by1, double bx2, double by2,
+                               double thickness);
+
+#endif // COLLISION_H
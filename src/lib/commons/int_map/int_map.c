@@ -0,0 +1,169 @@
+#include "int_map.h"
+
+#define INT_MAP_INITIAL_CAPACITY 16
+
+// Internal structure definitions - only visible in implementation
+typedef struct {
+  int key;
+  bool used;
+  void *value;
+} IntMapSlot;
+
+// Open addressing with linear probing; capacity is always a power of two
+struct IntMap {
+  IntMapSlot *slots;
+  int capacity;
+  int size;
+};
+
+// private functions
+static unsigned int int_map_hash(int key);
+static IntMapSlot *int_map_find_slot(IntMapSlot *slots, int capacity,
+                                     int key);
+static bool int_map_grow(struct IntMap *m);
+
+/**
+ * Creates a new empty map
+ * @return Pointer to new map or NULL on error
+ */
+IntMap int_map_create(void) {
+  struct IntMap *m = malloc(sizeof(struct IntMap));
+  if (m == NULL) {
+    return NULL;
+  }
+
+  m->slots = calloc(INT_MAP_INITIAL_CAPACITY, sizeof(IntMapSlot));
+  if (m->slots == NULL) {
+    free(m);
+    return NULL;
+  }
+  m->capacity = INT_MAP_INITIAL_CAPACITY;
+  m->size = 0;
+
+  return (IntMap)m;
+}
+
+/**
+ * Destroys the map, optionally destroying every stored value
+ * @param map Pointer to map to be destroyed
+ * @param destroy_value Destructor for the values or NULL
+ */
+void int_map_destroy(IntMap map, void (*destroy_value)(void *value)) {
+  if (map == NULL) {
+    return;
+  }
+
+  struct IntMap *m = (struct IntMap *)map;
+  if (destroy_value != NULL) {
+    for (int i = 0; i < m->capacity; i++) {
+      if (m->slots[i].used) {
+        destroy_value(m->slots[i].value);
+      }
+    }
+  }
+  free(m->slots);
+  free(m);
+}
+
+/**
+ * Inserts or replaces the value of a key
+ * @param map Pointer to the map
+ * @param key Key to insert
+ * @param value Value to store
+ * @return true on success, false on error
+ */
+bool int_map_put(IntMap map, int key, void *value) {
+  if (map == NULL) {
+    return false;
+  }
+
+  struct IntMap *m = (struct IntMap *)map;
+  // Keep the load factor below 3/4 so probe sequences stay short
+  if ((m->size + 1) * 4 > m->capacity * 3 && !int_map_grow(m)) {
+    return false;
+  }
+
+  IntMapSlot *slot = int_map_find_slot(m->slots, m->capacity, key);
+  if (!slot->used) {
+    slot->used = true;
+    slot->key = key;
+    m->size++;
+  }
+  slot->value = value;
+  return true;
+}
+
+/**
+ * Looks up a key
+ * @param map Pointer to the map
+ * @param key Key to look up
+ * @return Stored value or NULL if absent
+ */
+void *int_map_get(IntMap map, int key) {
+  if (map == NULL) {
+    return NULL;
+  }
+
+  struct IntMap *m = (struct IntMap *)map;
+  IntMapSlot *slot = int_map_find_slot(m->slots, m->capacity, key);
+  return slot->used ? slot->value : NULL;
+}
+
+/**
+ * Gets the number of keys in the map
+ * @param map Pointer to the map
+ * @return Number of keys, 0 if map is NULL
+ */
+int int_map_size(IntMap map) {
+  if (map == NULL) {
+    return 0;
+  }
+  return ((struct IntMap *)map)->size;
+}
+
+/**
+**************************
+* Private functions
+**************************
+*/
+
+// Integer finalizer (murmur3 fmix32) so that sequential ids spread evenly
+static unsigned int int_map_hash(int key) {
+  unsigned int h = (unsigned int)key;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+// Returns the slot holding key, or the empty slot where it would be inserted
+static IntMapSlot *int_map_find_slot(IntMapSlot *slots, int capacity,
+                                     int key) {
+  unsigned int mask = (unsigned int)capacity - 1u;
+  unsigned int i = int_map_hash(key) & mask;
+  while (slots[i].used && slots[i].key != key) {
+    i = (i + 1u) & mask;
+  }
+  return &slots[i];
+}
+
+static bool int_map_grow(struct IntMap *m) {
+  int newCapacity = m->capacity * 2;
+  IntMapSlot *newSlots = calloc((size_t)newCapacity, sizeof(IntMapSlot));
+  if (newSlots == NULL) {
+    return false;
+  }
+
+  for (int i = 0; i < m->capacity; i++) {
+    if (m->slots[i].used) {
+      *int_map_find_slot(newSlots, newCapacity, m->slots[i].key) =
+          m->slots[i];
+    }
+  }
+  free(m->slots);
+  m->slots = newSlots;
+  m->capacity = newCapacity;
+  return true;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file int_map.h
+ * @brief Integer-keyed hash map ADT
+ *
+ * This module provides an abstract data type that maps int keys (such as the
+ * ids used by .qry commands) to opaque pointers with expected constant-time
+ * insertion and lookup. The map never owns the values it stores.
+ */
+
+#ifndef INT_MAP_H
+#define INT_MAP_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * @brief Opaque pointer type for integer map instances
+ */
+typedef void *IntMap;
+
+/**
+ * @brief Creates a new empty map
+ * @return Pointer to new map or NULL on error
+ */
+IntMap int_map_create(void);
+
+/**
+ * @brief Destroys a map and frees its memory
+ * @param map Map instance to destroy
+ * @param destroy_value Function called on every stored value, or NULL to
+ * leave the values untouched
+ */
+void int_map_destroy(IntMap map, void (*destroy_value)(void *value));
+
+/**
+ * @brief Associates a value with a key
+ * @param map Map instance
+ * @param key Key to insert
+ * @param value Value to store; replaces the previous value of the key
+ * @return true if successful, false on allocation failure
+ */
+bool int_map_put(IntMap map, int key, void *value);
+
+/**
+ * @brief Looks up the value stored under a key
+ * @param map Map instance
+ * @param key Key to look up
+ * @return Stored value or NULL if the key is not present
+ */
+void *int_map_get(IntMap map, int key);
+
+/**
+ * @brief Gets the number of keys stored in the map
+ * @param map Map instance
+ * @return Number of keys
+ */
+int int_map_size(IntMap map);
+
+#endif // INT_MAP_H
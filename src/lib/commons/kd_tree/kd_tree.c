@@ -0,0 +1,382 @@
+#include "kd_tree.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Points inserted after a build that are searched one by one
+#define KD_TREE_LINEAR_MAX 1024
+#define KD_TREE_INITIAL_CAPACITY 64
+
+// Internal structure definitions - only visible in implementation
+typedef struct {
+  double x;
+  double y;
+  int item;
+} KdPoint;
+
+// points[0 .. built - 1] form an implicit tree: the median of a range is its
+// root and splits it by x on even depths and by y on odd depths
+struct KdTree {
+  KdPoint *points;
+  int count;
+  int capacity;
+  int built;
+  // item -> its entry in the heap of a running search, -1 when not kept;
+  // all -1 between searches
+  int *slots;
+  int slotCount;
+};
+
+// Best items found so far, as a max-heap on (distance, item)
+typedef struct {
+  int *items;
+  double *distances; // squared while searching
+  int *slots;        // slots of the tree
+  int count;
+  int k;
+  KdTreeFilter accept;
+  void *ctx;
+} KdNearest;
+
+// private functions
+static void kd_tree_build(KdPoint *points, int lo, int hi, int depth);
+static void kd_tree_select(KdPoint *points, int lo, int hi, int nth,
+                           int axis);
+static double kd_point_axis(const KdPoint *p, int axis);
+static void kd_tree_search(const KdPoint *points, int lo, int hi, int depth,
+                           double x, double y, double offset[2],
+                           KdNearest *best);
+static void kd_nearest_offer(KdNearest *best, const KdPoint *p, double x,
+                             double y);
+static bool kd_nearest_worse(const KdNearest *best, int a, int b);
+static void kd_nearest_swap(KdNearest *best, int a, int b);
+static void kd_nearest_sift_down(KdNearest *best, int i);
+static void kd_nearest_sift_up(KdNearest *best, int i);
+static bool kd_nearest_full_and_beyond(const KdNearest *best, double d2);
+
+/**
+ * Creates an empty tree
+ * @return Pointer to new tree or NULL on error
+ */
+KdTree kd_tree_create(void) {
+  struct KdTree *t = malloc(sizeof(struct KdTree));
+  if (t == NULL) {
+    return NULL;
+  }
+
+  t->points = malloc(KD_TREE_INITIAL_CAPACITY * sizeof(KdPoint));
+  if (t->points == NULL) {
+    free(t);
+    return NULL;
+  }
+  t->count = 0;
+  t->capacity = KD_TREE_INITIAL_CAPACITY;
+  t->built = 0;
+  t->slots = NULL;
+  t->slotCount = 0;
+
+  return (KdTree)t;
+}
+
+/**
+ * Destroys the tree
+ * @param tree Pointer to tree to be destroyed
+ */
+void kd_tree_destroy(KdTree tree) {
+  if (tree == NULL) {
+    return;
+  }
+
+  struct KdTree *t = (struct KdTree *)tree;
+  free(t->points);
+  free(t->slots);
+  free(t);
+}
+
+/**
+ * Empties the tree, keeping its memory for new insertions
+ * @param tree Pointer to the tree
+ */
+void kd_tree_clear(KdTree tree) {
+  if (tree == NULL) {
+    return;
+  }
+
+  struct KdTree *t = (struct KdTree *)tree;
+  t->count = 0;
+  t->built = 0;
+}
+
+/**
+ * Appends a point; it joins the tree on a later rebuild
+ * @param tree Pointer to the tree
+ * @param x Point x
+ * @param y Point y
+ * @param item Caller item, not negative
+ * @return true on success, false on error
+ */
+bool kd_tree_insert(KdTree tree, double x, double y, int item) {
+  if (tree == NULL || item < 0) {
+    return false;
+  }
+
+  struct KdTree *t = (struct KdTree *)tree;
+  if (item >= t->slotCount) {
+    int slotCount = t->slotCount > 0 ? t->slotCount * 2 : 64;
+    while (slotCount <= item) {
+      slotCount *= 2;
+    }
+    int *slots = realloc(t->slots, (size_t)slotCount * sizeof(int));
+    if (slots == NULL) {
+      return false;
+    }
+    for (int i = t->slotCount; i < slotCount; i++) {
+      slots[i] = -1;
+    }
+    t->slots = slots;
+    t->slotCount = slotCount;
+  }
+  if (t->count == t->capacity) {
+    KdPoint *points =
+        realloc(t->points, (size_t)t->capacity * 2 * sizeof(KdPoint));
+    if (points == NULL) {
+      return false;
+    }
+    t->points = points;
+    t->capacity *= 2;
+  }
+
+  t->points[t->count++] = (KdPoint){x, y, item};
+  return true;
+}
+
+/**
+ * Gets the number of points
+ * @param tree Pointer to the tree
+ * @return Number of points, 0 if tree is NULL
+ */
+int kd_tree_size(KdTree tree) {
+  if (tree == NULL) {
+    return 0;
+  }
+  return ((struct KdTree *)tree)->count;
+}
+
+/**
+ * Rebuilds the tree if needed and finds the k nearest accepted items
+ * @param tree Pointer to the tree
+ * @param x Query x
+ * @param y Query y
+ * @param k Number of items wanted
+ * @param accept Item filter or NULL
+ * @param ctx Caller data
+ * @param items Output items
+ * @param distances Output distances
+ * @return Number of items found
+ */
+int kd_tree_nearest(KdTree tree, double x, double y, int k,
+                    KdTreeFilter accept, void *ctx, int *items,
+                    double *distances) {
+  if (tree == NULL || k <= 0) {
+    return 0;
+  }
+
+  struct KdTree *t = (struct KdTree *)tree;
+  // Pending points are scanned by every search, so the tree is rebuilt as
+  // soon as they no longer make a short scan
+  if (t->count - t->built > KD_TREE_LINEAR_MAX) {
+    kd_tree_build(t->points, 0, t->count, 0);
+    t->built = t->count;
+  }
+
+  KdNearest best = {items, distances, t->slots, 0, k, accept, ctx};
+  double offset[2] = {0.0, 0.0};
+  kd_tree_search(t->points, 0, t->built, 0, x, y, offset, &best);
+  for (int i = t->built; i < t->count; i++) {
+    kd_nearest_offer(&best, &t->points[i], x, y);
+  }
+
+  // Heap sort: repeatedly move the worst item to the end
+  int found = best.count;
+  for (int n = found; n > 1; n--) {
+    kd_nearest_swap(&best, 0, n - 1);
+    best.count = n - 1;
+    kd_nearest_sift_down(&best, 0);
+  }
+  for (int i = 0; i < found; i++) {
+    t->slots[items[i]] = -1;
+    distances[i] = sqrt(distances[i]);
+  }
+  return found;
+}
+
+/**
+ **************************
+ * Private functions
+ **************************
+ */
+
+static void kd_tree_build(KdPoint *points, int lo, int hi, int depth) {
+  if (hi - lo <= 1) {
+    return;
+  }
+  int mid = lo + (hi - lo) / 2;
+  kd_tree_select(points, lo, hi, mid, depth % 2);
+  kd_tree_build(points, lo, mid, depth + 1);
+  kd_tree_build(points, mid + 1, hi, depth + 1);
+}
+
+// Quickselect: moves the nth smallest point of [lo, hi) on axis to nth, with
+// smaller or equal points before it and greater or equal points after it
+static void kd_tree_select(KdPoint *points, int lo, int hi, int nth,
+                           int axis) {
+  hi--;
+  while (lo < hi) {
+    double pivot = kd_point_axis(&points[lo + (hi - lo) / 2], axis);
+    int i = lo;
+    int j = hi;
+    while (i <= j) {
+      while (kd_point_axis(&points[i], axis) < pivot)
+        i++;
+      while (kd_point_axis(&points[j], axis) > pivot)
+        j--;
+      if (i <= j) {
+        KdPoint swap = points[i];
+        points[i] = points[j];
+        points[j] = swap;
+        i++;
+        j--;
+      }
+    }
+    if (nth <= j)
+      hi = j;
+    else if (nth >= i)
+      lo = i;
+    else
+      return;
+  }
+}
+
+static double kd_point_axis(const KdPoint *p, int axis) {
+  return axis == 0 ? p->x : p->y;
+}
+
+// offset holds, per axis, how far the query is outside the region of
+// [lo, hi); the squared length of offset bounds the distance of its points
+static void kd_tree_search(const KdPoint *points, int lo, int hi, int depth,
+                           double x, double y, double offset[2],
+                           KdNearest *best) {
+  if (lo >= hi) {
+    return;
+  }
+  int mid = lo + (hi - lo) / 2;
+  const KdPoint *p = &points[mid];
+  kd_nearest_offer(best, p, x, y);
+
+  int axis = depth % 2;
+  double delta = (axis == 0 ? x : y) - kd_point_axis(p, axis);
+  int nearLo = delta < 0.0 ? lo : mid + 1;
+  int nearHi = delta < 0.0 ? mid : hi;
+  int farLo = delta < 0.0 ? mid + 1 : lo;
+  int farHi = delta < 0.0 ? hi : mid;
+  kd_tree_search(points, nearLo, nearHi, depth + 1, x, y, offset, best);
+
+  // The far side only if its region is close enough to hold a better (or
+  // equally distant, lower item) point
+  double saved = offset[axis];
+  offset[axis] = delta;
+  double bound = offset[0] * offset[0] + offset[1] * offset[1];
+  if (!kd_nearest_full_and_beyond(best, bound)) {
+    kd_tree_search(points, farLo, farHi, depth + 1, x, y, offset, best);
+  }
+  offset[axis] = saved;
+}
+
+// Considers a point; an item already kept only gets closer
+static void kd_nearest_offer(KdNearest *best, const KdPoint *p, double x,
+                             double y) {
+  double dx = p->x - x;
+  double dy = p->y - y;
+  double d2 = dx * dx + dy * dy;
+  // Not better than the worst kept item, which also means it cannot bring
+  // a kept item closer
+  if (best->count == best->k &&
+      (d2 > best->distances[0] ||
+       (d2 == best->distances[0] && p->item >= best->items[0])))
+    return;
+  if (best->accept != NULL && !best->accept(best->ctx, p->item))
+    return;
+
+  int kept = best->slots[p->item];
+  if (kept >= 0) {
+    if (d2 < best->distances[kept]) {
+      best->distances[kept] = d2;
+      kd_nearest_sift_down(best, kept);
+    }
+    return;
+  }
+
+  if (best->count < best->k) {
+    int i = best->count++;
+    best->items[i] = p->item;
+    best->distances[i] = d2;
+    best->slots[p->item] = i;
+    kd_nearest_sift_up(best, i);
+    return;
+  }
+  // Replace the worst kept item
+  best->slots[best->items[0]] = -1;
+  best->items[0] = p->item;
+  best->distances[0] = d2;
+  best->slots[p->item] = 0;
+  kd_nearest_sift_down(best, 0);
+}
+
+// Whether entry a ranks after entry b: farther, or as far with a higher item
+static bool kd_nearest_worse(const KdNearest *best, int a, int b) {
+  if (best->distances[a] != best->distances[b])
+    return best->distances[a] > best->distances[b];
+  return best->items[a] > best->items[b];
+}
+
+// Exchanges two heap entries, keeping the item slots in step
+static void kd_nearest_swap(KdNearest *best, int a, int b) {
+  int item = best->items[a];
+  double d2 = best->distances[a];
+  best->items[a] = best->items[b];
+  best->distances[a] = best->distances[b];
+  best->items[b] = item;
+  best->distances[b] = d2;
+  best->slots[best->items[a]] = a;
+  best->slots[item] = b;
+}
+
+static void kd_nearest_sift_down(KdNearest *best, int i) {
+  for (;;) {
+    int worst = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < best->count && kd_nearest_worse(best, left, worst))
+      worst = left;
+    if (right < best->count && kd_nearest_worse(best, right, worst))
+      worst = right;
+    if (worst == i)
+      return;
+    kd_nearest_swap(best, i, worst);
+    i = worst;
+  }
+}
+
+static void kd_nearest_sift_up(KdNearest *best, int i) {
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!kd_nearest_worse(best, i, parent))
+      return;
+    kd_nearest_swap(best, i, parent);
+    i = parent;
+  }
+}
+
+// Whether k items are kept and all of them are nearer than d2
+static bool kd_nearest_full_and_beyond(const KdNearest *best, double d2) {
+  return best->count == best->k && d2 > best->distances[0];
+}
@@ -0,0 +1,88 @@
+/**
+ * @file kd_tree.h
+ * @brief 2-d tree over points for k-nearest-neighbor queries
+ *
+ * Points carry a non-negative int item chosen by the caller, and several
+ * points may share an item (for instance both end points of a line). Items
+ * should be dense, such as array indices: the tree keeps a slot per item up
+ * to the largest one, so a search finds the entry of a kept item in O(1).
+ * The tree is balanced by median splits the first time it is searched;
+ * points inserted later are scanned one by one until they are numerous
+ * enough to rebuild the whole tree.
+ */
+
+#ifndef KD_TREE_H
+#define KD_TREE_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Opaque pointer type for k-d tree instances
+ */
+typedef void *KdTree;
+
+/**
+ * @brief Function deciding whether an item may be returned by a search
+ * @param ctx Caller data given to kd_tree_nearest
+ * @param item Item of a candidate point
+ * @return true to accept the item, false to skip it
+ */
+typedef bool (*KdTreeFilter)(void *ctx, int item);
+
+/**
+ * @brief Creates an empty tree
+ * @return Pointer to new tree or NULL on error
+ */
+KdTree kd_tree_create(void);
+
+/**
+ * @brief Destroys a tree and frees its memory
+ * @param tree Tree instance to destroy
+ */
+void kd_tree_destroy(KdTree tree);
+
+/**
+ * @brief Removes every point from the tree
+ * @param tree Tree instance
+ */
+void kd_tree_clear(KdTree tree);
+
+/**
+ * @brief Inserts a point
+ * @param tree Tree instance
+ * @param x Point x
+ * @param y Point y
+ * @param item Item reported when the point is found, not negative
+ * @return true if successful, false on a negative item or allocation
+ * failure
+ */
+bool kd_tree_insert(KdTree tree, double x, double y, int item);
+
+/**
+ * @brief Gets the number of points in the tree
+ * @param tree Tree instance
+ * @return Number of points
+ */
+int kd_tree_size(KdTree tree);
+
+/**
+ * @brief Finds the k accepted items nearest to a point
+ *
+ * The distance of an item is that of its nearest point. Results are sorted
+ * by distance, ties by item.
+ *
+ * @param tree Tree instance
+ * @param x Query x
+ * @param y Query y
+ * @param k Maximum number of items to find
+ * @param accept Filter for the items, or NULL to accept all of them
+ * @param ctx Caller data passed to accept
+ * @param items Output array of at least k items
+ * @param distances Output array of at least k Euclidean distances
+ * @return Number of items found (at most k)
+ */
+int kd_tree_nearest(KdTree tree, double x, double y, int k,
+                    KdTreeFilter accept, void *ctx, int *items,
+                    double *distances);
+
+#endif // KD_TREE_H
@@ -1,19 +1,7 @@
 #include "queue.h"
+#include "queue_internal.h"
 #include <stdio.h>
 
-// Internal structure definitions - only visible in implementation
-typedef struct QueueNode {
-  void *data;
-  struct QueueNode *next;
-} QueueNode;
-
-// Complete Queue structure definition
-struct Queue {
-  QueueNode *front; // First element in queue
-  QueueNode *rear;  // Last element in queue
-  int size;         // Current queue size
-};
-
 /**
  * Creates a new empty queue
  * @return Pointer to new queue or NULL on error
@@ -144,6 +132,53 @@ int queue_size(Queue queue) {
   return q->size;
 }
 
+/**
+ * Moves all elements of src to the rear of dest, preserving their order
+ * @param dest Pointer to the destination queue
+ * @param src Pointer to the source queue
+ */
+void queue_append_all(Queue dest, Queue src) {
+  if (dest == NULL || src == NULL || dest == src) {
+    return;
+  }
+
+  struct Queue *d = (struct Queue *)dest;
+  struct Queue *s = (struct Queue *)src;
+  if (s->front == NULL) {
+    return;
+  }
+
+  if (d->rear == NULL) {
+    d->front = s->front;
+  } else {
+    d->rear->next = s->front;
+  }
+  d->rear = s->rear;
+  d->size += s->size;
+
+  s->front = NULL;
+  s->rear = NULL;
+  s->size = 0;
+}
+
+/**
+ * Visits every element in queue order
+ * @param queue Pointer to the queue
+ * @param visit Function called with each element and ctx
+ * @param ctx Caller data
+ */
+void queue_for_each(Queue queue, void (*visit)(void *data, void *ctx),
+                    void *ctx) {
+  if (queue == NULL || visit == NULL) {
+    return;
+  }
+
+  struct Queue *q = (struct Queue *)queue;
+  for (QueueNode *node = q->front; node != NULL; node = node->next) {
+    visit(node->data, ctx);
+  }
+}
+
 /**
  * Removes all elements from the queue
  * @param queue Pointer to the queue
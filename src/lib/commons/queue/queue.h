@@ -66,6 +66,27 @@ bool queue_is_empty(Queue queue);
  */
 int queue_size(Queue queue);
 
+/**
+ * @brief Moves every element of one queue to the end of another
+ *
+ * The elements keep their order and src is left empty. The nodes are
+ * relinked, so this takes constant time.
+ *
+ * @param dest Queue receiving the elements
+ * @param src Queue whose elements are moved (must differ from dest)
+ */
+void queue_append_all(Queue dest, Queue src);
+
+/**
+ * @brief Calls visit on every element, from front to rear, without removing
+ * them
+ * @param queue Queue instance
+ * @param visit Function receiving each element and ctx
+ * @param ctx Caller data passed to visit
+ */
+void queue_for_each(Queue queue, void (*visit)(void *data, void *ctx),
+                    void *ctx);
+
 /**
  * @brief Removes all elements from the queue without destroying it
  * @param queue Queue instance
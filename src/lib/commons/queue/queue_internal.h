@@ -0,0 +1,31 @@
+/**
+ * Queue internals - Library-private node layout
+ *
+ * Inline access to the nodes of a queue, for readers that walk part of a
+ * queue they do not own (such as a ground view reading its base) without
+ * copying it. No NULL checks are performed.
+ */
+#ifndef QUEUE_INTERNAL_H
+#define QUEUE_INTERNAL_H
+
+#include "queue.h"
+
+typedef struct QueueNode {
+  void *data;
+  struct QueueNode *next;
+} QueueNode;
+
+/**
+ * Internal Queue structure
+ */
+struct Queue {
+  QueueNode *front; // First element in queue
+  QueueNode *rear;  // Last element in queue
+  int size;         // Current queue size
+};
+
+static inline const QueueNode *queue_fast_front(Queue queue) {
+  return ((struct Queue *)queue)->front;
+}
+
+#endif // QUEUE_INTERNAL_H
@@ -0,0 +1,342 @@
+#include "rtree.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Children per node
+#define RTREE_FANOUT 16
+// Boxes inserted after packing that are searched one by one
+#define RTREE_LINEAR_MAX 1024
+#define RTREE_INITIAL_CAPACITY 64
+
+// Positions in a box; entries and nodes both start with one, so STR sorts
+// either through a pointer to it
+enum { MIN_X, MIN_Y, MAX_X, MAX_Y };
+
+// Internal structure definitions - only visible in implementation
+typedef struct {
+  double box[4];
+  int item;
+} RTreeEntry;
+
+typedef struct {
+  double box[4];
+  int first; // first child: an entry for leaves, a node otherwise
+  int count;
+} RTreeNode;
+
+// Nodes of one packed tree, from the leaves up to the root
+typedef struct {
+  RTreeNode *nodes;
+  int count;
+  int leafCount; // nodes[0 .. leafCount - 1] are leaves
+  int root;      // -1 when empty
+} RTreePacked;
+
+// entries[0 .. basePacked - 1] are indexed by base and
+// entries[basePacked .. pendingPacked - 1] by pending; the rest are scanned
+struct RTree {
+  RTreeEntry *entries;
+  int count;
+  int capacity;
+  int basePacked;
+  int pendingPacked;
+  RTreePacked base;
+  RTreePacked pending;
+};
+
+// private functions
+static bool rtree_pack(RTreePacked *tree, RTreeEntry *entries, int first,
+                       int count);
+static void rtree_str_sort(void *items, int count, size_t size);
+static int rtree_compare_x(const void *a, const void *b);
+static int rtree_compare_y(const void *a, const void *b);
+static void rtree_search_packed(const RTreePacked *tree,
+                                const RTreeEntry *entries, int node,
+                                const double window[4], RTreeVisitor visit,
+                                void *ctx);
+static bool rtree_boxes_overlap(const double box[4], const double window[4]);
+static void rtree_grow_box(double box[4], const double other[4]);
+
+/**
+ * Creates an empty tree
+ * @return Pointer to new tree or NULL on error
+ */
+RTree rtree_create(void) {
+  struct RTree *t = malloc(sizeof(struct RTree));
+  if (t == NULL) {
+    return NULL;
+  }
+
+  t->entries = malloc(RTREE_INITIAL_CAPACITY * sizeof(RTreeEntry));
+  if (t->entries == NULL) {
+    free(t);
+    return NULL;
+  }
+  t->count = 0;
+  t->capacity = RTREE_INITIAL_CAPACITY;
+  t->basePacked = t->pendingPacked = 0;
+  t->base = (RTreePacked){NULL, 0, 0, -1};
+  t->pending = (RTreePacked){NULL, 0, 0, -1};
+
+  return (RTree)t;
+}
+
+/**
+ * Destroys the tree
+ * @param tree Pointer to tree to be destroyed
+ */
+void rtree_destroy(RTree tree) {
+  if (tree == NULL) {
+    return;
+  }
+
+  struct RTree *t = (struct RTree *)tree;
+  free(t->base.nodes);
+  free(t->pending.nodes);
+  free(t->entries);
+  free(t);
+}
+
+/**
+ * Empties the tree, keeping its memory for new insertions
+ * @param tree Pointer to the tree
+ */
+void rtree_clear(RTree tree) {
+  if (tree == NULL) {
+    return;
+  }
+
+  struct RTree *t = (struct RTree *)tree;
+  t->count = 0;
+  t->basePacked = t->pendingPacked = 0;
+  t->base.count = t->base.leafCount = 0;
+  t->base.root = -1;
+  t->pending.count = t->pending.leafCount = 0;
+  t->pending.root = -1;
+}
+
+/**
+ * Appends a box; it is packed on the next search
+ * @param tree Pointer to the tree
+ * @param minX Minimum x
+ * @param minY Minimum y
+ * @param maxX Maximum x
+ * @param maxY Maximum y
+ * @param item Caller item
+ * @return true on success, false on error
+ */
+bool rtree_insert(RTree tree, double minX, double minY, double maxX,
+                  double maxY, int item) {
+  if (tree == NULL) {
+    return false;
+  }
+
+  struct RTree *t = (struct RTree *)tree;
+  if (t->count == t->capacity) {
+    RTreeEntry *entries =
+        realloc(t->entries, (size_t)t->capacity * 2 * sizeof(RTreeEntry));
+    if (entries == NULL) {
+      return false;
+    }
+    t->entries = entries;
+    t->capacity *= 2;
+  }
+
+  t->entries[t->count++] = (RTreeEntry){{minX, minY, maxX, maxY}, item};
+  return true;
+}
+
+/**
+ * Gets the number of boxes
+ * @param tree Pointer to the tree
+ * @return Number of boxes, 0 if tree is NULL
+ */
+int rtree_size(RTree tree) {
+  if (tree == NULL) {
+    return 0;
+  }
+  return ((struct RTree *)tree)->count;
+}
+
+/**
+ * Packs pending insertions if needed and visits the boxes in the window
+ * @param tree Pointer to the tree
+ * @param minX Window minimum x
+ * @param minY Window minimum y
+ * @param maxX Window maximum x
+ * @param maxY Window maximum y
+ * @param visit Item visitor
+ * @param ctx Caller data
+ * @return true on success, false on error
+ */
+bool rtree_search(RTree tree, double minX, double minY, double maxX,
+                  double maxY, RTreeVisitor visit, void *ctx) {
+  if (tree == NULL || visit == NULL) {
+    return false;
+  }
+
+  struct RTree *t = (struct RTree *)tree;
+  int inserted = t->count - t->basePacked;
+  if (inserted > RTREE_LINEAR_MAX && inserted > t->basePacked / 8) {
+    // Late insertions are a sizable share: repack everything together
+    if (!rtree_pack(&t->base, t->entries, 0, t->count)) {
+      return false;
+    }
+    t->basePacked = t->pendingPacked = t->count;
+    t->pending.count = t->pending.leafCount = 0;
+    t->pending.root = -1;
+  } else if (t->count - t->pendingPacked > RTREE_LINEAR_MAX) {
+    if (!rtree_pack(&t->pending, t->entries, t->basePacked, inserted)) {
+      return false;
+    }
+    t->pendingPacked = t->count;
+  }
+
+  double window[4] = {minX, minY, maxX, maxY};
+  if (t->base.root >= 0) {
+    rtree_search_packed(&t->base, t->entries, t->base.root, window, visit,
+                        ctx);
+  }
+  if (t->pending.root >= 0) {
+    rtree_search_packed(&t->pending, t->entries, t->pending.root, window,
+                        visit, ctx);
+  }
+  for (int i = t->pendingPacked; i < t->count; i++) {
+    if (rtree_boxes_overlap(t->entries[i].box, window)) {
+      visit(ctx, t->entries[i].item);
+    }
+  }
+  return true;
+}
+
+/**
+ **************************
+ * Private functions
+ **************************
+ */
+
+// Packs entries[first .. first + count - 1] with STR, reordering them, and
+// builds the levels above the leaves the same way over the node boxes
+static bool rtree_pack(RTreePacked *tree, RTreeEntry *entries, int first,
+                       int count) {
+  tree->count = tree->leafCount = 0;
+  tree->root = -1;
+  if (count == 0) {
+    return true;
+  }
+
+  int total = 0;
+  int level = count;
+  do {
+    level = (level + RTREE_FANOUT - 1) / RTREE_FANOUT;
+    total += level;
+  } while (level > 1);
+  RTreeNode *nodes = realloc(tree->nodes, (size_t)total * sizeof(RTreeNode));
+  if (nodes == NULL) {
+    return false;
+  }
+  tree->nodes = nodes;
+
+  rtree_str_sort(&entries[first], count, sizeof(RTreeEntry));
+  for (int i = 0; i < count; i += RTREE_FANOUT) {
+    RTreeNode *node = &nodes[tree->count++];
+    node->first = first + i;
+    node->count = count - i < RTREE_FANOUT ? count - i : RTREE_FANOUT;
+    for (int k = 0; k < 4; k++) {
+      node->box[k] = entries[node->first].box[k];
+    }
+    for (int k = 1; k < node->count; k++) {
+      rtree_grow_box(node->box, entries[node->first + k].box);
+    }
+  }
+  tree->leafCount = tree->count;
+
+  int levelStart = 0;
+  int levelCount = tree->count;
+  while (levelCount > 1) {
+    // Children are moved before their parents point at them
+    rtree_str_sort(&nodes[levelStart], levelCount, sizeof(RTreeNode));
+    int parentStart = tree->count;
+    for (int i = 0; i < levelCount; i += RTREE_FANOUT) {
+      RTreeNode *node = &nodes[tree->count++];
+      node->first = levelStart + i;
+      node->count =
+          levelCount - i < RTREE_FANOUT ? levelCount - i : RTREE_FANOUT;
+      for (int k = 0; k < 4; k++) {
+        node->box[k] = nodes[node->first].box[k];
+      }
+      for (int k = 1; k < node->count; k++) {
+        rtree_grow_box(node->box, nodes[node->first + k].box);
+      }
+    }
+    levelStart = parentStart;
+    levelCount = tree->count - parentStart;
+  }
+  tree->root = levelStart;
+  return true;
+}
+
+// Sort-Tile-Recursive order: vertical slices by center x, each sliced into
+// runs of RTREE_FANOUT by center y. Items are entries or nodes.
+static void rtree_str_sort(void *items, int count, size_t size) {
+  qsort(items, (size_t)count, size, rtree_compare_x);
+
+  int leaves = (count + RTREE_FANOUT - 1) / RTREE_FANOUT;
+  int slices = (int)ceil(sqrt((double)leaves));
+  int perSlice = slices * RTREE_FANOUT;
+  for (int i = 0; i < count; i += perSlice) {
+    int n = count - i < perSlice ? count - i : perSlice;
+    qsort((char *)items + (size_t)i * size, (size_t)n, size,
+          rtree_compare_y);
+  }
+}
+
+static int rtree_compare_x(const void *a, const void *b) {
+  const double *p = *(const double(*)[4])a;
+  const double *q = *(const double(*)[4])b;
+  double cp = p[MIN_X] + p[MAX_X];
+  double cq = q[MIN_X] + q[MAX_X];
+  return (cp > cq) - (cp < cq);
+}
+
+static int rtree_compare_y(const void *a, const void *b) {
+  const double *p = *(const double(*)[4])a;
+  const double *q = *(const double(*)[4])b;
+  double cp = p[MIN_Y] + p[MAX_Y];
+  double cq = q[MIN_Y] + q[MAX_Y];
+  return (cp > cq) - (cp < cq);
+}
+
+static void rtree_search_packed(const RTreePacked *tree,
+                                const RTreeEntry *entries, int node,
+                                const double window[4], RTreeVisitor visit,
+                                void *ctx) {
+  const RTreeNode *n = &tree->nodes[node];
+  if (!rtree_boxes_overlap(n->box, window)) {
+    return;
+  }
+
+  if (node < tree->leafCount) {
+    for (int i = n->first; i < n->first + n->count; i++) {
+      if (rtree_boxes_overlap(entries[i].box, window)) {
+        visit(ctx, entries[i].item);
+      }
+    }
+    return;
+  }
+  for (int c = n->first; c < n->first + n->count; c++) {
+    rtree_search_packed(tree, entries, c, window, visit, ctx);
+  }
+}
+
+static bool rtree_boxes_overlap(const double box[4], const double window[4]) {
+  return !(box[MAX_X] < window[MIN_X] || window[MAX_X] < box[MIN_X] ||
+           box[MAX_Y] < window[MIN_Y] || window[MAX_Y] < box[MIN_Y]);
+}
+
+static void rtree_grow_box(double box[4], const double other[4]) {
+  box[MIN_X] = other[MIN_X] < box[MIN_X] ? other[MIN_X] : box[MIN_X];
+  box[MIN_Y] = other[MIN_Y] < box[MIN_Y] ? other[MIN_Y] : box[MIN_Y];
+  box[MAX_X] = other[MAX_X] > box[MAX_X] ? other[MAX_X] : box[MAX_X];
+  box[MAX_Y] = other[MAX_Y] > box[MAX_Y] ? other[MAX_Y] : box[MAX_Y];
+}
@@ -0,0 +1,87 @@
+/**
+ * @file rtree.h
+ * @brief R-tree over axis-aligned boxes for window queries
+ *
+ * Boxes are identified by an int item chosen by the caller. The tree is
+ * packed with the Sort-Tile-Recursive (STR) bulk-loading algorithm the
+ * first time it is searched. Boxes inserted afterwards are packed into a
+ * second, smaller tree, and everything is repacked together once they
+ * become a sizable share of the whole, so inserting in bulk between
+ * searches stays cheap. Removal is not supported; callers filter stale
+ * items in the visitor or rebuild the tree.
+ */
+
+#ifndef RTREE_H
+#define RTREE_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Opaque pointer type for R-tree instances
+ */
+typedef void *RTree;
+
+/**
+ * @brief Function receiving each item found by a search
+ * @param ctx Caller data given to rtree_search
+ * @param item Item of a box overlapping the window
+ */
+typedef void (*RTreeVisitor)(void *ctx, int item);
+
+/**
+ * @brief Creates an empty tree
+ * @return Pointer to new tree or NULL on error
+ */
+RTree rtree_create(void);
+
+/**
+ * @brief Destroys a tree and frees its memory
+ * @param tree Tree instance to destroy
+ */
+void rtree_destroy(RTree tree);
+
+/**
+ * @brief Removes every box from the tree
+ * @param tree Tree instance
+ */
+void rtree_clear(RTree tree);
+
+/**
+ * @brief Inserts a box
+ * @param tree Tree instance
+ * @param minX Minimum x of the box
+ * @param minY Minimum y of the box
+ * @param maxX Maximum x of the box
+ * @param maxY Maximum y of the box
+ * @param item Item reported when the box is found
+ * @return true if successful, false on allocation failure
+ */
+bool rtree_insert(RTree tree, double minX, double minY, double maxX,
+                  double maxY, int item);
+
+/**
+ * @brief Gets the number of boxes in the tree
+ * @param tree Tree instance
+ * @return Number of boxes
+ */
+int rtree_size(RTree tree);
+
+/**
+ * @brief Calls visit for every box overlapping a window
+ *
+ * Boxes touching the window on an edge overlap it. Items are visited in no
+ * particular order.
+ *
+ * @param tree Tree instance
+ * @param minX Minimum x of the window
+ * @param minY Minimum y of the window
+ * @param maxX Maximum x of the window
+ * @param maxY Maximum y of the window
+ * @param visit Function receiving each item found
+ * @param ctx Caller data passed to visit
+ * @return true if successful, false on allocation failure while packing
+ */
+bool rtree_search(RTree tree, double minX, double minY, double maxX,
+                  double maxY, RTreeVisitor visit, void *ctx);
+
+#endif // RTREE_H
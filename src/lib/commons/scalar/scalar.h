@@ -0,0 +1,21 @@
+/**
+ * @file scalar.h
+ * @brief Geometry scalar type
+ *
+ * Defines the scalar type used to store coordinates, sizes and cached
+ * geometry in shapes and arena records. It is double by default; building
+ * with -DGEOMETRY_SINGLE_PRECISION (make PRECISION=single) switches it to
+ * float, halving the memory taken by geometry in large scenes at the cost
+ * of precision. Public getters keep returning double either way.
+ */
+
+#ifndef SCALAR_H
+#define SCALAR_H
+
+#ifdef GEOMETRY_SINGLE_PRECISION
+typedef float Scalar;
+#else
+typedef double Scalar;
+#endif
+
+#endif // SCALAR_H
@@ -0,0 +1,130 @@
+#include "shared_string.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+// Reference counts are guarded by a lock picked from the string's address,
+// so owners on different threads (.qry runs sharing the shapes of one
+// ground) may retain and release the same string, while strings that map to
+// different locks never wait for each other
+#define SHARED_STRING_LOCKS 64
+
+#define SHARED_STRING_LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#define SHARED_STRING_LOCKS_8                                                  \
+  SHARED_STRING_LOCK_INIT, SHARED_STRING_LOCK_INIT, SHARED_STRING_LOCK_INIT,   \
+      SHARED_STRING_LOCK_INIT, SHARED_STRING_LOCK_INIT,                        \
+      SHARED_STRING_LOCK_INIT, SHARED_STRING_LOCK_INIT, SHARED_STRING_LOCK_INIT
+static pthread_mutex_t refsLocks[SHARED_STRING_LOCKS] = {
+    SHARED_STRING_LOCKS_8, SHARED_STRING_LOCKS_8, SHARED_STRING_LOCKS_8,
+    SHARED_STRING_LOCKS_8, SHARED_STRING_LOCKS_8, SHARED_STRING_LOCKS_8,
+    SHARED_STRING_LOCKS_8, SHARED_STRING_LOCKS_8};
+#undef SHARED_STRING_LOCKS_8
+#undef SHARED_STRING_LOCK_INIT
+
+// Header and characters live in a single allocation
+struct SharedString {
+  int refs;      // Number of owners
+  size_t length; // Cached strlen of chars
+  char chars[];  // Null-terminated characters
+};
+
+// private functions
+static pthread_mutex_t *refs_lock(const struct SharedString *str);
+
+/**
+ * Creates a shared string holding a copy of s
+ * @param s Source string
+ * @return New shared string or NULL on error
+ */
+SharedString shared_string_create(const char *s) {
+  if (s == NULL) {
+    return NULL;
+  }
+
+  size_t length = strlen(s);
+  struct SharedString *str =
+      (struct SharedString *)malloc(sizeof(struct SharedString) + length + 1);
+  if (str == NULL) {
+    return NULL;
+  }
+
+  str->refs = 1;
+  str->length = length;
+  memcpy(str->chars, s, length + 1);
+
+  return (SharedString)str;
+}
+
+/**
+ * Adds a reference to the shared string
+ * @param str Shared string
+ * @return The same shared string
+ */
+SharedString shared_string_retain(SharedString str) {
+  if (str == NULL) {
+    return NULL;
+  }
+
+  struct SharedString *s = (struct SharedString *)str;
+  pthread_mutex_t *lock = refs_lock(s);
+  pthread_mutex_lock(lock);
+  s->refs++;
+  pthread_mutex_unlock(lock);
+  return str;
+}
+
+/**
+ * Drops a reference and frees the string when it was the last one
+ * @param str Shared string
+ */
+void shared_string_release(SharedString str) {
+  if (str == NULL) {
+    return;
+  }
+
+  struct SharedString *s = (struct SharedString *)str;
+  pthread_mutex_t *lock = refs_lock(s);
+  pthread_mutex_lock(lock);
+  int refs = --s->refs;
+  pthread_mutex_unlock(lock);
+  if (refs == 0) {
+    free(s);
+  }
+}
+
+/**
+ * Returns the characters of the shared string
+ * @param str Shared string
+ * @return Characters or NULL if str is NULL
+ */
+const char *shared_string_get(SharedString str) {
+  if (str == NULL) {
+    return NULL;
+  }
+
+  return ((struct SharedString *)str)->chars;
+}
+
+/**
+ * Returns the cached length of the shared string
+ * @param str Shared string
+ * @return Length or 0 if str is NULL
+ */
+size_t shared_string_length(SharedString str) {
+  if (str == NULL) {
+    return 0;
+  }
+
+  return ((struct SharedString *)str)->length;
+}
+
+/**
+ * *** Private functions ***
+ */
+
+// Lock of the reference count of str; the low bits of the address are
+// dropped, as every allocation is aligned
+static pthread_mutex_t *refs_lock(const struct SharedString *str) {
+  uintptr_t address = (uintptr_t)str;
+  return &refsLocks[(address >> 4 ^ address >> 10) % SHARED_STRING_LOCKS];
+}
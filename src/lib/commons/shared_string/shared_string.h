@@ -0,0 +1,56 @@
+/**
+ * @file shared_string.h
+ * @brief Immutable reference-counted string
+ *
+ * This module provides an immutable string that is stored once and shared
+ * by every owner through reference counting. The length is computed when
+ * the string is created and cached, so owners never need to call strlen.
+ * Reference counts are updated under a lock, so owners may live on
+ * different threads.
+ */
+
+#ifndef SHARED_STRING_H
+#define SHARED_STRING_H
+
+#include <stdlib.h>
+
+/**
+ * @brief Opaque pointer type for shared string instances
+ */
+typedef void *SharedString;
+
+/**
+ * @brief Creates a shared string holding a copy of the given characters
+ * @param s Source string to copy
+ * @return New shared string with one reference or NULL on error
+ */
+SharedString shared_string_create(const char *s);
+
+/**
+ * @brief Adds a reference to a shared string
+ * @param str Shared string instance
+ * @return The same shared string, for convenience
+ */
+SharedString shared_string_retain(SharedString str);
+
+/**
+ * @brief Drops a reference, freeing the string when none are left
+ * @param str Shared string instance
+ */
+void shared_string_release(SharedString str);
+
+/**
+ * @brief Gets the characters of a shared string
+ * @param str Shared string instance
+ * @return Null-terminated characters (do not free or modify)
+ */
+const char *shared_string_get(SharedString str);
+
+/**
+ * @brief Gets the cached length of a shared string
+ * @param str Shared string instance
+ * @return Number of characters, excluding the terminator
+ */
+size_t shared_string_length(SharedString str);
+
+#endif // SHARED_STRING_H
@@ -0,0 +1,326 @@
+#include "spatial_grid.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define SPATIAL_GRID_INITIAL_CAPACITY 64
+// Upper bound on the number of cells per box, keeping memory linear
+#define SPATIAL_GRID_CELLS_PER_BOX 2
+
+// Internal structure definitions - only visible in implementation
+typedef struct {
+  double minX;
+  double minY;
+  double maxX;
+  double maxY;
+} GridBox;
+
+// Boxes in insertion order; the cell layout is chosen when pairs are queried
+struct SpatialGrid {
+  GridBox *boxes;
+  int count;
+  int capacity;
+  double originX;
+  double originY;
+  double cellSize;
+  int cellsX;
+  int cellsY;
+};
+
+// private functions
+static void spatial_grid_choose_cells(struct SpatialGrid *g);
+static int spatial_grid_column(const struct SpatialGrid *g, double x);
+static int spatial_grid_row(const struct SpatialGrid *g, double y);
+static int spatial_grid_compare_indices(const void *a, const void *b);
+
+/**
+ * Creates an empty grid
+ * @param capacity Expected number of boxes
+ * @return Pointer to new grid or NULL on error
+ */
+SpatialGrid spatial_grid_create(int capacity) {
+  struct SpatialGrid *g = malloc(sizeof(struct SpatialGrid));
+  if (g == NULL) {
+    return NULL;
+  }
+
+  g->capacity = capacity > 0 ? capacity : SPATIAL_GRID_INITIAL_CAPACITY;
+  g->boxes = malloc((size_t)g->capacity * sizeof(GridBox));
+  if (g->boxes == NULL) {
+    free(g);
+    return NULL;
+  }
+  g->count = 0;
+  g->originX = g->originY = 0.0;
+  g->cellSize = 1.0;
+  g->cellsX = g->cellsY = 1;
+
+  return (SpatialGrid)g;
+}
+
+/**
+ * Destroys the grid
+ * @param grid Pointer to grid to be destroyed
+ */
+void spatial_grid_destroy(SpatialGrid grid) {
+  if (grid == NULL) {
+    return;
+  }
+
+  struct SpatialGrid *g = (struct SpatialGrid *)grid;
+  free(g->boxes);
+  free(g);
+}
+
+/**
+ * Appends a box to the grid
+ * @param grid Pointer to the grid
+ * @param minX Minimum x
+ * @param minY Minimum y
+ * @param maxX Maximum x
+ * @param maxY Maximum y
+ * @return true on success, false on error
+ */
+bool spatial_grid_add(SpatialGrid grid, double minX, double minY,
+                      double maxX, double maxY) {
+  if (grid == NULL) {
+    return false;
+  }
+
+  struct SpatialGrid *g = (struct SpatialGrid *)grid;
+  if (g->count == g->capacity) {
+    GridBox *boxes =
+        realloc(g->boxes, (size_t)g->capacity * 2 * sizeof(GridBox));
+    if (boxes == NULL) {
+      return false;
+    }
+    g->boxes = boxes;
+    g->capacity *= 2;
+  }
+
+  GridBox *box = &g->boxes[g->count++];
+  box->minX = minX;
+  box->minY = minY;
+  box->maxX = maxX;
+  box->maxY = maxY;
+  return true;
+}
+
+/**
+ * Gets the number of boxes
+ * @param grid Pointer to the grid
+ * @return Number of boxes, 0 if grid is NULL
+ */
+int spatial_grid_size(SpatialGrid grid) {
+  if (grid == NULL) {
+    return 0;
+  }
+  return ((struct SpatialGrid *)grid)->count;
+}
+
+/**
+ * Bins the boxes and visits each overlapping pair once
+ * @param grid Pointer to the grid
+ * @param visit Pair visitor
+ * @param ctx Caller data
+ * @return true on success, false on error
+ */
+bool spatial_grid_for_each_overlap(SpatialGrid grid, SpatialGridVisitor visit,
+                                   void *ctx) {
+  if (grid == NULL || visit == NULL) {
+    return false;
+  }
+
+  struct SpatialGrid *g = (struct SpatialGrid *)grid;
+  if (g->count < 2) {
+    return true;
+  }
+  spatial_grid_choose_cells(g);
+
+  // Cells are stored compressed: the boxes of cell c are entries[cellStart[c]]
+  // up to entries[cellStart[c + 1] - 1], in index order
+  size_t cells = (size_t)g->cellsX * (size_t)g->cellsY;
+  size_t *cellStart = calloc(cells + 1, sizeof(size_t));
+  if (cellStart == NULL) {
+    return false;
+  }
+
+  // Counting pass: cellStart[c + 1] holds the boxes covering cell c, then
+  // the prefix sum turns the counts into offsets
+  for (int i = 0; i < g->count; i++) {
+    const GridBox *b = &g->boxes[i];
+    int c0 = spatial_grid_column(g, b->minX);
+    int c1 = spatial_grid_column(g, b->maxX);
+    int r0 = spatial_grid_row(g, b->minY);
+    int r1 = spatial_grid_row(g, b->maxY);
+    for (int r = r0; r <= r1; r++) {
+      for (int c = c0; c <= c1; c++) {
+        cellStart[(size_t)r * g->cellsX + c + 1]++;
+      }
+    }
+  }
+  for (size_t c = 0; c < cells; c++) {
+    cellStart[c + 1] += cellStart[c];
+  }
+
+  int *entries = malloc((cellStart[cells] > 0 ? cellStart[cells] : 1) *
+                        sizeof(int));
+  size_t *fill = malloc(cells * sizeof(size_t));
+  if (entries == NULL || fill == NULL) {
+    free(entries);
+    free(fill);
+    free(cellStart);
+    return false;
+  }
+  for (size_t c = 0; c < cells; c++) {
+    fill[c] = cellStart[c];
+  }
+  for (int i = 0; i < g->count; i++) {
+    const GridBox *b = &g->boxes[i];
+    int c0 = spatial_grid_column(g, b->minX);
+    int c1 = spatial_grid_column(g, b->maxX);
+    int r0 = spatial_grid_row(g, b->minY);
+    int r1 = spatial_grid_row(g, b->maxY);
+    for (int r = r0; r <= r1; r++) {
+      for (int c = c0; c <= c1; c++) {
+        entries[fill[(size_t)r * g->cellsX + c]++] = i;
+      }
+    }
+  }
+  free(fill);
+
+  // Each box collects the later boxes it overlaps, so the pairs come out
+  // ordered by first index and, after sorting the few neighbors, by second
+  int *neighbors = NULL;
+  int neighborCount = 0;
+  int neighborCapacity = 0;
+  bool ok = true;
+  for (int i = 0; i < g->count && ok; i++) {
+    const GridBox *a = &g->boxes[i];
+    int c0 = spatial_grid_column(g, a->minX);
+    int c1 = spatial_grid_column(g, a->maxX);
+    int r0 = spatial_grid_row(g, a->minY);
+    int r1 = spatial_grid_row(g, a->maxY);
+    neighborCount = 0;
+
+    for (int r = r0; r <= r1 && ok; r++) {
+      for (int c = c0; c <= c1 && ok; c++) {
+        size_t cell = (size_t)r * g->cellsX + c;
+        for (size_t p = cellStart[cell]; p < cellStart[cell + 1]; p++) {
+          int j = entries[p];
+          if (j <= i)
+            continue;
+          const GridBox *b = &g->boxes[j];
+          if (a->maxX < b->minX || b->maxX < a->minX || a->maxY < b->minY ||
+              b->maxY < a->minY)
+            continue;
+
+          // A pair sharing several cells is taken only from the cell holding
+          // the minimum corner of the intersection of its boxes
+          double cornerX = a->minX > b->minX ? a->minX : b->minX;
+          double cornerY = a->minY > b->minY ? a->minY : b->minY;
+          if (spatial_grid_column(g, cornerX) != c ||
+              spatial_grid_row(g, cornerY) != r)
+            continue;
+
+          if (neighborCount == neighborCapacity) {
+            int capacity = neighborCapacity > 0 ? neighborCapacity * 2 : 64;
+            int *grown = realloc(neighbors, (size_t)capacity * sizeof(int));
+            if (grown == NULL) {
+              ok = false;
+              break;
+            }
+            neighbors = grown;
+            neighborCapacity = capacity;
+          }
+          neighbors[neighborCount++] = j;
+        }
+      }
+    }
+
+    if (ok) {
+      // neighbors stays NULL until a box has a later neighbor
+      if (neighborCount > 1) {
+        qsort(neighbors, (size_t)neighborCount, sizeof(int),
+              spatial_grid_compare_indices);
+      }
+      for (int k = 0; k < neighborCount; k++) {
+        visit(ctx, i, neighbors[k]);
+      }
+    }
+  }
+
+  free(neighbors);
+  free(entries);
+  free(cellStart);
+  return ok;
+}
+
+/**
+ **************************
+ * Private functions
+ **************************
+ */
+
+// Cells are about as large as the boxes, so a box covers few cells, but
+// never so small that the grid has many more cells than boxes
+static void spatial_grid_choose_cells(struct SpatialGrid *g) {
+  double minX = g->boxes[0].minX, minY = g->boxes[0].minY;
+  double maxX = g->boxes[0].maxX, maxY = g->boxes[0].maxY;
+  double extent = 0.0;
+  for (int i = 0; i < g->count; i++) {
+    const GridBox *b = &g->boxes[i];
+    if (b->minX < minX)
+      minX = b->minX;
+    if (b->minY < minY)
+      minY = b->minY;
+    if (b->maxX > maxX)
+      maxX = b->maxX;
+    if (b->maxY > maxY)
+      maxY = b->maxY;
+    double w = b->maxX - b->minX;
+    double h = b->maxY - b->minY;
+    extent += w > h ? w : h;
+  }
+  extent /= g->count;
+
+  double width = maxX - minX;
+  double height = maxY - minY;
+  double size = sqrt(width * height / g->count);
+  if (extent > size)
+    size = extent;
+  if (!(size > 0.0))
+    size = 1.0;
+
+  double limit = (double)g->count * SPATIAL_GRID_CELLS_PER_BOX;
+  double cells = (floor(width / size) + 1.0) * (floor(height / size) + 1.0);
+  while (cells > limit) {
+    size *= 2.0;
+    cells = (floor(width / size) + 1.0) * (floor(height / size) + 1.0);
+  }
+
+  g->originX = minX;
+  g->originY = minY;
+  g->cellSize = size;
+  g->cellsX = (int)floor(width / size) + 1;
+  g->cellsY = (int)floor(height / size) + 1;
+}
+
+static int spatial_grid_column(const struct SpatialGrid *g, double x) {
+  int c = (int)((x - g->originX) / g->cellSize);
+  if (c < 0)
+    return 0;
+  return c < g->cellsX ? c : g->cellsX - 1;
+}
+
+static int spatial_grid_row(const struct SpatialGrid *g, double y) {
+  int r = (int)((y - g->originY) / g->cellSize);
+  if (r < 0)
+    return 0;
+  return r < g->cellsY ? r : g->cellsY - 1;
+}
+
+static int spatial_grid_compare_indices(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file spatial_grid.h
+ * @brief Uniform grid over axis-aligned boxes for all-pairs overlap queries
+ *
+ * Boxes are added one by one and identified by the order they were added
+ * in. When the overlapping pairs are requested, the grid picks its cell size
+ * from the bounds of the boxes and their mean size, bins every box into the
+ * cells it covers and compares only boxes sharing a cell, which takes close
+ * to linear time when the boxes are spread over the scene.
+ */
+
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Opaque pointer type for spatial grid instances
+ */
+typedef void *SpatialGrid;
+
+/**
+ * @brief Function receiving an overlapping pair of boxes
+ * @param ctx Caller data given to spatial_grid_for_each_overlap
+ * @param first Index of the box added first
+ * @param second Index of the box added last (always above first)
+ */
+typedef void (*SpatialGridVisitor)(void *ctx, int first, int second);
+
+/**
+ * @brief Creates an empty grid
+ * @param capacity Expected number of boxes (the grid grows past it)
+ * @return Pointer to new grid or NULL on error
+ */
+SpatialGrid spatial_grid_create(int capacity);
+
+/**
+ * @brief Destroys a grid and frees its memory
+ * @param grid Grid instance to destroy
+ */
+void spatial_grid_destroy(SpatialGrid grid);
+
+/**
+ * @brief Adds a box; its index is the number of boxes added before it
+ * @param grid Grid instance
+ * @param minX Minimum x of the box
+ * @param minY Minimum y of the box
+ * @param maxX Maximum x of the box
+ * @param maxY Maximum y of the box
+ * @return true if successful, false on allocation failure
+ */
+bool spatial_grid_add(SpatialGrid grid, double minX, double minY,
+                      double maxX, double maxY);
+
+/**
+ * @brief Gets the number of boxes added
+ * @param grid Grid instance
+ * @return Number of boxes
+ */
+int spatial_grid_size(SpatialGrid grid);
+
+/**
+ * @brief Calls visit once for every pair of overlapping boxes
+ *
+ * Boxes touching on an edge overlap. Pairs are visited ordered by their
+ * first index, then by their second index.
+ *
+ * @param grid Grid instance
+ * @param visit Function receiving each pair
+ * @param ctx Caller data passed to visit
+ * @return true if successful, false on allocation failure
+ */
+bool spatial_grid_for_each_overlap(SpatialGrid grid, SpatialGridVisitor visit,
+                                   void *ctx);
+
+#endif // SPATIAL_GRID_H
@@ -129,6 +129,68 @@ void *stack_peek_at(Stack stack, int index) {
   return current->data;
 }
 
+/**
+ * Moves up to count elements from the top of src to the top of dest
+ * @param dest Pointer to the destination stack
+ * @param src Pointer to the source stack
+ * @param count Maximum number of elements to move
+ * @return Number of elements moved
+ */
+int stack_transfer(Stack dest, Stack src, int count) {
+  if (dest == NULL || src == NULL || dest == src) {
+    return 0;
+  }
+
+  struct Stack *d = (struct Stack *)dest;
+  struct Stack *s = (struct Stack *)src;
+  int moved = 0;
+  while (moved < count && s->top != NULL) {
+    StackNode *node = s->top;
+    s->top = node->next;
+    node->next = d->top;
+    d->top = node;
+    moved++;
+  }
+  s->size -= moved;
+  d->size += moved;
+
+  return moved;
+}
+
+/**
+ * Creates a stack with the elements of another, in the same order
+ * @param stack Pointer to the stack to copy
+ * @return Pointer to new stack or NULL on error
+ */
+Stack stack_copy(Stack stack) {
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  struct Stack *copy = (struct Stack *)stack_create();
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  // Nodes are appended at the bottom, so the top stays on top
+  StackNode **tail = &copy->top;
+  for (StackNode *node = ((struct Stack *)stack)->top; node != NULL;
+       node = node->next) {
+    StackNode *new_node = (StackNode *)malloc(sizeof(StackNode));
+    if (new_node == NULL) {
+      stack_destroy(copy);
+      return NULL;
+    }
+    new_node->data = node->data;
+    new_node->next = NULL;
+    *tail = new_node;
+    tail = &new_node->next;
+    copy->size++;
+  }
+
+  return (Stack)copy;
+}
+
 /**
  * Checks if the stack is empty
  * @param stack Pointer to the stack
@@ -156,6 +218,24 @@ int stack_size(Stack stack) {
   return s->size;
 }
 
+/**
+ * Visits every element of the stack, from top to bottom
+ * @param stack Pointer to the stack
+ * @param visit Function called with each element and ctx
+ * @param ctx Caller data passed to visit
+ */
+void stack_for_each(Stack stack, void (*visit)(void *data, void *ctx),
+                    void *ctx) {
+  if (stack == NULL || visit == NULL) {
+    return;
+  }
+
+  struct Stack *s = (struct Stack *)stack;
+  for (StackNode *node = s->top; node != NULL; node = node->next) {
+    visit(node->data, ctx);
+  }
+}
+
 /**
  * Removes all elements from the stack
  * @param stack Pointer to the stack
@@ -60,6 +60,30 @@ void *stack_peek(Stack stack);
  */
 void *stack_peek_at(Stack stack, int index);
 
+/**
+ * @brief Moves elements from the top of one stack to the top of another
+ *
+ * Equivalent to popping from src and pushing onto dest count times (so the
+ * moved elements end up in reverse order), but relinks the existing nodes
+ * instead of allocating new ones.
+ *
+ * @param dest Stack receiving the elements (must differ from src)
+ * @param src Stack the elements are taken from
+ * @param count Maximum number of elements to move
+ * @return Number of elements actually moved
+ */
+int stack_transfer(Stack dest, Stack src, int count);
+
+/**
+ * @brief Creates a stack holding the same elements in the same order
+ *
+ * Only the nodes are copied; both stacks point to the same elements.
+ *
+ * @param stack Stack instance to copy
+ * @return New stack or NULL on error
+ */
+Stack stack_copy(Stack stack);
+
 /**
  * @brief Checks if the stack is empty
  * @param stack Stack instance
@@ -74,6 +98,16 @@ bool stack_is_empty(Stack stack);
  */
 int stack_size(Stack stack);
 
+/**
+ * @brief Calls visit on every element, from top to bottom, without removing
+ * them
+ * @param stack Stack instance
+ * @param visit Function receiving each element and ctx
+ * @param ctx Caller data passed to visit
+ */
+void stack_for_each(Stack stack, void (*visit)(void *data, void *ctx),
+                    void *ctx);
+
 /**
  * @brief Removes all elements from the stack without destroying it
  * @param stack Stack instance
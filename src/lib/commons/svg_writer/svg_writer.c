@@ -0,0 +1,251 @@
+#include "svg_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Decimals of every number in the document
+#define SVG_WRITER_DECIMALS 2
+
+struct SvgWriter {
+  TextWriter output;
+  FILE *file;          // file of svg_writer_open, closed with the writer
+  const char *element; // name of the element being written
+};
+
+// private functions
+static struct SvgWriter *start_document(TextWriter output, FILE *file);
+
+/**
+ * Creates the file and starts a document in it
+ * @param path File path
+ * @return New writer or NULL on error
+ */
+SvgWriter svg_writer_open(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  TextWriter output = text_writer_create(file);
+  struct SvgWriter *w = output != NULL ? start_document(output, file) : NULL;
+  if (w == NULL) {
+    text_writer_destroy(output);
+    fclose(file);
+  }
+  return (SvgWriter)w;
+}
+
+/**
+ * Starts a document in output
+ * @param output Text writer
+ * @return New writer or NULL on error
+ */
+SvgWriter svg_writer_create(TextWriter output) {
+  if (output == NULL) {
+    return NULL;
+  }
+  return (SvgWriter)start_document(output, NULL);
+}
+
+/**
+ * Opens an element
+ * @param writer Writer
+ * @param element Element name
+ */
+void svg_writer_begin(SvgWriter writer, const char *element) {
+  struct SvgWriter *w = (struct SvgWriter *)writer;
+  w->element = element;
+  text_writer_put_char(w->output, '<');
+  text_writer_put_text(w->output, element);
+}
+
+/**
+ * Adds name='value' with two decimals
+ * @param writer Writer
+ * @param name Attribute name
+ * @param value Attribute value
+ */
+void svg_writer_number(SvgWriter writer, const char *name, double value) {
+  struct SvgWriter *w = (struct SvgWriter *)writer;
+  text_writer_put_char(w->output, ' ');
+  text_writer_put_text(w->output, name);
+  text_writer_put_text(w->output, "='");
+  text_writer_put_fixed(w->output, value, SVG_WRITER_DECIMALS);
+  text_writer_put_char(w->output, '\'');
+}
+
+/**
+ * Adds name='value'
+ * @param writer Writer
+ * @param name Attribute name
+ * @param value Attribute value
+ */
+void svg_writer_attribute(SvgWriter writer, const char *name,
+                          const char *value) {
+  struct SvgWriter *w = (struct SvgWriter *)writer;
+  text_writer_put_char(w->output, ' ');
+  text_writer_put_text(w->output, name);
+  text_writer_put_text(w->output, "='");
+  text_writer_put_text(w->output, value);
+  text_writer_put_char(w->output, '\'');
+}
+
+/**
+ * Adds transform='rotate(degrees x y)'
+ * @param writer Writer
+ * @param degrees Angle
+ * @param x Center x
+ * @param y Center y
+ */
+void svg_writer_rotate(SvgWriter writer, int degrees, double x, double y) {
+  struct SvgWriter *w = (struct SvgWriter *)writer;
+  text_writer_put_text(w->output, " transform='rotate(");
+  text_writer_put_int(w->output, degrees);
+  text_writer_put_char(w->output, ' ');
+  text_writer_put_fixed(w->output, x, SVG_WRITER_DECIMALS);
+  text_writer_put_char(w->output, ' ');
+  text_writer_put_fixed(w->output, y, SVG_WRITER_DECIMALS);
+  text_writer_put_text(w->output, ")'");
+}
+
+/**
+ * Closes the element as empty
+ * @param writer Writer
+ */
+void svg_writer_end(SvgWriter writer) {
+  struct SvgWriter *w = (struct SvgWriter *)writer;
+  text_writer_put_text(w->output, "/>\n");
+}
+
+/**
+ * Closes the element around a text
+ * @param writer Writer
+ * @param text Content
+ */
+void svg_writer_content(SvgWriter writer, const char *text) {
+  struct SvgWriter *w = (struct SvgWriter *)writer;
+  text_writer_put_char(w->output, '>');
+  text_writer_put_text(w->output, text);
+  text_writer_put_text(w->output, "</");
+  text_writer_put_text(w->output, w->element);
+  text_writer_put_text(w->output, ">\n");
+}
+
+/**
+ * Closes the element around a number with two decimals
+ * @param writer Writer
+ * @param value Content
+ */
+void svg_writer_number_content(SvgWriter writer, double value) {
+  struct SvgWriter *w = (struct SvgWriter *)writer;
+  text_writer_put_char(w->output, '>');
+  text_writer_put_fixed(w->output, value, SVG_WRITER_DECIMALS);
+  text_writer_put_text(w->output, "</");
+  text_writer_put_text(w->output, w->element);
+  text_writer_put_text(w->output, ">\n");
+}
+
+/**
+ * Opens <circle cx cy r fill stroke
+ */
+void svg_writer_circle(SvgWriter writer, double x, double y, double radius,
+                       const char *fill, const char *stroke) {
+  svg_writer_begin(writer, "circle");
+  svg_writer_number(writer, "cx", x);
+  svg_writer_number(writer, "cy", y);
+  svg_writer_number(writer, "r", radius);
+  svg_writer_attribute(writer, "fill", fill);
+  svg_writer_attribute(writer, "stroke", stroke);
+}
+
+/**
+ * Opens <rect x y width height fill stroke
+ */
+void svg_writer_rect(SvgWriter writer, double x, double y, double width,
+                     double height, const char *fill, const char *stroke) {
+  svg_writer_begin(writer, "rect");
+  svg_writer_number(writer, "x", x);
+  svg_writer_number(writer, "y", y);
+  svg_writer_number(writer, "width", width);
+  svg_writer_number(writer, "height", height);
+  svg_writer_attribute(writer, "fill", fill);
+  svg_writer_attribute(writer, "stroke", stroke);
+}
+
+/**
+ * Opens <line x1 y1 x2 y2 stroke
+ */
+void svg_writer_line(SvgWriter writer, double x1, double y1, double x2,
+                     double y2, const char *stroke) {
+  svg_writer_begin(writer, "line");
+  svg_writer_number(writer, "x1", x1);
+  svg_writer_number(writer, "y1", y1);
+  svg_writer_number(writer, "x2", x2);
+  svg_writer_number(writer, "y2", y2);
+  svg_writer_attribute(writer, "stroke", stroke);
+}
+
+/**
+ * Opens <text x y fill stroke text-anchor
+ */
+void svg_writer_text(SvgWriter writer, double x, double y, const char *fill,
+                     const char *stroke, char anchor) {
+  const char *text_anchor = "start";
+  if (anchor == 'm' || anchor == 'M') {
+    text_anchor = "middle";
+  } else if (anchor == 'e' || anchor == 'E') {
+    text_anchor = "end";
+  }
+
+  svg_writer_begin(writer, "text");
+  svg_writer_number(writer, "x", x);
+  svg_writer_number(writer, "y", y);
+  svg_writer_attribute(writer, "fill", fill);
+  svg_writer_attribute(writer, "stroke", stroke);
+  svg_writer_attribute(writer, "text-anchor", text_anchor);
+}
+
+/**
+ * Ends the document and frees the writer
+ * @param writer Writer
+ * @return true if the document was fully written
+ */
+bool svg_writer_close(SvgWriter writer) {
+  if (writer == NULL) {
+    return true;
+  }
+
+  struct SvgWriter *w = (struct SvgWriter *)writer;
+  text_writer_put_text(w->output, "</svg>\n");
+  bool written;
+  if (w->file != NULL) {
+    written = text_writer_destroy(w->output);
+    if (fclose(w->file) != 0) {
+      written = false;
+    }
+  } else {
+    written = text_writer_flush(w->output);
+  }
+  free(w);
+  return written;
+}
+
+/**
+ * *** Private functions ***
+ */
+
+// Writes the XML declaration and the opening svg tag
+static struct SvgWriter *start_document(TextWriter output, FILE *file) {
+  struct SvgWriter *w = (struct SvgWriter *)malloc(sizeof(struct SvgWriter));
+  if (w == NULL) {
+    return NULL;
+  }
+
+  w->output = output;
+  w->file = file;
+  w->element = NULL;
+  text_writer_put_text(output,
+                       "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                       "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+                       "viewBox=\"0 0 1000 1000\">\n");
+  return w;
+}
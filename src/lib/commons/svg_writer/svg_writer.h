@@ -0,0 +1,154 @@
+/**
+ * @file svg_writer.h
+ * @brief SVG document output through a buffered text writer
+ *
+ * This module writes the SVG documents of the project: the document header
+ * and footer, the elements drawing each shape type and generic elements
+ * built attribute by attribute. Numeric attributes are written with two
+ * decimals, as printf "%.2f" would, by the fast formatter of the text
+ * writer, and the text goes out in large blocks to the writer's sink.
+ *
+ * An element is opened by svg_writer_begin or by one of the shape
+ * functions, receives any further attributes and is closed by svg_writer_end
+ * (empty element) or by one of the content functions.
+ */
+
+#ifndef SVG_WRITER_H
+#define SVG_WRITER_H
+
+#include "../text_writer/text_writer.h"
+#include <stdbool.h>
+
+/**
+ * @brief Opaque pointer type for SVG writer instances
+ */
+typedef void *SvgWriter;
+
+/**
+ * @brief Creates a file and starts an SVG document in it
+ * @param path Path of the file, replaced if it exists
+ * @return New writer or NULL if the file could not be created
+ */
+SvgWriter svg_writer_open(const char *path);
+
+/**
+ * @brief Starts an SVG document in a text writer
+ * @param output Writer receiving the document; it is not destroyed by the
+ * SVG writer
+ * @return New writer or NULL on error
+ */
+SvgWriter svg_writer_create(TextWriter output);
+
+/**
+ * @brief Opens an element
+ * @param writer Writer instance
+ * @param element Element name, kept until the element is closed
+ */
+void svg_writer_begin(SvgWriter writer, const char *element);
+
+/**
+ * @brief Adds a numeric attribute, with two decimals, to the open element
+ * @param writer Writer instance
+ * @param name Attribute name
+ * @param value Attribute value
+ */
+void svg_writer_number(SvgWriter writer, const char *name, double value);
+
+/**
+ * @brief Adds an attribute to the open element
+ * @param writer Writer instance
+ * @param name Attribute name
+ * @param value Attribute value, written as is
+ */
+void svg_writer_attribute(SvgWriter writer, const char *name,
+                          const char *value);
+
+/**
+ * @brief Adds a rotation around a point to the open element
+ * @param writer Writer instance
+ * @param degrees Angle of the rotation
+ * @param x X coordinate of the center
+ * @param y Y coordinate of the center
+ */
+void svg_writer_rotate(SvgWriter writer, int degrees, double x, double y);
+
+/**
+ * @brief Closes the open element as an empty element
+ * @param writer Writer instance
+ */
+void svg_writer_end(SvgWriter writer);
+
+/**
+ * @brief Closes the open element with a text content
+ * @param writer Writer instance
+ * @param text Content, written as is
+ */
+void svg_writer_content(SvgWriter writer, const char *text);
+
+/**
+ * @brief Closes the open element with a number, with two decimals, as its
+ * content
+ * @param writer Writer instance
+ * @param value Content
+ */
+void svg_writer_number_content(SvgWriter writer, double value);
+
+/**
+ * @brief Opens a circle element with the attributes of a circle shape
+ * @param writer Writer instance
+ * @param x X coordinate of the center
+ * @param y Y coordinate of the center
+ * @param radius Radius
+ * @param fill Fill color
+ * @param stroke Border color
+ */
+void svg_writer_circle(SvgWriter writer, double x, double y, double radius,
+                       const char *fill, const char *stroke);
+
+/**
+ * @brief Opens a rect element with the attributes of a rectangle shape
+ * @param writer Writer instance
+ * @param x X coordinate of the anchor
+ * @param y Y coordinate of the anchor
+ * @param width Width
+ * @param height Height
+ * @param fill Fill color
+ * @param stroke Border color
+ */
+void svg_writer_rect(SvgWriter writer, double x, double y, double width,
+                     double height, const char *fill, const char *stroke);
+
+/**
+ * @brief Opens a line element with the attributes of a line shape
+ * @param writer Writer instance
+ * @param x1 X coordinate of the first endpoint
+ * @param y1 Y coordinate of the first endpoint
+ * @param x2 X coordinate of the second endpoint
+ * @param y2 Y coordinate of the second endpoint
+ * @param stroke Color
+ */
+void svg_writer_line(SvgWriter writer, double x1, double y1, double x2,
+                     double y2, const char *stroke);
+
+/**
+ * @brief Opens a text element with the attributes of a text shape
+ * @param writer Writer instance
+ * @param x X coordinate of the anchor
+ * @param y Y coordinate of the anchor
+ * @param fill Fill color
+ * @param stroke Border color
+ * @param anchor Anchor letter of the text shape, in either case: 'm' for
+ * the middle, 'e' for the end and anything else for the start
+ */
+void svg_writer_text(SvgWriter writer, double x, double y, const char *fill,
+                     const char *stroke, char anchor);
+
+/**
+ * @brief Ends the document and frees the writer, closing the file of
+ * svg_writer_open
+ * @param writer Writer instance
+ * @return true if the whole document reached its destination
+ */
+bool svg_writer_close(SvgWriter writer);
+
+#endif // SVG_WRITER_H
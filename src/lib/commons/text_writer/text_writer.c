@@ -0,0 +1,362 @@
+#include "text_writer.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Text gathered before it is handed to the sink
+#define TEXT_WRITER_BUFFER_SIZE (256 * 1024)
+// Longest number put_fixed writes: 309 integer digits of the largest
+// double, the point, 9 decimals, the sign and the terminator
+#define TEXT_WRITER_NUMBER_MAX 352
+#define TEXT_WRITER_MAX_DECIMALS 9
+
+// Header and buffer live in a single allocation
+struct TextWriter {
+  TextSink sink;
+  void *context;
+  FILE *file;            // file flushed with the writer, or NULL
+  bool memory;           // the text is kept in memoryText
+  char *memoryText;      // everything drained by a memory writer
+  size_t memorySize;     // bytes in memoryText
+  size_t memoryCapacity; // bytes allocated for memoryText
+  size_t drained;        // bytes handed to the sink
+  bool failed;           // the sink did not take a whole block
+  size_t used;           // bytes of buffer waiting to be written
+  char buffer[];
+};
+
+static const double powers_of_ten[TEXT_WRITER_MAX_DECIMALS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+// private functions
+static struct TextWriter *create_writer(TextSink sink, void *context);
+static bool write_to_file(void *context, const char *data, size_t size);
+static bool write_to_memory(void *context, const char *data, size_t size);
+static bool write_to_null(void *context, const char *data, size_t size);
+static void send(struct TextWriter *w, const char *data, size_t size);
+static void drain(struct TextWriter *w);
+static int format_unsigned(char *out, uint64_t value, int minDigits);
+static int format_fixed(char *out, double value, int decimals);
+
+/**
+ * Creates a writer appending to file
+ * @param file Open file
+ * @return New writer or NULL on error
+ */
+TextWriter text_writer_create(FILE *file) {
+  if (file == NULL) {
+    return NULL;
+  }
+
+  struct TextWriter *w = create_writer(write_to_file, file);
+  if (w != NULL) {
+    w->file = file;
+  }
+  return (TextWriter)w;
+}
+
+/**
+ * Creates a writer handing its text to sink
+ * @param sink Function receiving the text
+ * @param context Passed to sink
+ * @return New writer or NULL on error
+ */
+TextWriter text_writer_create_sink(TextSink sink, void *context) {
+  if (sink == NULL) {
+    return NULL;
+  }
+  return (TextWriter)create_writer(sink, context);
+}
+
+/**
+ * Creates a writer keeping its text in memory
+ * @return New writer or NULL on error
+ */
+TextWriter text_writer_create_memory(void) {
+  struct TextWriter *w = create_writer(write_to_memory, NULL);
+  if (w != NULL) {
+    w->context = w;
+    w->memory = true;
+  }
+  return (TextWriter)w;
+}
+
+/**
+ * Creates a writer discarding its text
+ * @return New writer or NULL on error
+ */
+TextWriter text_writer_create_null(void) {
+  return (TextWriter)create_writer(write_to_null, NULL);
+}
+
+/**
+ * Writes a string
+ * @param writer Writer
+ * @param text Null-terminated string
+ */
+void text_writer_put_text(TextWriter writer, const char *text) {
+  struct TextWriter *w = (struct TextWriter *)writer;
+  size_t length = strlen(text);
+  if (length > TEXT_WRITER_BUFFER_SIZE - w->used) {
+    drain(w);
+    // Text longer than the whole buffer goes straight to the sink
+    if (length >= TEXT_WRITER_BUFFER_SIZE) {
+      send(w, text, length);
+      return;
+    }
+  }
+  memcpy(w->buffer + w->used, text, length);
+  w->used += length;
+}
+
+/**
+ * Writes a single character
+ * @param writer Writer
+ * @param c Character
+ */
+void text_writer_put_char(TextWriter writer, char c) {
+  struct TextWriter *w = (struct TextWriter *)writer;
+  if (w->used == TEXT_WRITER_BUFFER_SIZE) {
+    drain(w);
+  }
+  w->buffer[w->used++] = c;
+}
+
+/**
+ * Writes an integer as "%d" would
+ * @param writer Writer
+ * @param value Integer
+ */
+void text_writer_put_int(TextWriter writer, int value) {
+  struct TextWriter *w = (struct TextWriter *)writer;
+  if (TEXT_WRITER_BUFFER_SIZE - w->used < 12) {
+    drain(w);
+  }
+
+  char *out = w->buffer + w->used;
+  int length = 0;
+  // Negated as unsigned, so INT_MIN does not overflow
+  uint64_t magnitude = (uint64_t)(uint32_t)value;
+  if (value < 0) {
+    out[length++] = '-';
+    magnitude = (uint64_t)(0u - (uint32_t)value);
+  }
+  length += format_unsigned(out + length, magnitude, 1);
+  w->used += (size_t)length;
+}
+
+/**
+ * Writes a number as "%.Nf" would, N being decimals
+ * @param writer Writer
+ * @param value Number
+ * @param decimals Digits after the decimal point, from 0 to 9
+ */
+void text_writer_put_fixed(TextWriter writer, double value, int decimals) {
+  struct TextWriter *w = (struct TextWriter *)writer;
+  if (TEXT_WRITER_BUFFER_SIZE - w->used < TEXT_WRITER_NUMBER_MAX) {
+    drain(w);
+  }
+  if (decimals < 0) {
+    decimals = 0;
+  } else if (decimals > TEXT_WRITER_MAX_DECIMALS) {
+    decimals = TEXT_WRITER_MAX_DECIMALS;
+  }
+  w->used += (size_t)format_fixed(w->buffer + w->used, value, decimals);
+}
+
+/**
+ * Gets the bytes written so far
+ * @param writer Writer
+ * @return Bytes written, buffered ones included
+ */
+size_t text_writer_size(TextWriter writer) {
+  struct TextWriter *w = (struct TextWriter *)writer;
+  return w->drained + w->used;
+}
+
+/**
+ * Gets the text kept by a memory writer
+ * @param writer Memory writer
+ * @param size Receives the length of the text, or NULL
+ * @return Null-terminated text or NULL
+ */
+const char *text_writer_memory_text(TextWriter writer, size_t *size) {
+  struct TextWriter *w = (struct TextWriter *)writer;
+  if (!w->memory) {
+    return NULL;
+  }
+
+  drain(w);
+  // The terminator is kept past the text, so it is not counted
+  if (w->failed || !write_to_memory(w, "", 1)) {
+    w->failed = true;
+    return NULL;
+  }
+  w->memorySize--;
+  if (size != NULL) {
+    *size = w->memorySize;
+  }
+  return w->memoryText;
+}
+
+/**
+ * Writes the buffered text and flushes a file sink
+ * @param writer Writer
+ * @return true if nothing failed to reach the sink
+ */
+bool text_writer_flush(TextWriter writer) {
+  struct TextWriter *w = (struct TextWriter *)writer;
+  drain(w);
+  if (w->file != NULL && fflush(w->file) != 0) {
+    w->failed = true;
+  }
+  return !w->failed;
+}
+
+/**
+ * Flushes and frees the writer
+ * @param writer Writer
+ * @return true if nothing failed to reach the file
+ */
+bool text_writer_destroy(TextWriter writer) {
+  if (writer == NULL) {
+    return true;
+  }
+
+  bool written = text_writer_flush(writer);
+  free(((struct TextWriter *)writer)->memoryText);
+  free(writer);
+  return written;
+}
+
+/**
+ * *** Private functions ***
+ */
+
+static struct TextWriter *create_writer(TextSink sink, void *context) {
+  struct TextWriter *w = (struct TextWriter *)malloc(
+      sizeof(struct TextWriter) + TEXT_WRITER_BUFFER_SIZE);
+  if (w == NULL) {
+    return NULL;
+  }
+
+  w->sink = sink;
+  w->context = context;
+  w->file = NULL;
+  w->memory = false;
+  w->memoryText = NULL;
+  w->memorySize = 0;
+  w->memoryCapacity = 0;
+  w->drained = 0;
+  w->failed = false;
+  w->used = 0;
+  return w;
+}
+
+static bool write_to_file(void *context, const char *data, size_t size) {
+  return fwrite(data, 1, size, (FILE *)context) == size;
+}
+
+// Appends to the text of a memory writer, doubling its capacity as needed
+static bool write_to_memory(void *context, const char *data, size_t size) {
+  struct TextWriter *w = (struct TextWriter *)context;
+  if (size > w->memoryCapacity - w->memorySize) {
+    size_t capacity = w->memoryCapacity > 0 ? w->memoryCapacity : 4096;
+    while (size > capacity - w->memorySize) {
+      if (capacity > SIZE_MAX / 2) {
+        return false;
+      }
+      capacity *= 2;
+    }
+    char *text = (char *)realloc(w->memoryText, capacity);
+    if (text == NULL) {
+      return false;
+    }
+    w->memoryText = text;
+    w->memoryCapacity = capacity;
+  }
+  memcpy(w->memoryText + w->memorySize, data, size);
+  w->memorySize += size;
+  return true;
+}
+
+static bool write_to_null(void *context, const char *data, size_t size) {
+  (void)context;
+  (void)data;
+  (void)size;
+  return true;
+}
+
+// Hands a block to the sink
+static void send(struct TextWriter *w, const char *data, size_t size) {
+  if (!w->sink(w->context, data, size)) {
+    w->failed = true;
+  }
+  w->drained += size;
+}
+
+// Hands the buffered text to the sink
+static void drain(struct TextWriter *w) {
+  if (w->used > 0) {
+    send(w, w->buffer, w->used);
+  }
+  w->used = 0;
+}
+
+// Writes the decimal digits of value, zero padded to minDigits, and returns
+// how many were written
+static int format_unsigned(char *out, uint64_t value, int minDigits) {
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  while (count < minDigits) {
+    digits[count++] = '0';
+  }
+  for (int i = 0; i < count; i++) {
+    out[i] = digits[count - 1 - i];
+  }
+  return count;
+}
+
+// Writes value with the given decimals as printf would and returns the
+// length. The fraction is split off exactly and scaled with a single
+// rounding, off by far less than 1e-6 of a unit; printf rounds the exact
+// binary value, so only scaled fractions that close to a tie can round the
+// other way, and those go through snprintf, as do huge and non-finite values.
+static int format_fixed(char *out, double value, int decimals) {
+  double magnitude = fabs(value);
+  if (!(magnitude < 1e15)) {
+    return snprintf(out, TEXT_WRITER_NUMBER_MAX, "%.*f", decimals, value);
+  }
+
+  double whole = floor(magnitude);
+  double scaled = (magnitude - whole) * powers_of_ten[decimals];
+  double units = floor(scaled);
+  double rest = scaled - units;
+  if (fabs(rest - 0.5) < 1e-6) {
+    return snprintf(out, TEXT_WRITER_NUMBER_MAX, "%.*f", decimals, value);
+  }
+
+  uint64_t integer = (uint64_t)whole;
+  uint64_t fraction = (uint64_t)units + (rest > 0.5 ? 1 : 0);
+  if (fraction == (uint64_t)powers_of_ten[decimals]) {
+    integer++;
+    fraction = 0;
+  }
+
+  int length = 0;
+  // printf keeps the sign of negative values that round to zero
+  if (signbit(value)) {
+    out[length++] = '-';
+  }
+  length += format_unsigned(out + length, integer, 1);
+  if (decimals > 0) {
+    out[length++] = '.';
+    length += format_unsigned(out + length, fraction, decimals);
+  }
+  return length;
+}
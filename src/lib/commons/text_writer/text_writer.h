@@ -0,0 +1,127 @@
+/**
+ * @file text_writer.h
+ * @brief Buffered text output with fast number formatting
+ *
+ * This module provides a writer that gathers text in a large buffer and
+ * hands it to a sink in big blocks, instead of going through stdio for
+ * every field. Integers and fixed-point numbers are formatted by hand, with
+ * the same output printf gives for "%d" and "%.Nf", so reports written
+ * through it do not change.
+ *
+ * A sink is a function receiving each block. Writers are provided for a
+ * file, for a block of memory that keeps everything written, and for a null
+ * sink that discards the text and only counts it.
+ */
+
+#ifndef TEXT_WRITER_H
+#define TEXT_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Opaque pointer type for text writer instances
+ */
+typedef void *TextWriter;
+
+/**
+ * @brief Receives a block of text from a writer
+ * @param context Context given when the writer was created
+ * @param data Text, not null-terminated
+ * @param size Length of the text
+ * @return true if the whole block was written
+ */
+typedef bool (*TextSink)(void *context, const char *data, size_t size);
+
+/**
+ * @brief Creates a writer that appends to an open file
+ * @param file File written by the writer; it is not closed by the writer
+ * @return New writer or NULL on error
+ */
+TextWriter text_writer_create(FILE *file);
+
+/**
+ * @brief Creates a writer that hands its text to a sink
+ * @param sink Function receiving the blocks of text
+ * @param context Passed to every call of sink
+ * @return New writer or NULL on error
+ */
+TextWriter text_writer_create_sink(TextSink sink, void *context);
+
+/**
+ * @brief Creates a writer that keeps its text in memory
+ * @return New writer or NULL on error
+ * @see text_writer_memory_text
+ */
+TextWriter text_writer_create_memory(void);
+
+/**
+ * @brief Creates a writer that discards its text
+ * @return New writer or NULL on error
+ * @see text_writer_size
+ */
+TextWriter text_writer_create_null(void);
+
+/**
+ * @brief Writes a string
+ * @param writer Writer instance
+ * @param text Null-terminated string
+ */
+void text_writer_put_text(TextWriter writer, const char *text);
+
+/**
+ * @brief Writes a single character
+ * @param writer Writer instance
+ * @param c Character to write
+ */
+void text_writer_put_char(TextWriter writer, char c);
+
+/**
+ * @brief Writes an integer, as printf "%d" would
+ * @param writer Writer instance
+ * @param value Integer to write
+ */
+void text_writer_put_int(TextWriter writer, int value);
+
+/**
+ * @brief Writes a number with a fixed count of decimals, as printf "%.Nf"
+ * would
+ * @param writer Writer instance
+ * @param value Number to write
+ * @param decimals Digits after the decimal point, from 0 to 9
+ */
+void text_writer_put_fixed(TextWriter writer, double value, int decimals);
+
+/**
+ * @brief Gets how many bytes were written, buffered ones included
+ * @param writer Writer instance
+ * @return Bytes written since the writer was created
+ */
+size_t text_writer_size(TextWriter writer);
+
+/**
+ * @brief Gets the text of a memory writer
+ * @param writer Writer created by text_writer_create_memory
+ * @param size Receives the length of the text; may be NULL
+ * @return Null-terminated text, valid until the next write or the
+ * destruction of the writer, or NULL if writer is not a memory writer or
+ * ran out of memory
+ */
+const char *text_writer_memory_text(TextWriter writer, size_t *size);
+
+/**
+ * @brief Writes the buffered text to the sink, flushing a file sink
+ * @param writer Writer instance
+ * @return true if everything written so far reached the sink
+ */
+bool text_writer_flush(TextWriter writer);
+
+/**
+ * @brief Flushes the writer and frees it
+ * @param writer Writer instance to destroy
+ * @return true if everything written reached the sink
+ */
+bool text_writer_destroy(TextWriter writer);
+
+#endif // TEXT_WRITER_H
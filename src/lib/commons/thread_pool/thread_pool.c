@@ -0,0 +1,207 @@
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Internal structure definitions - only visible in implementation
+struct ThreadPool;
+
+typedef struct {
+  struct ThreadPool *pool;
+  int index; // range handled by this worker, 1..size-1
+  pthread_t thread;
+} Worker;
+
+struct ThreadPool {
+  int size;
+  Worker *workers; // size - 1 workers; the caller runs range 0
+
+  pthread_mutex_t lock;
+  pthread_cond_t jobReady;
+  pthread_cond_t jobDone;
+  unsigned long generation; // incremented for every loop
+  int pending;              // workers still running the current loop
+  bool stopping;
+
+  // Current loop
+  ThreadPoolTask task;
+  void *ctx;
+  int count;
+  int ranges; // min(count, size); workers past the last range stay idle
+};
+
+// private functions
+static void *worker_main(void *arg);
+static void run_range(struct ThreadPool *p, int index);
+
+/**
+ * Creates a pool with the requested number of threads
+ * @param threads Threads per loop including the caller, or 0 for one per CPU
+ * @return Pointer to new pool or NULL on error
+ */
+ThreadPool thread_pool_create(int threads) {
+  if (threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int)cpus : 1;
+  }
+
+  struct ThreadPool *p = malloc(sizeof(struct ThreadPool));
+  if (p == NULL) {
+    return NULL;
+  }
+  p->size = threads;
+  p->generation = 0;
+  p->pending = 0;
+  p->stopping = false;
+  p->task = NULL;
+  p->ctx = NULL;
+  p->count = 0;
+  p->ranges = 0;
+  p->workers = NULL;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->jobReady, NULL);
+  pthread_cond_init(&p->jobDone, NULL);
+
+  if (threads > 1) {
+    p->workers = malloc((size_t)(threads - 1) * sizeof(Worker));
+    if (p->workers == NULL) {
+      p->size = 1;
+      return (ThreadPool)p;
+    }
+    for (int i = 0; i < threads - 1; i++) {
+      p->workers[i].pool = p;
+      p->workers[i].index = i + 1;
+      if (pthread_create(&p->workers[i].thread, NULL, worker_main,
+                         &p->workers[i]) != 0) {
+        // Run with the threads that did start
+        p->size = i + 1;
+        break;
+      }
+    }
+  }
+
+  return (ThreadPool)p;
+}
+
+/**
+ * Stops and joins every worker, then frees the pool
+ * @param pool Pointer to pool to be destroyed
+ */
+void thread_pool_destroy(ThreadPool pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  struct ThreadPool *p = (struct ThreadPool *)pool;
+  pthread_mutex_lock(&p->lock);
+  p->stopping = true;
+  pthread_cond_broadcast(&p->jobReady);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i = 0; i < p->size - 1; i++) {
+    pthread_join(p->workers[i].thread, NULL);
+  }
+
+  pthread_cond_destroy(&p->jobDone);
+  pthread_cond_destroy(&p->jobReady);
+  pthread_mutex_destroy(&p->lock);
+  free(p->workers);
+  free(p);
+}
+
+/**
+ * Gets the number of threads per loop
+ * @param pool Pointer to the pool
+ * @return Number of threads, 1 if pool is NULL
+ */
+int thread_pool_size(ThreadPool pool) {
+  if (pool == NULL) {
+    return 1;
+  }
+  return ((struct ThreadPool *)pool)->size;
+}
+
+/**
+ * Runs task over [0, count) split in one contiguous range per thread, or in
+ * count ranges of one index when there are fewer indices than threads
+ * @param pool Pointer to the pool (NULL runs the loop inline)
+ * @param count Number of indices
+ * @param task Function run on each range
+ * @param ctx Context passed to task
+ */
+void thread_pool_parallel_for(ThreadPool pool, int count, ThreadPoolTask task,
+                              void *ctx) {
+  if (count <= 0) {
+    return;
+  }
+
+  struct ThreadPool *p = (struct ThreadPool *)pool;
+  if (p == NULL || p->size == 1 || count == 1) {
+    task(ctx, 0, count);
+    return;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  p->task = task;
+  p->ctx = ctx;
+  p->count = count;
+  p->ranges = count < p->size ? count : p->size;
+  p->pending = p->size - 1;
+  p->generation++;
+  pthread_cond_broadcast(&p->jobReady);
+  pthread_mutex_unlock(&p->lock);
+
+  run_range(p, 0);
+
+  pthread_mutex_lock(&p->lock);
+  while (p->pending > 0) {
+    pthread_cond_wait(&p->jobDone, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+/**
+**************************
+* Private functions
+**************************
+*/
+
+static void *worker_main(void *arg) {
+  Worker *w = (Worker *)arg;
+  struct ThreadPool *p = w->pool;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!p->stopping && p->generation == seen) {
+      pthread_cond_wait(&p->jobReady, &p->lock);
+    }
+    if (p->stopping) {
+      break;
+    }
+    seen = p->generation;
+    pthread_mutex_unlock(&p->lock);
+
+    run_range(p, w->index);
+
+    pthread_mutex_lock(&p->lock);
+    if (--p->pending == 0) {
+      pthread_cond_signal(&p->jobDone);
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+// Runs the index-th of the contiguous ranges of the current loop
+static void run_range(struct ThreadPool *p, int index) {
+  if (index >= p->ranges) {
+    return;
+  }
+  long begin = (long)p->count * index / p->ranges;
+  long end = (long)p->count * (index + 1) / p->ranges;
+  if (begin < end) {
+    p->task(p->ctx, (int)begin, (int)end);
+  }
+}
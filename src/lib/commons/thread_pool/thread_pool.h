@@ -0,0 +1,62 @@
+/**
+ * @file thread_pool.h
+ * @brief Fixed-size worker thread pool ADT
+ *
+ * This module provides a pool of POSIX threads that run data-parallel loops.
+ * A loop over [0, count) is split into one contiguous range per thread; the
+ * calling thread takes the first range and waits for the others, so a pool
+ * of size 1 runs everything inline without starting any thread.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/**
+ * @brief Opaque pointer type for thread pool instances
+ */
+typedef void *ThreadPool;
+
+/**
+ * @brief Function run on one range of a parallel loop
+ * @param ctx Context pointer given to thread_pool_parallel_for
+ * @param begin First index of the range
+ * @param end One past the last index of the range
+ */
+typedef void (*ThreadPoolTask)(void *ctx, int begin, int end);
+
+/**
+ * @brief Creates a new thread pool
+ * @param threads Number of threads running each loop, counting the caller;
+ * 0 or less uses one thread per online processor
+ * @return Pointer to new pool or NULL on error
+ */
+ThreadPool thread_pool_create(int threads);
+
+/**
+ * @brief Stops the worker threads and frees the pool
+ * @param pool Pool instance to destroy
+ */
+void thread_pool_destroy(ThreadPool pool);
+
+/**
+ * @brief Gets the number of threads running each loop
+ * @param pool Pool instance
+ * @return Number of threads, including the caller
+ */
+int thread_pool_size(ThreadPool pool);
+
+/**
+ * @brief Runs task over [0, count) and waits until every range is done
+ *
+ * Ranges run concurrently, so task must only write state owned by its own
+ * range.
+ *
+ * @param pool Pool instance
+ * @param count Number of indices
+ * @param task Function called once per non-empty range
+ * @param ctx Context pointer passed to task
+ */
+void thread_pool_parallel_for(ThreadPool pool, int count, ThreadPoolTask task,
+                              void *ctx);
+
+#endif // THREAD_POOL_H
@@ -18,6 +18,20 @@ char *duplicate_string(const char *s) {
   return dup;
 }
 
+/**
+ * Cuts a file name at the first dot after its leading dots
+ * @param name File name to cut
+ */
+void strip_extension(char *name) {
+  if (name == NULL)
+    return;
+
+  char *dot = strchr(name + strspn(name, "."), '.');
+  if (dot != NULL) {
+    *dot = '\0';
+  }
+}
+
 // Internal helper: convert a single hex digit to its value, returns -1 on error
 static int hex_value(char c) {
   if (c >= '0' && c <= '9')
@@ -14,6 +14,14 @@
  */
 char *duplicate_string(const char *s);
 
+/**
+ * Cuts a file name at its extension, in place, the way strtok(name, ".")
+ * does (leading dots are kept) but without strtok's hidden state, so it can
+ * run on several threads at once.
+ * @param name File name to cut
+ */
+void strip_extension(char *name);
+
 /**
  * Produces the inverted color for a given color string.
  * Supports 6-digit hex colors (e.g., "#aabbcc") and a small set of common
@@ -55,6 +55,29 @@ FileData file_data_create(const char *filepath) {
   return (FileData)file;
 }
 
+// Creates a FileData instance naming a file, with no lines
+FileData file_data_create_unread(const char *filepath) {
+  struct FileData *file = malloc(sizeof(struct FileData));
+  if (file == NULL) {
+    printf("Error: Failed to allocate memory for FileData\n");
+    return NULL;
+  }
+
+  file->filepath = filepath;
+  file->filename =
+      strrchr(filepath, '/') ? strrchr(filepath, '/') + 1 : filepath;
+  file->linesQueue = queue_create();
+  file->linesStackToFree = stack_create();
+  if (file->linesQueue == NULL || file->linesStackToFree == NULL) {
+    printf("Error: Failed to allocate memory for FileData\n");
+    queue_destroy(file->linesQueue);
+    stack_destroy(file->linesStackToFree);
+    free(file);
+    return NULL;
+  }
+  return (FileData)file;
+}
+
 // Reads the file lines and returns a Queue. This function is private.
 static struct LinesQueueAndStack *
 read_file_to_queue_and_stack(const char *filepath) {
@@ -27,6 +27,17 @@ typedef void *FileData;
  */
 FileData file_data_create(const char *filepath);
 
+/**
+ * @brief Creates a FileData instance without reading the file
+ *
+ * Only the file path and name are stored; the queue of lines is empty.
+ * Useful when a file only names the outputs.
+ *
+ * @param filepath Path to the file
+ * @return FileData instance or NULL if creation failed
+ */
+FileData file_data_create_unread(const char *filepath);
+
 /**
  * @brief Destroys a FileData instance and frees all memory
  * @param fileData FileData instance to destroy
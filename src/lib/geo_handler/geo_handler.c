@@ -1,35 +1,72 @@
 #include "geo_handler.h"
 #include "../commons/queue/queue.h"
-#include "../commons/stack/stack.h"
+#include "../commons/queue/queue_internal.h"
+#include "../commons/svg_writer/svg_writer.h"
 #include "../file_reader/file_reader.h"
 #include "../shapes/circle/circle.h"
+#include "../shapes/circle/circle_internal.h"
 #include "../shapes/line/line.h"
+#include "../shapes/line/line_internal.h"
 #include "../shapes/rectangle/rectangle.h"
+#include "../shapes/rectangle/rectangle_internal.h"
+#include "../shapes/shape/shape.h"
+#include "../shapes/shape/shape_internal.h"
 #include "../shapes/shapes.h"
 #include "../shapes/text/text.h"
+#include "../shapes/text/text_internal.h"
 #include "../shapes/text_style/text_style.h"
 #include <stdio.h>
 #include <string.h>
 
 typedef struct {
+  // Shapes of the ground; in a view, the ones added after the shapes it
+  // still reads from its base
   Queue shapesQueue;
-  Stack shapesStackToFree;
+  const QueueNode *baseNext; // next shape a view reads from its base
+  int baseRemaining;         // shapes of the base the view has not taken
+  // Shapes freed with the ground, unless released earlier; each one knows
+  // its slot here
+  Shape *ownedShapes;
+  int ownedCount;
+  int ownedCapacity;
   Queue svgQueue;
 } Ground_t;
 
-typedef struct {
-  ShapeType type;
-  void *data;
-} Shape_t;
-
 // private functions defined as static and implemented on the end of the file
-static void execute_circle_command(Ground_t *ground);
-static void execute_rectangle_command(Ground_t *ground);
-static void execute_line_command(Ground_t *ground);
-static void execute_text_command(Ground_t *ground);
-static void execute_text_style_command(Ground_t *ground);
+// Each shape type in SHAPE_TYPE_LIST has a .geo command parser and an SVG
+// writer:
+//   c i x y r corb corp          (circle)
+//   r i x y w h corb corp        (rectangle)
+//   l i x1 y1 x2 y2 cor          (line)
+//   t i x y corb corp a txto     (text)
+//   ts fFamily fWeight fSize     (text style)
+#define GEO_DECLARE_SHAPE_FUNCTIONS(type, prefix, command)                     \
+  static void execute_##prefix##_command(Ground_t *ground);                    \
+  static void write_##prefix##_svg(SvgWriter svg, void *data);
+SHAPE_TYPE_LIST(GEO_DECLARE_SHAPE_FUNCTIONS)
+#undef GEO_DECLARE_SHAPE_FUNCTIONS
 static void create_svg_queue(Ground_t *ground, const char *output_path,
                              FileData fileData, const char *command_suffix);
+static void gather_view_shapes(Ground_t *view);
+
+typedef struct {
+  const char *name;
+  void (*execute)(Ground_t *ground);
+} GeoCommand_t;
+
+static const GeoCommand_t geo_commands[] = {
+#define GEO_COMMAND_ENTRY(type, prefix, command)                               \
+  {command, execute_##prefix##_command},
+    SHAPE_TYPE_LIST(GEO_COMMAND_ENTRY)
+#undef GEO_COMMAND_ENTRY
+};
+
+static void (*const svg_writers[])(SvgWriter svg, void *data) = {
+#define GEO_SVG_WRITER_ENTRY(type, prefix, command)                            \
+  [type] = write_##prefix##_svg,
+    SHAPE_TYPE_LIST(GEO_SVG_WRITER_ENTRY)
+#undef GEO_SVG_WRITER_ENTRY
+};
 
 Ground execute_geo_commands(FileData fileData, const char *output_path,
                             const char *command_suffix) {
@@ -40,36 +77,24 @@ Ground execute_geo_commands(FileData fileData, const char *output_path,
   }
 
   ground->shapesQueue = queue_create();
-  ground->shapesStackToFree = stack_create();
+  ground->ownedShapes = NULL;
+  ground->ownedCount = 0;
+  ground->ownedCapacity = 0;
+  ground->baseNext = NULL;
+  ground->baseRemaining = 0;
   ground->svgQueue = queue_create();
   while (!queue_is_empty(get_file_lines_queue(fileData))) {
     char *line = (char *)queue_dequeue(get_file_lines_queue(fileData));
     char *command = strtok(line, " ");
 
-    // Circle command: c i x y r corb corp
-    if (strcmp(command, "c") == 0) {
-      execute_circle_command(ground);
-    }
-
-    // Rectangle command: r i x y w h corb corp
-    else if (strcmp(command, "r") == 0) {
-      execute_rectangle_command(ground);
-
-    }
-    // Line command: l i x1 y1 x2 y2 cor
-    else if (strcmp(command, "l") == 0) {
-      execute_line_command(ground);
-
-    }
-
-    // Text command: t i x y corb corp a txto
-    else if (strcmp(command, "t") == 0) {
-      execute_text_command(ground);
+    size_t i = 0;
+    size_t commandsCount = sizeof(geo_commands) / sizeof(geo_commands[0]);
+    while (i < commandsCount && strcmp(command, geo_commands[i].name) != 0) {
+      i++;
     }
 
-    // Text style command: ts fFamily fWeight fSize
-    else if (strcmp(command, "ts") == 0) {
-      execute_text_style_command(ground);
+    if (i < commandsCount) {
+      geo_commands[i].execute(ground);
     } else {
       printf("Unknown command: %s\n", command);
     }
@@ -78,45 +103,136 @@ Ground execute_geo_commands(FileData fileData, const char *output_path,
   return ground;
 }
 
+// Creates an empty ground with nothing to render
+Ground create_ground(void) {
+  Ground_t *ground = malloc(sizeof(Ground_t));
+  if (ground == NULL) {
+    printf("Error: Failed to allocate memory for Ground\n");
+    exit(1);
+  }
+
+  ground->shapesQueue = queue_create();
+  ground->ownedShapes = NULL;
+  ground->ownedCount = 0;
+  ground->ownedCapacity = 0;
+  ground->baseNext = NULL;
+  ground->baseRemaining = 0;
+  ground->svgQueue = NULL;
+  if (ground->shapesQueue == NULL) {
+    printf("Error: Failed to allocate memory for Ground\n");
+    exit(1);
+  }
+  return ground;
+}
+
+// Creates a view reading the shapes of base, with its own tail and clones
+Ground fork_ground(Ground base) {
+  Ground_t *ground = malloc(sizeof(Ground_t));
+  if (ground == NULL) {
+    printf("Error: Failed to allocate memory for Ground\n");
+    exit(1);
+  }
+
+  // A view is read through a cursor over a single queue, so the shapes of
+  // a view used as base are gathered in one first
+  Ground_t *base_t = (Ground_t *)base;
+  if (base_t->baseRemaining > 0) {
+    gather_view_shapes(base_t);
+  }
+  ground->shapesQueue = queue_create();
+  ground->baseNext = queue_fast_front(base_t->shapesQueue);
+  ground->baseRemaining = queue_size(base_t->shapesQueue);
+  ground->ownedShapes = NULL;
+  ground->ownedCount = 0;
+  ground->ownedCapacity = 0;
+  ground->svgQueue = NULL;
+  if (ground->shapesQueue == NULL) {
+    printf("Error: Failed to allocate memory for Ground\n");
+    exit(1);
+  }
+  return ground;
+}
+
 void destroy_geo_waste(Ground ground) {
   Ground_t *ground_t = (Ground_t *)ground;
   queue_destroy(ground_t->shapesQueue);
   queue_destroy(ground_t->svgQueue);
-  while (!stack_is_empty(ground_t->shapesStackToFree)) {
-    Shape_t *shape = stack_pop(ground_t->shapesStackToFree);
-    switch (shape->type) {
-    case CIRCLE:
-      circle_destroy(shape->data);
-      break;
-    case RECTANGLE:
-      rectangle_destroy(shape->data);
-      break;
-    case LINE:
-      line_destroy(shape->data);
-      break;
-    case TEXT:
-      text_destroy(shape->data);
-      break;
-    case TEXT_STYLE:
-      text_style_destroy(shape->data);
-      break;
-    default:
-      break;
-    }
-    free(shape);
+  for (int i = 0; i < ground_t->ownedCount; i++) {
+    shape_destroy(ground_t->ownedShapes[i]);
   }
-  stack_destroy(ground_t->shapesStackToFree);
+  free(ground_t->ownedShapes);
   free(ground);
 }
 
-Queue get_ground_queue(Ground ground) {
+// Shapes of the base come first; lc only takes from the front and calc
+// only adds at the end, so a view never writes to its base
+Shape take_ground_shape(Ground ground) {
   Ground_t *ground_t = (Ground_t *)ground;
-  return ground_t->shapesQueue;
+  if (ground_t->baseRemaining > 0) {
+    Shape shape = (Shape)ground_t->baseNext->data;
+    ground_t->baseNext = ground_t->baseNext->next;
+    ground_t->baseRemaining--;
+    return shape;
+  }
+  return (Shape)queue_dequeue(ground_t->shapesQueue);
+}
+
+bool add_ground_shape(Ground ground, Shape shape) {
+  return queue_enqueue(((Ground_t *)ground)->shapesQueue, shape);
+}
+
+void add_ground_shapes(Ground ground, Queue shapes) {
+  queue_append_all(((Ground_t *)ground)->shapesQueue, shapes);
 }
 
-Stack get_ground_shapes_stack_to_free(Ground ground) {
+int count_ground_shapes(Ground ground) {
   Ground_t *ground_t = (Ground_t *)ground;
-  return ground_t->shapesStackToFree;
+  return ground_t->baseRemaining + queue_size(ground_t->shapesQueue);
+}
+
+void for_each_ground_shape(Ground ground,
+                           void (*visit)(void *shape, void *ctx), void *ctx) {
+  Ground_t *ground_t = (Ground_t *)ground;
+  const QueueNode *node = ground_t->baseNext;
+  for (int i = 0; i < ground_t->baseRemaining; i++) {
+    visit(node->data, ctx);
+    node = node->next;
+  }
+  queue_for_each(ground_t->shapesQueue, visit, ctx);
+}
+
+// Makes the ground free shape when it is destroyed
+void track_ground_shape(Ground ground, Shape shape) {
+  Ground_t *ground_t = (Ground_t *)ground;
+  if (ground_t->ownedCount == ground_t->ownedCapacity) {
+    int capacity =
+        ground_t->ownedCapacity > 0 ? ground_t->ownedCapacity * 2 : 1024;
+    Shape *owned =
+        realloc(ground_t->ownedShapes, (size_t)capacity * sizeof(Shape));
+    if (owned == NULL) {
+      printf("Error: Failed to allocate memory for Ground\n");
+      exit(1);
+    }
+    ground_t->ownedShapes = owned;
+    ground_t->ownedCapacity = capacity;
+  }
+  shape_fast_set_owner_slot(shape, ground_t->ownedCount);
+  ground_t->ownedShapes[ground_t->ownedCount++] = shape;
+}
+
+// Frees shape now if the ground owns it; the last owned shape takes its slot
+void release_ground_shape(Ground ground, Shape shape) {
+  Ground_t *ground_t = (Ground_t *)ground;
+  int slot = shape_fast_get_owner_slot(shape);
+  if (slot < 0 || slot >= ground_t->ownedCount ||
+      ground_t->ownedShapes[slot] != shape) {
+    return;
+  }
+
+  Shape last = ground_t->ownedShapes[--ground_t->ownedCount];
+  ground_t->ownedShapes[slot] = last;
+  shape_fast_set_owner_slot(last, slot);
+  shape_destroy(shape);
 }
 
 /**
@@ -135,15 +251,13 @@ static void execute_circle_command(Ground_t *ground) {
   Circle circle = circle_create(atoi(identifier), atof(posX), atof(posY),
                                 atof(radius), borderColor, fillColor);
 
-  Shape_t *shape = malloc(sizeof(Shape_t));
+  Shape shape = shape_create(CIRCLE, circle);
   if (shape == NULL) {
     printf("Error: Failed to allocate memory for Shape\n");
     exit(1);
   }
-  shape->type = CIRCLE;
-  shape->data = circle;
   queue_enqueue(ground->shapesQueue, shape);
-  stack_push(ground->shapesStackToFree, shape);
+  track_ground_shape(ground, shape);
   queue_enqueue(ground->svgQueue, shape);
 }
 
@@ -160,15 +274,13 @@ static void execute_rectangle_command(Ground_t *ground) {
       rectangle_create(atoi(identifier), atof(posX), atof(posY), atof(width),
                        atof(height), borderColor, fillColor);
 
-  Shape_t *shape = malloc(sizeof(Shape_t));
+  Shape shape = shape_create(RECTANGLE, rectangle);
   if (shape == NULL) {
     printf("Error: Failed to allocate memory for Shape\n");
     exit(1);
   }
-  shape->type = RECTANGLE;
-  shape->data = rectangle;
   queue_enqueue(ground->shapesQueue, shape);
-  stack_push(ground->shapesStackToFree, shape);
+  track_ground_shape(ground, shape);
   queue_enqueue(ground->svgQueue, shape);
 }
 
@@ -183,15 +295,13 @@ static void execute_line_command(Ground_t *ground) {
   Line line = line_create(atoi(identifier), atof(x1), atof(y1), atof(x2),
                           atof(y2), color);
 
-  Shape_t *shape = malloc(sizeof(Shape_t));
+  Shape shape = shape_create(LINE, line);
   if (shape == NULL) {
     printf("Error: Failed to allocate memory for Shape\n");
     exit(1);
   }
-  shape->type = LINE;
-  shape->data = line;
   queue_enqueue(ground->shapesQueue, shape);
-  stack_push(ground->shapesStackToFree, shape);
+  track_ground_shape(ground, shape);
   queue_enqueue(ground->svgQueue, shape);
 }
 
@@ -207,15 +317,13 @@ static void execute_text_command(Ground_t *ground) {
   Text text_obj = text_create(atoi(identifier), atof(posX), atof(posY),
                               borderColor, fillColor, *anchor, text);
 
-  Shape_t *shape = malloc(sizeof(Shape_t));
+  Shape shape = shape_create(TEXT, text_obj);
   if (shape == NULL) {
     printf("Error: Failed to allocate memory for Shape\n");
     exit(1);
   }
-  shape->type = TEXT;
-  shape->data = text_obj;
   queue_enqueue(ground->shapesQueue, shape);
-  stack_push(ground->shapesStackToFree, shape);
+  track_ground_shape(ground, shape);
   queue_enqueue(ground->svgQueue, shape);
 }
 
@@ -227,18 +335,36 @@ static void execute_text_style_command(Ground_t *ground) {
   TextStyle text_style_obj =
       text_style_create(fontFamily, *fontWeight, atoi(fontSize));
 
-  Shape_t *shape = malloc(sizeof(Shape_t));
+  Shape shape = shape_create(TEXT_STYLE, text_style_obj);
   if (shape == NULL) {
     printf("Error: Failed to allocate memory for Shape\n");
     exit(1);
   }
-  shape->type = TEXT_STYLE;
-  shape->data = text_style_obj;
   queue_enqueue(ground->shapesQueue, shape);
-  stack_push(ground->shapesStackToFree, shape);
+  track_ground_shape(ground, shape);
   queue_enqueue(ground->svgQueue, shape);
 }
 
+// Replaces the queue of a view with one holding every shape of the view,
+// those still in its base included, so it no longer reads its base
+static void gather_view_shapes(Ground_t *view) {
+  Queue shapes = queue_create();
+  if (shapes == NULL) {
+    printf("Error: Failed to allocate memory for Ground\n");
+    exit(1);
+  }
+  while (view->baseRemaining > 0) {
+    if (!queue_enqueue(shapes, take_ground_shape(view))) {
+      printf("Error: Failed to allocate memory for Ground\n");
+      exit(1);
+    }
+  }
+  queue_append_all(shapes, view->shapesQueue);
+  queue_destroy(view->shapesQueue);
+  view->shapesQueue = shapes;
+  view->baseNext = NULL;
+}
+
 static void create_svg_queue(Ground_t *ground, const char *output_path,
                              FileData fileData, const char *command_suffix) {
   const char *original_file_name = get_file_name(fileData);
@@ -278,66 +404,61 @@ static void create_svg_queue(Ground_t *ground, const char *output_path,
     return;
   }
 
-  FILE *file = fopen(output_path_with_file, "w");
-  if (file == NULL) {
+  SvgWriter svg = svg_writer_open(output_path_with_file);
+  if (svg == NULL) {
     printf("Error: Failed to open file: %s\n", output_path_with_file);
     free(output_path_with_file);
     return;
   }
-  fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-  fprintf(
-      file,
-      "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 1000 1000\">\n");
   while (!queue_is_empty(ground->svgQueue)) {
-    Shape_t *shape = queue_dequeue(ground->svgQueue);
+    Shape shape = queue_dequeue(ground->svgQueue);
     if (shape != NULL) {
-      if (shape->type == CIRCLE) {
-        Circle circle = (Circle)shape->data;
-        fprintf(
-            file,
-            "<circle cx='%.2f' cy='%.2f' r='%.2f' fill='%s' stroke='%s'/>\n",
-            circle_get_x(circle), circle_get_y(circle),
-            circle_get_radius(circle), circle_get_fill_color(circle),
-            circle_get_border_color(circle));
-      } else if (shape->type == RECTANGLE) {
-        Rectangle rectangle = (Rectangle)shape->data;
-        fprintf(file,
-                "<rect x='%.2f' y='%.2f' width='%.2f' height='%.2f' fill='%s' "
-                "stroke='%s'/>\n",
-                rectangle_get_x(rectangle), rectangle_get_y(rectangle),
-                rectangle_get_width(rectangle), rectangle_get_height(rectangle),
-                rectangle_get_fill_color(rectangle),
-                rectangle_get_border_color(rectangle));
-      } else if (shape->type == LINE) {
-        Line line = (Line)shape->data;
-        fprintf(file,
-                "<line x1='%.2f' y1='%.2f' x2='%.2f' y2='%.2f' stroke='%s'/>\n",
-                line_get_x1(line), line_get_y1(line), line_get_x2(line),
-                line_get_y2(line), line_get_color(line));
-      } else if (shape->type == TEXT) {
-        Text text = (Text)shape->data;
-        char anchor = text_get_anchor(text);
-        const char *text_anchor = "start"; // default
-
-        // Map anchor character to SVG text-anchor value
-        if (anchor == 'm' || anchor == 'M') {
-          text_anchor = "middle";
-        } else if (anchor == 'e' || anchor == 'E') {
-          text_anchor = "end";
-        } else if (anchor == 's' || anchor == 'S') {
-          text_anchor = "start";
-        }
-
-        fprintf(file,
-                "<text x='%.2f' y='%.2f' fill='%s' stroke='%s' "
-                "text-anchor='%s'>%s</text>\n",
-                text_get_x(text), text_get_y(text), text_get_fill_color(text),
-                text_get_border_color(text), text_anchor, text_get_text(text));
-      }
+      svg_writers[shape_fast_get_type(shape)](svg, shape_fast_get_data(shape));
     }
   }
-  fprintf(file, "</svg>\n");
-  fclose(file);
+  svg_writer_close(svg);
   free(output_path_with_file);
   free(file_name);
-}
\ No newline at end of file
+}
+
+static void write_circle_svg(SvgWriter svg, void *data) {
+  Circle circle = (Circle)data;
+  svg_writer_circle(svg, circle_fast_get_x(circle), circle_fast_get_y(circle),
+                    circle_fast_get_radius(circle),
+                    circle_fast_get_fill_color(circle),
+                    circle_fast_get_border_color(circle));
+  svg_writer_end(svg);
+}
+
+static void write_rectangle_svg(SvgWriter svg, void *data) {
+  Rectangle rectangle = (Rectangle)data;
+  svg_writer_rect(svg, rectangle_fast_get_x(rectangle),
+                  rectangle_fast_get_y(rectangle),
+                  rectangle_fast_get_width(rectangle),
+                  rectangle_fast_get_height(rectangle),
+                  rectangle_fast_get_fill_color(rectangle),
+                  rectangle_fast_get_border_color(rectangle));
+  svg_writer_end(svg);
+}
+
+static void write_line_svg(SvgWriter svg, void *data) {
+  Line line = (Line)data;
+  svg_writer_line(svg, line_fast_get_x1(line), line_fast_get_y1(line),
+                  line_fast_get_x2(line), line_fast_get_y2(line),
+                  line_fast_get_color(line));
+  svg_writer_end(svg);
+}
+
+static void write_text_svg(SvgWriter svg, void *data) {
+  Text text = (Text)data;
+  svg_writer_text(svg, text_fast_get_x(text), text_fast_get_y(text),
+                  text_fast_get_fill_color(text),
+                  text_fast_get_border_color(text), text_fast_get_anchor(text));
+  svg_writer_content(svg, text_fast_get_text(text));
+}
+
+static void write_text_style_svg(SvgWriter svg, void *data) {
+  // Style descriptors are not drawn
+  (void)svg;
+  (void)data;
+}
@@ -8,8 +8,10 @@
 
 #ifndef GEO_HANDLER_H
 #define GEO_HANDLER_H
-#include "../commons/stack/stack.h"
+#include "../commons/queue/queue.h"
 #include "../file_reader/file_reader.h"
+#include "../shapes/shape/shape.h"
+#include <stdbool.h>
 
 /**
  * @brief Opaque pointer type for ground instances
@@ -27,18 +29,87 @@ Ground execute_geo_commands(FileData fileData, const char *output_path,
                             const char *command_suffix);
 
 /**
- * @brief Gets the ground queue containing all shapes
+ * @brief Creates a ground with no shapes, without reading any .geo file
+ *
+ * Used to restore a ground saved in a .qry snapshot.
+ *
+ * @return Empty ground instance
+ */
+Ground create_ground(void);
+
+/**
+ * @brief Creates a copy-on-write view of a ground for one .qry run
+ *
+ * The view shares the shapes of the base, which must outlive it and stay
+ * unchanged while it exists. It reads the shapes of the base through a
+ * cursor that take_ground_shape advances, and keeps the shapes added to it
+ * in a queue of its own, so forking takes constant time and a view only
+ * grows with what its run adds. The clones it tracks are freed with it, so
+ * views of the same base may be used on different threads.
+ *
+ * @param base Ground instance created by execute_geo_commands, or a view
+ *        whose runs have ended (its shapes are then gathered in a queue
+ *        first)
+ * @return New ground view; destroy it with destroy_geo_waste
+ */
+Ground fork_ground(Ground base);
+
+/**
+ * @brief Removes the first shape of the ground
+ * @param ground Ground instance
+ * @return The removed shape, or NULL if the ground has no shapes
+ */
+Shape take_ground_shape(Ground ground);
+
+/**
+ * @brief Adds a shape to the end of the ground
+ * @param ground Ground instance
+ * @param shape Shape to add
+ * @return true on success, false if memory ran out
+ */
+bool add_ground_shape(Ground ground, Shape shape);
+
+/**
+ * @brief Moves every shape of a queue to the end of the ground
+ * @param ground Ground instance
+ * @param shapes Queue of shapes, left empty; they keep their order
+ */
+void add_ground_shapes(Ground ground, Queue shapes);
+
+/**
+ * @brief Gets the number of shapes on the ground
+ * @param ground Ground instance
+ * @return Number of shapes
+ */
+int count_ground_shapes(Ground ground);
+
+/**
+ * @brief Calls visit on every shape of the ground, from first to last,
+ * without removing them
+ * @param ground Ground instance
+ * @param visit Function receiving each shape and ctx
+ * @param ctx Caller data passed to visit
+ */
+void for_each_ground_shape(Ground ground,
+                           void (*visit)(void *shape, void *ctx), void *ctx);
+
+/**
+ * @brief Makes the ground own a shape, freeing it when it is destroyed
  * @param ground Ground instance
- * @return Queue containing all shapes
+ * @param shape Shape not owned by any ground yet
  */
-Queue get_ground_queue(Ground ground);
+void track_ground_shape(Ground ground, Shape shape);
 
 /**
- * @brief Gets the ground shapes stack used for memory management
+ * @brief Frees a shape owned by the ground before the ground is destroyed
+ *
+ * Shapes owned by another ground, such as the base of a view, are left
+ * alone. The caller must make sure nothing refers to the shape anymore.
+ *
  * @param ground Ground instance
- * @return Stack containing shapes to free
+ * @param shape Shape that is no longer used
  */
-Stack get_ground_shapes_stack_to_free(Ground ground);
+void release_ground_shape(Ground ground, Shape shape);
 
 /**
  * @brief Destroys the ground and frees all associated memory
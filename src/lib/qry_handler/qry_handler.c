@@ -1,175 +1,676 @@
 #include "qry_handler.h"
+#include "../commons/aabb_batch/aabb_batch.h"
+#include "../commons/collision/collision.h"
+#include "../commons/kd_tree/kd_tree.h"
 #include "../commons/queue/queue.h"
+#include "../commons/rtree/rtree.h"
+#include "../commons/scalar/scalar.h"
+#include "../commons/spatial_grid/spatial_grid.h"
 #include "../commons/stack/stack.h"
+#include "../commons/svg_writer/svg_writer.h"
+#include "../commons/text_writer/text_writer.h"
+#include "../commons/thread_pool/thread_pool.h"
 #include "../commons/utils/utils.h"
 #include "../geo_handler/geo_handler.h"
+#include "../qry_program/qry_program_internal.h"
 #include "../shapes/circle/circle.h"
+#include "../shapes/circle/circle_internal.h"
 #include "../shapes/line/line.h"
+#include "../shapes/line/line_internal.h"
 #include "../shapes/rectangle/rectangle.h"
+#include "../shapes/rectangle/rectangle_internal.h"
+#include "../shapes/shape/shape.h"
+#include "../shapes/shape/shape_internal.h"
 #include "../shapes/shapes.h"
 #include "../shapes/text/text.h"
+#include "../shapes/text/text_internal.h"
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-typedef struct {
-  ShapeType type;
-  void *data;
-} Shape_t;
-
+// Shooters and loaders live in arrays indexed by the slots the program
+// gave their ids, so their addresses stay valid while the program runs
 typedef struct {
   int id;
-  Stack *shapes;
+  Stack shapes; // NULL until a lc or atch names the loader
+  bool shared;  // shapes belong to the run this one was forked from
+  int node;     // scratch, used while grouping shooter commands
 } Loader_t;
 
 typedef struct {
   int id;
-  double x;
-  double y;
-  Shape_t *shootingPosition;
+  bool registered; // a pd named this shooter
+  Scalar x;
+  Scalar y;
+  Shape shootingPosition;
   Loader_t *rightLoader;
   Loader_t *leftLoader;
-  int rightLoaderId; // stable identifier, avoids dangling pointers after
-                     // realloc
-  int leftLoaderId; // stable identifier, avoids dangling pointers after realloc
+  int node; // scratch, used while grouping shooter commands
 } Shooter_t;
 
+// Build with -DQRY_INCREMENTAL_CALC (make CALC=incremental) to resolve launch
+// pairs while the arena is filled
+#ifdef QRY_INCREMENTAL_CALC
+#define QRY_INCREMENTAL_CALC_ENABLED true
+#else
+#define QRY_INCREMENTAL_CALC_ENABLED false
+#endif
+
+// Build with -DQRY_EXACT_OVERLAP (make OVERLAP=exact) to confirm bounding box
+// hits with an exact test of the shapes
+#ifdef QRY_EXACT_OVERLAP
+#define QRY_EXACT_OVERLAP_ENABLED true
+#else
+#define QRY_EXACT_OVERLAP_ENABLED false
+#endif
+
+typedef struct {
+  Shape shape;
+  Scalar x;
+  Scalar y;
+  bool isAnnotated;
+  Scalar shooterX;
+  Scalar shooterY;
+} ShapePositionOnArena_t;
+
+// Append-only log of the shapes on the arena, in launch order
+typedef struct {
+  ShapePositionOnArena_t *records; // oldest launch first
+  int count;
+  int capacity;
+} Arena_t;
+
+// Shapes a shooter command discarded because no loader could take them
+typedef struct {
+  Shape *shapes; // oldest discard first
+  int count;
+  int capacity;
+} Discarded_t;
+
+// Pairs planned per parallel batch, bounding the memory used by calc
+#define CALC_PAIRS_PER_BATCH 65536
+// Below this many pairs, planning stays on the calling thread
+#define CALC_PARALLEL_MIN_PAIRS 1024
+// Threads used by calc; 0 means one per online processor
+#ifndef QRY_CALC_THREADS
+#define QRY_CALC_THREADS 0
+#endif
+
+typedef enum {
+  CLONE_AT_POSITION,
+  CLONE_WITH_BORDER_COLOR,
+  CLONE_WITH_SWAPPED_COLORS
+} CloneKind;
+
+// A shape going back to the ground as a clone of an arena record
+typedef struct {
+  const ShapePositionOnArena_t *source;
+  CloneKind kind;
+  const char *borderColor; // CLONE_WITH_BORDER_COLOR only
+  Shape clone;
+  bool built; // clone was already built while planning
+} PlannedClone_t;
+
+// Result of one launch pair, as planned before being merged into the ground
+typedef struct {
+  bool boxesOverlap; // broadphase result
+  bool overlap;      // final result, after the narrowphase if enabled
+  double crushedArea;
+  int cloneCount;
+  PlannedClone_t clones[3];
+} PairOutcome_t;
+
+typedef struct {
+  const ShapePositionOnArena_t *records; // first record of the batch
+  PairOutcome_t *outcomes;
+  bool exactOverlap;
+} PlanPairsJob_t;
+
+// Exact geometry of an arena record for the narrowphase
+typedef enum { COLLIDER_CIRCLE, COLLIDER_BOX, COLLIDER_SEGMENT } ColliderKind;
+
+typedef struct {
+  ColliderKind kind;
+  double x1; // circle center, box minimum corner or segment start
+  double y1;
+  double x2; // box maximum corner or segment end
+  double y2;
+  double radius; // circle radius or segment half width
+} Collider_t;
+
+// Spatial indexes over the ground. Shapes are numbered in ground queue order
+// once a query needs them; lc only takes shapes from the front of the queue,
+// so the shapes still on the ground are the last queue_size(ground) numbered
+// ones. Each tree is built on its first query and catches up with the
+// numbering on the next ones.
+typedef struct {
+  bool numbered; // the ground is being numbered
+  Shape *shapes; // shape number -> shape
+  int count;
+  int capacity;
+  RTree boxes;       // item is the shape number; NULL until the first sel
+  int boxesIndexed;  // shapes numbered below this were added to boxes
+  KdTree anchors;    // anchor points; NULL until the first prox
+  int anchorsIndexed;
+} GroundIndex_t;
+
+// Outcome of a shft, dsp or rjd. These commands only touch one shooter
+// and the loaders attached to it, so a run of them is split into groups of
+// commands on shooters that share no loader. The groups run concurrently,
+// each launching into its own staging arena; the reports and launches are
+// then merged in command order.
 typedef enum {
-  FREE_SHOOTERS_ARRAY,
-  FREE_LOADERS_ARRAY,
-  FREE_SHAPE_POSITION,
-  FREE_STACK_HANDLE
-} FreeType;
+  SHOOTER_COMMAND_DONE,
+  SHOOTER_NOT_FOUND,
+  SHOOTER_INVALID_BUTTON,
+  SHOOTER_LOADER_NOT_FOUND
+} ShooterCommandStatus;
 
 typedef struct {
-  void *ptr;
-  FreeType type;
-} FreeItem;
+  int group;
+  ShooterCommandStatus status;
+  int firstRecord; // launches staged in the arena of the group
+  int recordCount;
+  int firstDiscarded; // shapes discarded into the list of the group
+  int discardedCount;
+} ShooterOutcome_t;
+
+// Below this many commands in a run, the groups run on the calling thread
+#define SHOOTER_PARALLEL_MIN_COMMANDS 256
 
 typedef struct {
-  Stack arena;       // elements are ShapePositionOnArena_t
-  Stack stackToFree; // elements are FreeItem
+  struct Qry_t *qry;
+  const QryInstruction *code; // first command of the run
+  ShooterOutcome_t *outcomes;
+  const int *order;      // command indices, grouped, in command order
+  const int *groupStart; // group g runs order[groupStart[g] ..
+                         // groupStart[g + 1] - 1]
+  Arena_t *staged;       // one arena per group
+  Discarded_t *discarded; // one list per group
+} ShooterGroupsJob_t;
+
+typedef struct Qry_t {
+  Arena_t arena;
+  QryProgram program; // program being run, not owned
+  Shooter_t *shooters; // by shooter slot of the program
+  int shooterCount;
+  Loader_t *loaders; // by loader slot of the program
+  int loaderCount;
+  // Launch pairs are resolved as soon as both shapes are on the arena
+  // instead of all at once by calc
+  bool incrementalCalc;
+  Queue resolvedShapes; // shapes that return to the ground at the next calc
+  double crushedArea;   // area crushed by the pairs resolved since last calc
+  ThreadPool workerPool; // plans launch pairs and runs shooter groups
+  // Overlapping bounding boxes are confirmed by an exact shape test
+  bool exactOverlap;
+  int broadphaseRejects;  // pairs apart by their boxes, since last calc
+  int narrowphaseRejects; // pairs apart by the exact test, since last calc
+  GroundIndex_t groundIndex;
 } Qry_t;
 
+// Ground shapes found by sel, as shape numbers of the ground index
 typedef struct {
-  Shape_t *shape;
+  const Qry_t *qry;
+  int firstOnGround; // lower numbers already left the ground
+  double window[4];  // minX, minY, maxX, maxY
+  int *found;
+  int foundCount;
+  int foundCapacity;
+} RegionSelection_t;
+
+// Shapes gathered by sob; items[0 .. arenaCount - 1] are on the arena and the
+// rest on the ground
+typedef struct {
+  ShapePositionOnArena_t *items;
+  int count;
+  int arenaCount;
+  bool exactOverlap;
+  TextWriter report;
+  int pairCount; // pairs reported so far
+} OverlapScan_t;
+
+// .qry runs against one ground, or branches of one run, taken in order by
+// the worker threads
+typedef struct {
+  QryProgram *programs;
+  FileData *qryFileDatas;
+  int count;
+  int next; // first run not taken yet, guarded by lock
+  pthread_mutex_t lock;
+  FileData geoFileData;
+  Ground ground; // base of the views, only read
+  const struct Qry_t *base; // run the programs continue, or NULL
+  const char *outputPath;
+  int runThreads; // size of the worker pool of each run
+} QryMatches_t;
+
+// Snapshots a run saves while running, and the one it resumes from
+typedef struct {
+  const char *resumePath;     // NULL to start from the first instruction
+  const char *checkpointPath; // NULL to save no snapshot
+  int interval;               // instructions run between two snapshots
+} QryCheckpointing_t;
+
+// Layout of a snapshot file: this header, the ground queue, the loaders
+// (size or -1 for a loader never filled, then its shapes from the top), the
+// shooters, the arena and the shapes waiting for the next calc
+#define QRY_SNAPSHOT_VERSION 1
+typedef struct {
+  char magic[4]; // "QRYK"
+  int version;
+  uint64_t sourceHash; // of the .qry the program was compiled from
+  int incrementalCalc;
+  int next;       // first instruction not run yet
+  long txtSize;   // bytes of the .txt report written by then
+  int shooterCount;
+  int loaderCount;
+  double crushedArea;
+  int broadphaseRejects;
+  int narrowphaseRejects;
+  int groundCount;
+  int arenaCount;
+  int resolvedCount;
+} QrySnapshotHeader;
+
+typedef struct {
+  int registered;
   double x;
   double y;
-  bool isAnnotated;
+  int rightLoader; // loader slot or -1
+  int leftLoader;
+  int loaded; // a shape in the shooting position follows
+} ShooterSnapshot_t;
+
+typedef struct {
+  double x;
+  double y;
+  int isAnnotated;
   double shooterX;
   double shooterY;
-} ShapePositionOnArena_t;
+} ArenaRecordSnapshot_t; // followed by the shape of the record
+
+// Shapes written to a snapshot by queue_for_each and stack_for_each
+typedef struct {
+  FILE *file;
+  bool ok;
+} SnapshotWriter_t;
 
 // private functions
-static void execute_pd_command(Shooter_t **shooters, int *shootersCount,
-                               Stack stackToFree);
-static void execute_lc_command(Loader_t **loaders, int *loadersCount,
-                               Ground ground, Stack stackToFree, FILE *txtFile);
-static void execute_atch_command(Loader_t **loaders, int *loadersCount,
-                                 Shooter_t **shooters, int *shootersCount,
-                                 Stack stackToFree);
-static void perform_shift_operation(Shooter_t **shooters, int shootersCount,
-                                    int shooterId, const char *direction,
-                                    int times, Loader_t *loaders,
-                                    int loadersCount);
-static void perform_shoot_operation(Shooter_t **shooters, int shootersCount,
-                                    int shooterId, double dx, double dy,
-                                    const char *annotate, Stack arena,
-                                    Stack stackToFree);
-static void execute_shft_command(Shooter_t **shooters, int *shootersCount,
-                                 Loader_t *loaders, int *loadersCount,
-                                 FILE *txtFile);
-static void execute_dsp_command(Shooter_t **shooters, int *shootersCount,
-                                Stack arena, Stack stackToFree, FILE *txtFile);
-static void execute_rjd_command(Shooter_t **shooters, int *shootersCount,
-                                Stack stackToFree, Stack arena,
-                                Loader_t *loaders, int *loadersCount,
-                                FILE *txtFile);
-static void execute_calc_command(Stack arena, Ground ground, FILE *txtFile,
+static Qry_t *create_qry(QryProgram program, int threads);
+static Qry_t *fork_qry(const Qry_t *base, QryProgram program, int threads);
+static Qry_t *run_qry_program(Qry_t *qry, FileData qryFileData,
+                              FileData geoFileData, Ground ground,
+                              const char *output_path,
+                              const QryCheckpointing_t *checkpointing);
+static void run_qry_matches(QryProgram *programs, FileData *qryFileDatas,
+                            int count, FileData geoFileData, Ground ground,
+                            const Qry_t *base, const char *output_path);
+static bool save_qry_snapshot(const Qry_t *qry, Ground ground,
+                              const char *path, int next, long txtSize);
+static void write_snapshot_shape(void *shape, void *ctx);
+static int load_qry_snapshot(Qry_t *qry, Ground ground, const char *path,
+                             long *txtSize);
+static bool read_snapshot_shapes(FILE *file, int count, Ground ground,
+                                 Shape *shapes);
+static bool restore_report(const char *path, long size);
+static void run_qry_matches_task(void *ctx, int begin, int end);
+static void copy_resolved_shape(void *shape, void *ctx);
+static void execute_pd_command(Qry_t *qry, const QryInstruction *in);
+static void execute_lc_command(Qry_t *qry, const QryInstruction *in,
+                               Ground ground, TextWriter report);
+static void execute_atch_command(Qry_t *qry, const QryInstruction *in);
+static void perform_shift_operation(Shooter_t *shooter, QryButton button,
+                                    int times, Discarded_t *discarded);
+static void perform_shoot_operation(Shooter_t *shooter, double dx, double dy,
+                                    bool annotate, Arena_t *arena);
+static void run_shooter_commands(Qry_t *qry, int first, int end,
+                                 Ground ground, TextWriter report);
+static int group_shooter_commands(Qry_t *qry, const QryInstruction *code,
+                                  ShooterOutcome_t *outcomes, int count);
+static int find_group_root(int *parent, int node);
+static void run_shooter_groups_task(void *ctx, int begin, int end);
+static void perform_shooter_command(Qry_t *qry, const QryInstruction *in,
+                                    ShooterOutcome_t *outcome, Arena_t *arena,
+                                    Discarded_t *discarded);
+static ShooterCommandStatus perform_volley_operation(Shooter_t *shooter,
+                                                     const QryInstruction *in,
+                                                     Arena_t *arena,
+                                                     Discarded_t *discarded);
+static void report_shooter_command(const Qry_t *qry, const QryInstruction *in,
+                                   const ShooterOutcome_t *outcome,
+                                   TextWriter report);
+static void execute_calc_command(Qry_t *qry, Ground ground, TextWriter report,
                                  int totalCommands, FileData qryFileData,
-                                 FileData geoFileData, const char *output_path);
-static int find_shooter_index_by_id(Shooter_t **shooters, int shootersCount,
-                                    int id);
+                                 FileData geoFileData, const char *output_path,
+                                 bool render);
+static void resolve_completed_pairs(Qry_t *qry, Ground ground);
+static void execute_sob_command(Qry_t *qry, Ground ground,
+                                TextWriter report);
+static void add_ground_item(void *shape, void *ctx);
+static void report_overlap_pair(void *ctx, int first, int second);
+static void execute_sel_command(Qry_t *qry, const QryInstruction *in,
+                                Ground ground, TextWriter report);
+static void execute_prox_command(Qry_t *qry, const QryInstruction *in,
+                                 Ground ground, TextWriter report);
+static int prepare_ground_index(GroundIndex_t *index, Ground ground);
+static void number_ground_shape(void *shape, void *ctx);
+static void sync_ground_boxes(GroundIndex_t *index, int firstOnGround);
+static void sync_ground_anchors(GroundIndex_t *index, int firstOnGround);
+static bool is_on_ground(void *ctx, int item);
+static void collect_selected_shape(void *ctx, int item);
+static int compare_ints(const void *a, const void *b);
+static void write_int_line(TextWriter report, const char *label, int value);
+static void write_fixed_line(TextWriter report, const char *label,
+                             double value, int decimals);
+static Shooter_t *find_shooter(Qry_t *qry, int slot);
+static void create_loader_stack(Loader_t *loader);
+static Stack writable_loader_shapes(Loader_t *loader);
+static void fire_volley(Shooter_t *shooter, Loader_t *source,
+                        Loader_t *target, double dx, double dy,
+                        double incrementX, double incrementY,
+                        Arena_t *arena, Discarded_t *discarded);
+static ShapePositionOnArena_t *arena_append(Arena_t *arena, int count);
+static void discard_shape(Discarded_t *discarded, Shape shape);
 
 void destroy_qry_waste(Qry qry) {
   Qry_t *qry_t = (Qry_t *)qry;
-  while (!stack_is_empty(qry_t->stackToFree)) {
-    FreeItem *item = (FreeItem *)stack_pop(qry_t->stackToFree);
-
-    if (item != NULL && item->ptr != NULL) {
-      switch (item->type) {
-      case FREE_SHOOTERS_ARRAY:
-      case FREE_LOADERS_ARRAY:
-      case FREE_SHAPE_POSITION:
-        free(item->ptr);
-        break;
-      case FREE_STACK_HANDLE: {
-        Stack *stack_handle = (Stack *)item->ptr;
-        if (stack_handle != NULL && *stack_handle != NULL) {
-          stack_destroy(*stack_handle);
-        }
-        free(item->ptr);
-        break;
-      }
-      }
-      free(item);
+  for (int slot = 0; slot < qry_t->loaderCount; slot++) {
+    if (!qry_t->loaders[slot].shared) {
+      stack_destroy(qry_t->loaders[slot].shapes);
     }
   }
-  stack_destroy(qry_t->arena);
-  stack_destroy(qry_t->stackToFree);
+  free(qry_t->loaders);
+  free(qry_t->shooters);
+  free(qry_t->arena.records);
+  rtree_destroy(qry_t->groundIndex.boxes);
+  kd_tree_destroy(qry_t->groundIndex.anchors);
+  free(qry_t->groundIndex.shapes);
+  queue_destroy(qry_t->resolvedShapes);
+  thread_pool_destroy(qry_t->workerPool);
   free(qry_t);
 }
 
 // Helpers for calc
-static double shape_area(ShapeType type, void *shapeData);
-typedef struct {
-  double minX;
-  double minY;
-  double maxX;
-  double maxY;
-} Aabb;
-static Aabb make_aabb_for_shape_on_arena(const ShapePositionOnArena_t *s);
-static bool aabb_overlap(Aabb a, Aabb b);
-static bool shapes_overlap(const ShapePositionOnArena_t *a,
-                           const ShapePositionOnArena_t *b);
-static Shape_t *make_shape_wrapper(ShapeType type, void *data);
-static Shape_t *clone_with_border_color(Shape_t *src,
-                                        const char *newBorderColor);
-static Shape_t *clone_with_swapped_colors(Shape_t *src);
-// Clone helpers setting a new position (x,y) based on arena placement
-static Shape_t *clone_with_position(Shape_t *src, double x, double y,
-                                    Ground ground);
-static Shape_t *clone_with_border_color_at_position(Shape_t *src,
-                                                    const char *newBorderColor,
-                                                    double x, double y,
-                                                    Ground ground);
-static Shape_t *clone_with_swapped_colors_at_position(Shape_t *src, double x,
-                                                      double y, Ground ground);
-static void destroy_shape(Shape_t *s);
+static void store_arena_box(const ShapePositionOnArena_t *s, AabbBatch batch,
+                            int k);
+static void plan_pairs_task(void *ctx, int begin, int end);
+static void plan_pair(const ShapePositionOnArena_t *I,
+                      const ShapePositionOnArena_t *J, bool overlap,
+                      PairOutcome_t *outcome);
+static void plan_clone(PairOutcome_t *outcome,
+                       const ShapePositionOnArena_t *source, CloneKind kind,
+                       const char *borderColor);
+static Shape build_planned_clone(const PlannedClone_t *planned);
+static void merge_pair_outcome(Qry_t *qry, PairOutcome_t *outcome,
+                               Ground ground);
+static void make_collider(const ShapePositionOnArena_t *s,
+                          Collider_t *collider);
+static bool shapes_touch(const ShapePositionOnArena_t *a,
+                         const ShapePositionOnArena_t *b);
+static bool shape_touches_window(const ShapePositionOnArena_t *s,
+                                 const double window[4]);
+// Clone helper setting a new position (x,y) based on arena placement
+static Shape clone_with_position(Shape src, double x, double y,
+                                 Ground ground);
+static Shape track_ground_clone(Shape cloned, Ground ground);
 
 // SVG writer for final .qry result
 static void write_qry_result_svg(FileData qryFileData, FileData geoFileData,
-                                 Ground ground, Stack arena,
+                                 Ground ground, const Arena_t *arena,
                                  const char *output_path);
+// Per-type SVG writers; placement is the arena record to draw the shape at,
+// or NULL to draw it at its own position
+#define QRY_DECLARE_SVG_WRITER(type, prefix, command)                          \
+  static void write_##prefix##_svg(SvgWriter svg, void *data,                 \
+                                   const ShapePositionOnArena_t *placement);
+SHAPE_TYPE_LIST(QRY_DECLARE_SVG_WRITER)
+#undef QRY_DECLARE_SVG_WRITER
+static void write_ground_shape_svg(void *shape, void *ctx);
+
+static const char *const shape_type_names[] = {
+#define QRY_SHAPE_TYPE_NAME(type, prefix, command) [type] = #prefix,
+    SHAPE_TYPE_LIST(QRY_SHAPE_TYPE_NAME)
+#undef QRY_SHAPE_TYPE_NAME
+};
+
+static void (*const svg_writers[])(SvgWriter svg, void *data,
+                                   const ShapePositionOnArena_t *placement) = {
+#define QRY_SVG_WRITER_ENTRY(type, prefix, command)                            \
+  [type] = write_##prefix##_svg,
+    SHAPE_TYPE_LIST(QRY_SVG_WRITER_ENTRY)
+#undef QRY_SVG_WRITER_ENTRY
+};
+
+Qry execute_qry_program(QryProgram program, FileData qryFileData,
+                        FileData geoFileData, Ground ground,
+                        const char *output_path) {
+  return run_qry_program(create_qry(program, QRY_CALC_THREADS), qryFileData,
+                         geoFileData, ground, output_path, NULL);
+}
+
+Qry execute_qry_program_checkpointed(QryProgram program, FileData qryFileData,
+                                     FileData geoFileData, Ground ground,
+                                     const char *output_path,
+                                     const char *resume_path,
+                                     const char *checkpoint_path,
+                                     int interval) {
+  QryCheckpointing_t checkpointing = {.resumePath = resume_path,
+                                      .checkpointPath = checkpoint_path,
+                                      .interval = interval > 0 ? interval : 1};
+  return run_qry_program(create_qry(program, QRY_CALC_THREADS), qryFileData,
+                         geoFileData, ground, output_path, &checkpointing);
+}
+
+Qry execute_qry_branch(Qry base, QryProgram program, FileData qryFileData,
+                       FileData geoFileData, Ground ground,
+                       const char *output_path) {
+  Qry_t *branch = fork_qry((const Qry_t *)base, program, QRY_CALC_THREADS);
+  if (branch == NULL) {
+    return NULL;
+  }
+  return run_qry_program(branch, qryFileData, geoFileData, ground,
+                         output_path, NULL);
+}
+
+void execute_qry_matches(QryProgram *programs, FileData *qryFileDatas,
+                         int count, FileData geoFileData, Ground ground,
+                         const char *output_path) {
+  run_qry_matches(programs, qryFileDatas, count, geoFileData, ground, NULL,
+                  output_path);
+}
+
+void execute_qry_branches(Qry base, QryProgram *programs,
+                          FileData *qryFileDatas, int count,
+                          FileData geoFileData, Ground ground,
+                          const char *output_path) {
+  run_qry_matches(programs, qryFileDatas, count, geoFileData, ground,
+                  (const Qry_t *)base, output_path);
+}
+
+/*
+==========================
+Private functions
+==========================
+*/
+
+// Runs each program against its own view of ground, forking base for each
+// one if not NULL, spread over a pool of worker threads
+static void run_qry_matches(QryProgram *programs, FileData *qryFileDatas,
+                            int count, FileData geoFileData, Ground ground,
+                            const Qry_t *base, const char *output_path) {
+  if (count <= 0) {
+    return;
+  }
 
-Qry execute_qry_commands(FileData qryFileData, FileData geoFileData,
-                         Ground ground, const char *output_path) {
+  ThreadPool pool = thread_pool_create(QRY_CALC_THREADS);
+  if (pool == NULL) {
+    printf("Error: Failed to allocate memory for Qry\n");
+    exit(1);
+  }
+  int threads = thread_pool_size(pool);
+  int workers = threads < count ? threads : count;
+  QryMatches_t matches = {.programs = programs,
+                          .qryFileDatas = qryFileDatas,
+                          .count = count,
+                          .next = 0,
+                          .geoFileData = geoFileData,
+                          .ground = ground,
+                          .base = base,
+                          .outputPath = output_path,
+                          // Threads left when there are fewer runs than
+                          // threads go to the pools of the runs
+                          .runThreads = threads / workers};
+  pthread_mutex_init(&matches.lock, NULL);
+  thread_pool_parallel_for(pool, workers, run_qry_matches_task, &matches);
+  pthread_mutex_destroy(&matches.lock);
+  thread_pool_destroy(pool);
+}
 
+// Creates the state of a run of program that has not run any instruction,
+// with a worker pool of the given size
+static Qry_t *create_qry(QryProgram program, int threads) {
   Qry_t *qry = malloc(sizeof(Qry_t));
   if (qry == NULL) {
     printf("Error: Failed to allocate memory for Qry\n");
     exit(1);
   }
-  qry->arena = stack_create();
-  qry->stackToFree = stack_create();
+  qry->arena = (Arena_t){.records = NULL, .count = 0, .capacity = 0};
+  qry->incrementalCalc = QRY_INCREMENTAL_CALC_ENABLED;
+  qry->resolvedShapes = queue_create();
+  qry->crushedArea = 0.0;
+  qry->workerPool = thread_pool_create(threads);
+  qry->exactOverlap = QRY_EXACT_OVERLAP_ENABLED;
+  qry->broadphaseRejects = 0;
+  qry->narrowphaseRejects = 0;
+  qry->groundIndex = (GroundIndex_t){.numbered = false,
+                                     .shapes = NULL,
+                                     .count = 0,
+                                     .capacity = 0,
+                                     .boxes = NULL,
+                                     .boxesIndexed = 0,
+                                     .anchors = NULL,
+                                     .anchorsIndexed = 0};
+  if (qry->resolvedShapes == NULL || qry->workerPool == NULL) {
+    printf("Error: Failed to allocate memory for Qry\n");
+    exit(1);
+  }
+  int shooterCount = qry_program_fast_shooter_count(program);
+  int loaderCount = qry_program_fast_loader_count(program);
+  qry->program = program;
+  qry->shooters = malloc((size_t)(shooterCount > 0 ? shooterCount : 1) *
+                         sizeof(Shooter_t));
+  qry->shooterCount = shooterCount;
+  qry->loaders =
+      malloc((size_t)(loaderCount > 0 ? loaderCount : 1) * sizeof(Loader_t));
+  qry->loaderCount = loaderCount;
+  if (qry->shooters == NULL || qry->loaders == NULL) {
+    printf("Error: Failed to allocate memory for Shooters\n");
+    exit(1);
+  }
+  for (int slot = 0; slot < shooterCount; slot++) {
+    qry->shooters[slot] =
+        (Shooter_t){.id = qry_program_fast_shooter_id(program, slot),
+                    .registered = false,
+                    .x = 0.0,
+                    .y = 0.0,
+                    .shootingPosition = NULL,
+                    .rightLoader = NULL,
+                    .leftLoader = NULL,
+                    .node = -1};
+  }
+  for (int slot = 0; slot < loaderCount; slot++) {
+    qry->loaders[slot] =
+        (Loader_t){.id = qry_program_fast_loader_id(program, slot),
+                   .shapes = NULL,
+                   .shared = false,
+                   .node = -1};
+  }
+  return qry;
+}
+
+// Creates a branch of base that runs program from the state base ended
+// with. Shapes are shared and loader stacks too, until the branch changes
+// them; the arena and the shapes waiting for calc are copied, since the
+// first launch or calc of the branch would copy them anyway. Returns NULL
+// if program does not keep the slots of the program of base.
+static Qry_t *fork_qry(const Qry_t *base, QryProgram program, int threads) {
+  if (qry_program_fast_shooter_count(program) < base->shooterCount ||
+      qry_program_fast_loader_count(program) < base->loaderCount) {
+    return NULL;
+  }
+  for (int slot = 0; slot < base->shooterCount; slot++) {
+    if (qry_program_fast_shooter_id(program, slot) !=
+        base->shooters[slot].id) {
+      return NULL;
+    }
+  }
+  for (int slot = 0; slot < base->loaderCount; slot++) {
+    if (qry_program_fast_loader_id(program, slot) != base->loaders[slot].id) {
+      return NULL;
+    }
+  }
+
+  Qry_t *qry = create_qry(program, threads);
+  qry->incrementalCalc = base->incrementalCalc;
+  qry->exactOverlap = base->exactOverlap;
+  qry->crushedArea = base->crushedArea;
+  qry->broadphaseRejects = base->broadphaseRejects;
+  qry->narrowphaseRejects = base->narrowphaseRejects;
+  for (int slot = 0; slot < base->loaderCount; slot++) {
+    qry->loaders[slot].shapes = base->loaders[slot].shapes;
+    qry->loaders[slot].shared = base->loaders[slot].shapes != NULL;
+  }
+  for (int slot = 0; slot < base->shooterCount; slot++) {
+    const Shooter_t *from = &base->shooters[slot];
+    Shooter_t *shooter = &qry->shooters[slot];
+    shooter->registered = from->registered;
+    shooter->x = from->x;
+    shooter->y = from->y;
+    shooter->shootingPosition = from->shootingPosition;
+    // Attached loaders are found by slot in the loaders of the branch
+    if (from->rightLoader != NULL) {
+      shooter->rightLoader = &qry->loaders[from->rightLoader - base->loaders];
+    }
+    if (from->leftLoader != NULL) {
+      shooter->leftLoader = &qry->loaders[from->leftLoader - base->loaders];
+    }
+  }
 
-  // Note: qry should NOT be added to stackToFree as it causes premature freeing
+  if (base->arena.count > 0) {
+    ShapePositionOnArena_t *records =
+        arena_append(&qry->arena, base->arena.count);
+    memcpy(records, base->arena.records,
+           (size_t)base->arena.count * sizeof(ShapePositionOnArena_t));
+  }
+  queue_for_each(base->resolvedShapes, copy_resolved_shape,
+                 qry->resolvedShapes);
+  return qry;
+}
 
-  Shooter_t *shooters = NULL;
-  int shootersCount = 0;
-  Loader_t *loaders = NULL;
-  int loadersCount = 0;
+// Runs the program of qry against ground, resuming from and saving
+// snapshots as checkpointing asks, if not NULL
+static Qry_t *run_qry_program(Qry_t *qry, FileData qryFileData,
+                              FileData geoFileData, Ground ground,
+                              const char *output_path,
+                              const QryCheckpointing_t *checkpointing) {
+  QryProgram program = qry->program;
+
+  // A resumed run starts where its snapshot was saved, with the report as
+  // it was then
+  int start = 0;
+  long txtSize = 0;
+  if (checkpointing != NULL && checkpointing->resumePath != NULL) {
+    start = load_qry_snapshot(qry, ground, checkpointing->resumePath,
+                              &txtSize);
+    if (start < 0) {
+      printf("Error: Invalid snapshot %s\n", checkpointing->resumePath);
+      exit(1);
+    }
+  }
 
   // Abrir arquivo .txt com o mesmo nome-base do SVG de saída, mas extensão .txt
   size_t geo_len = strlen(get_file_name(geoFileData));
@@ -184,8 +685,8 @@ Qry execute_qry_commands(FileData qryFileData, FileData geoFileData,
   }
   strcpy(geo_base, get_file_name(geoFileData));
   strcpy(qry_base, get_file_name(qryFileData));
-  strtok(geo_base, ".");
-  strtok(qry_base, ".");
+  strip_extension(geo_base);
+  strip_extension(qry_base);
   size_t path_len = strlen(output_path);
   // geoBase-qryBase.txt
   size_t processed_name_len = strlen(geo_base) + 1 + strlen(qry_base);
@@ -206,196 +707,410 @@ Qry execute_qry_commands(FileData qryFileData, FileData geoFileData,
     free(qry_base);
     return NULL;
   }
-  FILE *txtFile = fopen(output_txt_path, "w");
+  if (txtSize > 0 && !restore_report(output_txt_path, txtSize)) {
+    printf("Error: Report %s does not match the snapshot\n", output_txt_path);
+    exit(1);
+  }
+  // The report is gathered in a buffer and written in big blocks
+  FILE *txtFile = fopen(output_txt_path, txtSize > 0 ? "a" : "w");
+  TextWriter report = text_writer_create(txtFile);
+  if (report == NULL) {
+    printf("Error: Failed to open %s\n", output_txt_path);
+    exit(1);
+  }
   free(geo_base);
   free(qry_base);
   free(output_txt_path);
 
-  // Get total number of commands (lines) before processing
-  int totalCommands = queue_size(get_file_lines_queue(qryFileData));
-
-  while (!queue_is_empty(get_file_lines_queue(qryFileData))) {
-    char *line = (char *)queue_dequeue(get_file_lines_queue(qryFileData));
-    char *command = strtok(line, " \t\r\n");
-
-    if (command == NULL || *command == '\0') {
-      continue;
+  const QryInstruction *code = qry_program_fast_code(program);
+  int count = qry_program_fast_count(program);
+  // Every calc rewrites the same .svg, so only the last one renders it; the
+  // others just update the state and the report
+  int lastCalc = count - 1;
+  while (lastCalc >= 0 && code[lastCalc].op != QRY_OP_CALC) {
+    lastCalc--;
+  }
+  int nextCheckpoint =
+      checkpointing != NULL ? start + checkpointing->interval : count;
+  for (int pc = start; pc < count; pc++) {
+    const QryInstruction *in = &code[pc];
+    switch (in->op) {
+    case QRY_OP_SHFT:
+    case QRY_OP_DSP:
+    case QRY_OP_RJD: {
+      // The whole run of shooter commands starting here executes at once
+      int end = pc + 1;
+      while (end < count && (code[end].op == QRY_OP_SHFT ||
+                             code[end].op == QRY_OP_DSP ||
+                             code[end].op == QRY_OP_RJD)) {
+        end++;
+      }
+      run_shooter_commands(qry, pc, end, ground, report);
+      pc = end - 1;
+      break;
+    }
+    case QRY_OP_PD:
+      execute_pd_command(qry, in);
+      break;
+    case QRY_OP_LC:
+      execute_lc_command(qry, in, ground, report);
+      break;
+    case QRY_OP_ATCH:
+      execute_atch_command(qry, in);
+      break;
+    case QRY_OP_SEL:
+      execute_sel_command(qry, in, ground, report);
+      break;
+    case QRY_OP_PROX:
+      execute_prox_command(qry, in, ground, report);
+      break;
+    case QRY_OP_SOB:
+      execute_sob_command(qry, ground, report);
+      break;
+    case QRY_OP_CALC:
+      execute_calc_command(qry, ground, report,
+                           qry_program_fast_line_count(program), qryFileData,
+                           geoFileData, output_path, pc == lastCalc);
+      break;
+    case QRY_OP_ERROR:
+      printf("%s\n", qry_program_fast_text(program, in->text));
+      break;
     }
 
-    if (strcmp(command, "pd") == 0) {
-      execute_pd_command(&shooters, &shootersCount, qry->stackToFree);
-    } else if (strcmp(command, "lc") == 0) {
-      execute_lc_command(&loaders, &loadersCount, ground, qry->stackToFree,
-                         txtFile);
-    } else if (strcmp(command, "atch") == 0) {
-      execute_atch_command(&loaders, &loadersCount, &shooters, &shootersCount,
-                           qry->stackToFree);
-    } else if (strcmp(command, "shft") == 0) {
-      execute_shft_command(&shooters, &shootersCount, loaders, &loadersCount,
-                           txtFile);
-    } else if (strcmp(command, "dsp") == 0) {
-      execute_dsp_command(&shooters, &shootersCount, qry->arena,
-                          qry->stackToFree, txtFile);
-    } else if (strcmp(command, "rjd") == 0) {
-      execute_rjd_command(&shooters, &shootersCount, qry->stackToFree,
-                          qry->arena, loaders, &loadersCount, txtFile);
-    } else if (strcmp(command, "calc") == 0) {
-      execute_calc_command(qry->arena, ground, txtFile, totalCommands,
-                           qryFileData, geoFileData, output_path);
-    } else
-      printf("Unknown command: %s\n", command);
-  }
-
-  // SVG is now generated inside execute_calc_command before arena is emptied
+    // Snapshots fall between instructions, never inside a shooter run
+    if (pc + 1 >= nextCheckpoint && pc + 1 < count) {
+      if (checkpointing->checkpointPath != NULL) {
+        text_writer_flush(report);
+        if (!save_qry_snapshot(qry, ground, checkpointing->checkpointPath,
+                               pc + 1, ftell(txtFile))) {
+          printf("Error: Failed to write snapshot %s\n",
+                 checkpointing->checkpointPath);
+        }
+      }
+      nextCheckpoint = pc + 1 + checkpointing->interval;
+    }
+  }
 
+  text_writer_destroy(report);
   fclose(txtFile);
-  return (Qry)qry;
+  return qry;
 }
 
-/*
-==========================
-Private functions
-==========================
-*/
-
-static void execute_pd_command(Shooter_t **shooters, int *shootersCount,
-                               Stack stackToFree) {
-  char *identifier = strtok(NULL, " ");
-  char *posX = strtok(NULL, " ");
-  char *posY = strtok(NULL, " ");
+// Takes pending runs one at a time until none is left, each against its own
+// view of the ground and, for branches, its own fork of the base run; runs
+// on the worker thread pool
+static void run_qry_matches_task(void *ctx, int begin, int end) {
+  QryMatches_t *matches = (QryMatches_t *)ctx;
+  (void)begin;
+  (void)end;
+  for (;;) {
+    pthread_mutex_lock(&matches->lock);
+    int i = matches->next++;
+    pthread_mutex_unlock(&matches->lock);
+    if (i >= matches->count) {
+      return;
+    }
 
-  *shootersCount += 1;
+    Qry_t *qry =
+        matches->base != NULL
+            ? fork_qry(matches->base, matches->programs[i], matches->runThreads)
+            : create_qry(matches->programs[i], matches->runThreads);
+    if (qry == NULL) {
+      printf("Error: %s does not continue the forked run\n",
+             get_file_name(matches->qryFileDatas[i]));
+      continue;
+    }
+    Ground view = fork_ground(matches->ground);
+    qry = run_qry_program(qry, matches->qryFileDatas[i], matches->geoFileData,
+                          view, matches->outputPath, NULL);
+    if (qry != NULL) {
+      destroy_qry_waste(qry);
+    }
+    destroy_geo_waste(view);
+  }
+}
 
-  *shooters = realloc(*shooters, *shootersCount * sizeof(Shooter_t));
-  if (*shooters == NULL) {
-    printf("Error: Failed to allocate memory for Shooters\n");
+// Adds a shape waiting for calc in the run being forked to the branch
+static void copy_resolved_shape(void *shape, void *ctx) {
+  if (!queue_enqueue((Queue)ctx, shape)) {
+    printf("Error: Failed to allocate memory for Qry\n");
     exit(1);
   }
+}
 
-  // Add shooters array to stackToFree for cleanup (update existing or create
-  // new)
-  bool shooters_already_tracked = false;
-  int stack_size_count = stack_size(stackToFree);
-  for (int i = 0; i < stack_size_count; i++) {
-    FreeItem *existing_item = (FreeItem *)stack_peek_at(stackToFree, i);
-    if (existing_item != NULL && existing_item->type == FREE_SHOOTERS_ARRAY) {
-      // Update the existing item with the new pointer
-      existing_item->ptr = *shooters;
-      shooters_already_tracked = true;
-      break;
-    }
+// Saves the state of a run before instruction next to a temporary file,
+// renamed over path once complete, so a crash never leaves half a snapshot
+static bool save_qry_snapshot(const Qry_t *qry, Ground ground,
+                              const char *path, int next, long txtSize) {
+  size_t pathLength = strlen(path);
+  char *tmpPath = malloc(pathLength + 5);
+  if (tmpPath == NULL) {
+    return false;
+  }
+  snprintf(tmpPath, pathLength + 5, "%s.tmp", path);
+  FILE *file = fopen(tmpPath, "wb");
+  if (file == NULL) {
+    free(tmpPath);
+    return false;
   }
 
-  if (!shooters_already_tracked) {
-    FreeItem *shooters_item = malloc(sizeof(FreeItem));
-    if (shooters_item != NULL) {
-      shooters_item->ptr = *shooters;
-      shooters_item->type = FREE_SHOOTERS_ARRAY;
-      stack_push(stackToFree, shooters_item);
+  int shooterCount = qry_program_fast_shooter_count(qry->program);
+  QrySnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "QRYK", 4);
+  header.version = QRY_SNAPSHOT_VERSION;
+  header.sourceHash = qry_program_fast_source_hash(qry->program);
+  header.incrementalCalc = qry->incrementalCalc;
+  header.next = next;
+  header.txtSize = txtSize;
+  header.shooterCount = shooterCount;
+  header.loaderCount = qry->loaderCount;
+  header.crushedArea = qry->crushedArea;
+  header.broadphaseRejects = qry->broadphaseRejects;
+  header.narrowphaseRejects = qry->narrowphaseRejects;
+  header.groundCount = count_ground_shapes(ground);
+  header.arenaCount = qry->arena.count;
+  header.resolvedCount = queue_size(qry->resolvedShapes);
+
+  SnapshotWriter_t writer = {.file = file,
+                             .ok = fwrite(&header, sizeof(header), 1, file) ==
+                                   1};
+  for_each_ground_shape(ground, write_snapshot_shape, &writer);
+  for (int slot = 0; slot < qry->loaderCount && writer.ok; slot++) {
+    Stack shapes = qry->loaders[slot].shapes;
+    int size = shapes != NULL ? stack_size(shapes) : -1;
+    writer.ok = fwrite(&size, sizeof(int), 1, file) == 1;
+    stack_for_each(shapes, write_snapshot_shape, &writer);
+  }
+  for (int slot = 0; slot < shooterCount && writer.ok; slot++) {
+    const Shooter_t *shooter = &qry->shooters[slot];
+    ShooterSnapshot_t saved;
+    memset(&saved, 0, sizeof(saved));
+    saved.registered = shooter->registered;
+    saved.x = shooter->x;
+    saved.y = shooter->y;
+    saved.rightLoader = shooter->rightLoader != NULL
+                            ? (int)(shooter->rightLoader - qry->loaders)
+                            : -1;
+    saved.leftLoader = shooter->leftLoader != NULL
+                           ? (int)(shooter->leftLoader - qry->loaders)
+                           : -1;
+    saved.loaded = shooter->shootingPosition != NULL;
+    writer.ok = fwrite(&saved, sizeof(saved), 1, file) == 1;
+    if (saved.loaded) {
+      write_snapshot_shape(shooter->shootingPosition, &writer);
     }
   }
-  (*shooters)[*shootersCount - 1] = (Shooter_t){.id = atoi(identifier),
-                                                .x = atof(posX),
-                                                .y = atof(posY),
-                                                .shootingPosition = NULL,
-                                                .rightLoader = NULL,
-                                                .leftLoader = NULL,
-                                                .rightLoaderId = -1,
-                                                .leftLoaderId = -1};
+  for (int i = 0; i < qry->arena.count && writer.ok; i++) {
+    const ShapePositionOnArena_t *record = &qry->arena.records[i];
+    ArenaRecordSnapshot_t saved;
+    memset(&saved, 0, sizeof(saved));
+    saved.x = record->x;
+    saved.y = record->y;
+    saved.isAnnotated = record->isAnnotated;
+    saved.shooterX = record->shooterX;
+    saved.shooterY = record->shooterY;
+    writer.ok = fwrite(&saved, sizeof(saved), 1, file) == 1;
+    write_snapshot_shape(record->shape, &writer);
+  }
+  queue_for_each(qry->resolvedShapes, write_snapshot_shape, &writer);
+
+  bool written = fclose(file) == 0 && writer.ok;
+  if (written) {
+    written = rename(tmpPath, path) == 0;
+  }
+  if (!written) {
+    remove(tmpPath);
+  }
+  free(tmpPath);
+  return written;
 }
 
-static void execute_lc_command(Loader_t **loaders, int *loadersCount,
-                               Ground ground, Stack stackToFree,
-                               FILE *txtFile) {
-  char *identifier = strtok(NULL, " ");
-  char *firstXShapes = strtok(NULL, " ");
-
-  int loaderId = atoi(identifier);
-  int newShapesCount = atoi(firstXShapes);
+static void write_snapshot_shape(void *shape, void *ctx) {
+  SnapshotWriter_t *writer = (SnapshotWriter_t *)ctx;
+  if (writer->ok) {
+    writer->ok = shape_write(shape, writer->file);
+  }
+}
 
-  fprintf(txtFile, "[lc]\n");
-  fprintf(txtFile, "\tLoader ID: %d\n", loaderId);
-  fprintf(txtFile, "\tNew shapes count: %d\n", newShapesCount);
+// Restores the state saved by save_qry_snapshot into a fresh run of the
+// same program, adding the saved ground to the empty ground. Returns the
+// instruction to resume from, or -1 if the snapshot is missing or does not
+// belong to this program and build.
+static int load_qry_snapshot(Qry_t *qry, Ground ground, const char *path,
+                             long *txtSize) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+
+  QrySnapshotHeader header;
+  int shooterCount = qry_program_fast_shooter_count(qry->program);
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, "QRYK", 4) != 0 ||
+      header.version != QRY_SNAPSHOT_VERSION ||
+      header.sourceHash != qry_program_fast_source_hash(qry->program) ||
+      header.incrementalCalc != qry->incrementalCalc ||
+      header.shooterCount != shooterCount ||
+      header.loaderCount != qry->loaderCount || header.next < 0 ||
+      header.next > qry_program_fast_count(qry->program) ||
+      header.txtSize < 0 || header.groundCount < 0 || header.arenaCount < 0 ||
+      header.resolvedCount < 0) {
+    fclose(file);
+    return -1;
+  }
+
+  // Every shape read belongs to the ground, wherever the run keeps it
+  int largest = header.groundCount > header.resolvedCount
+                    ? header.groundCount
+                    : header.resolvedCount;
+  Shape *shapes = malloc((size_t)(largest > 0 ? largest : 1) * sizeof(Shape));
+  bool ok = shapes != NULL &&
+            read_snapshot_shapes(file, header.groundCount, ground, shapes);
+  for (int i = 0; ok && i < header.groundCount; i++) {
+    ok = add_ground_shape(ground, shapes[i]);
+  }
+
+  for (int slot = 0; ok && slot < qry->loaderCount; slot++) {
+    int size;
+    ok = fread(&size, sizeof(int), 1, file) == 1 && size >= -1;
+    if (!ok || size < 0) {
+      continue;
+    }
+    Shape *stacked = malloc((size_t)(size > 0 ? size : 1) * sizeof(Shape));
+    create_loader_stack(&qry->loaders[slot]);
+    ok = stacked != NULL && read_snapshot_shapes(file, size, ground, stacked);
+    // Saved from the top, so pushed back from the bottom
+    for (int i = size - 1; ok && i >= 0; i--) {
+      ok = stack_push(qry->loaders[slot].shapes, stacked[i]);
+    }
+    free(stacked);
+  }
 
-  // Check if loader already exists
-  int existingLoaderIndex = -1;
-  for (int i = 0; i < *loadersCount; i++) {
-    if ((*loaders)[i].id == loaderId) {
-      existingLoaderIndex = i;
+  for (int slot = 0; ok && slot < shooterCount; slot++) {
+    Shooter_t *shooter = &qry->shooters[slot];
+    ShooterSnapshot_t saved;
+    ok = fread(&saved, sizeof(saved), 1, file) == 1 &&
+         saved.rightLoader >= -1 && saved.rightLoader < qry->loaderCount &&
+         saved.leftLoader >= -1 && saved.leftLoader < qry->loaderCount;
+    if (!ok) {
       break;
     }
+    shooter->registered = saved.registered;
+    shooter->x = saved.x;
+    shooter->y = saved.y;
+    shooter->rightLoader =
+        saved.rightLoader >= 0 ? &qry->loaders[saved.rightLoader] : NULL;
+    shooter->leftLoader =
+        saved.leftLoader >= 0 ? &qry->loaders[saved.leftLoader] : NULL;
+    if (saved.loaded) {
+      ok = read_snapshot_shapes(file, 1, ground, &shooter->shootingPosition);
+    }
   }
 
-  if (existingLoaderIndex == -1) {
-    // Create new loader
-    *loadersCount += 1;
-    *loaders = realloc(*loaders, *loadersCount * sizeof(Loader_t));
-    if (*loaders == NULL) {
-      printf("Error: Failed to allocate memory for Loaders\n");
-      exit(1);
+  ShapePositionOnArena_t *records =
+      ok ? arena_append(&qry->arena, header.arenaCount) : NULL;
+  for (int i = 0; ok && i < header.arenaCount; i++) {
+    ArenaRecordSnapshot_t saved;
+    ok = fread(&saved, sizeof(saved), 1, file) == 1 &&
+         read_snapshot_shapes(file, 1, ground, &records[i].shape);
+    if (ok) {
+      records[i].x = saved.x;
+      records[i].y = saved.y;
+      records[i].isAnnotated = saved.isAnnotated;
+      records[i].shooterX = saved.shooterX;
+      records[i].shooterY = saved.shooterY;
     }
+  }
 
-    // Add loaders array to stackToFree for cleanup (update existing or create
-    // new)
-    bool loaders_already_tracked = false;
-    int stack_size_count = stack_size(stackToFree);
-    for (int i = 0; i < stack_size_count; i++) {
-      FreeItem *existing_item = (FreeItem *)stack_peek_at(stackToFree, i);
-      if (existing_item != NULL && existing_item->type == FREE_LOADERS_ARRAY) {
-        // Update the existing item with the new pointer
-        existing_item->ptr = *loaders;
-        loaders_already_tracked = true;
-        break;
-      }
-    }
+  ok = ok && read_snapshot_shapes(file, header.resolvedCount, ground, shapes);
+  for (int i = 0; ok && i < header.resolvedCount; i++) {
+    ok = queue_enqueue(qry->resolvedShapes, shapes[i]);
+  }
+  free(shapes);
+  fclose(file);
+  if (!ok) {
+    return -1;
+  }
 
-    if (!loaders_already_tracked) {
-      FreeItem *loaders_item = malloc(sizeof(FreeItem));
-      if (loaders_item != NULL) {
-        loaders_item->ptr = *loaders;
-        loaders_item->type = FREE_LOADERS_ARRAY;
-        stack_push(stackToFree, loaders_item);
-      }
+  qry->crushedArea = header.crushedArea;
+  qry->broadphaseRejects = header.broadphaseRejects;
+  qry->narrowphaseRejects = header.narrowphaseRejects;
+  *txtSize = header.txtSize;
+  return header.next;
+}
+
+// Reads count shapes into shapes, each one owned by the ground
+static bool read_snapshot_shapes(FILE *file, int count, Ground ground,
+                                 Shape *shapes) {
+  for (int i = 0; i < count; i++) {
+    shapes[i] = shape_read(file);
+    if (shapes[i] == NULL) {
+      return false;
     }
-    (*loaders)[*loadersCount - 1] = (Loader_t){.id = loaderId, .shapes = NULL};
-    existingLoaderIndex = *loadersCount - 1;
+    track_ground_shape(ground, shapes[i]);
   }
+  return true;
+}
 
-  // Create stack if it doesn't exist
-  if ((*loaders)[existingLoaderIndex].shapes == NULL) {
-    (*loaders)[existingLoaderIndex].shapes = malloc(sizeof(Stack));
-    if ((*loaders)[existingLoaderIndex].shapes == NULL) {
-      printf("Error: Failed to allocate memory for Loader stack\n");
-      exit(1);
+// Cuts the report at path back to the size it had when the snapshot was
+// saved, dropping whatever the interrupted run wrote after it
+static bool restore_report(const char *path, long size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  char *kept = malloc((size_t)size);
+  bool ok = kept != NULL && fread(kept, 1, (size_t)size, file) == (size_t)size;
+  fclose(file);
+  if (ok) {
+    file = fopen(path, "wb");
+    ok = file != NULL && fwrite(kept, 1, (size_t)size, file) == (size_t)size;
+    if (file != NULL && fclose(file) != 0) {
+      ok = false;
     }
+  }
+  free(kept);
+  return ok;
+}
 
-    // Add shapes stack to stackToFree for cleanup
-    FreeItem *stack_item = malloc(sizeof(FreeItem));
-    if (stack_item != NULL) {
-      stack_item->ptr = (*loaders)[existingLoaderIndex].shapes;
-      stack_item->type = FREE_STACK_HANDLE;
-      stack_push(stackToFree, stack_item);
-    }
-    *(*loaders)[existingLoaderIndex].shapes = stack_create();
-    if (*(*loaders)[existingLoaderIndex].shapes == NULL) {
-      printf("Error: Failed to create stack for Loader\n");
-      exit(1);
-    }
+static void execute_pd_command(Qry_t *qry, const QryInstruction *in) {
+  Shooter_t *shooter = &qry->shooters[in->shooter];
+  // A repeated id keeps the shooter registered first
+  if (shooter->registered) {
+    return;
   }
 
+  shooter->registered = true;
+  shooter->x = in->operand[0];
+  shooter->y = in->operand[1];
+}
+
+static void execute_lc_command(Qry_t *qry, const QryInstruction *in,
+                               Ground ground, TextWriter report) {
+  Loader_t *loader = &qry->loaders[in->loader];
+  int newShapesCount = in->count;
+
+  text_writer_put_text(report, "[lc]\n");
+  write_int_line(report, "\tLoader ID: ", loader->id);
+  write_int_line(report, "\tNew shapes count: ", newShapesCount);
+
+  create_loader_stack(loader);
+  Stack loaderShapes = writable_loader_shapes(loader);
+
   // Add new shapes to the stack in reverse order
   // (so first shape from ground is on top and fires first)
   Stack tempStack = stack_create();
   for (int i = 0; i < newShapesCount; i++) {
-    Shape_t *shape = queue_dequeue(get_ground_queue(ground));
+    Shape shape = take_ground_shape(ground);
     if (shape != NULL) {
       stack_push(tempStack, shape);
     }
   }
   // Now pop from temp and push to loader (reverses the order)
   while (!stack_is_empty(tempStack)) {
-    Shape_t *shape = stack_pop(tempStack);
-    if (!stack_push(*(*loaders)[existingLoaderIndex].shapes, shape)) {
+    Shape shape = stack_pop(tempStack);
+    if (!stack_push(loaderShapes, shape)) {
       printf("Error: Failed to push shape to loader stack\n");
       exit(1);
     }
@@ -403,200 +1118,81 @@ static void execute_lc_command(Loader_t **loaders, int *loadersCount,
   stack_destroy(tempStack);
 }
 
-// Helper function to find or create a loader by ID
-static Loader_t *find_or_create_loader(Loader_t **loaders, int *loadersCount,
-                                       int loaderId, Stack stackToFree) {
-  // First, try to find existing loader
-  for (int j = 0; j < *loadersCount; j++) {
-    if ((*loaders)[j].id == loaderId) {
-      return &(*loaders)[j];
-    }
-  }
-
-  // Not found, create new loader
-  *loadersCount += 1;
-  *loaders = realloc(*loaders, *loadersCount * sizeof(Loader_t));
-  if (*loaders == NULL) {
-    printf("Error: Failed to allocate memory for Loaders\n");
-    exit(1);
-  }
-
-  // Track the (re)allocated loaders array for cleanup
-  bool loaders_already_tracked = false;
-  int stack_size_count = stack_size(stackToFree);
-  for (int i = 0; i < stack_size_count; i++) {
-    FreeItem *existing_item = (FreeItem *)stack_peek_at(stackToFree, i);
-    if (existing_item != NULL && existing_item->type == FREE_LOADERS_ARRAY) {
-      existing_item->ptr = *loaders;
-      loaders_already_tracked = true;
-      break;
-    }
-  }
-
-  if (!loaders_already_tracked) {
-    FreeItem *loaders_item = malloc(sizeof(FreeItem));
-    if (loaders_item != NULL) {
-      loaders_item->ptr = *loaders;
-      loaders_item->type = FREE_LOADERS_ARRAY;
-      stack_push(stackToFree, loaders_item);
-    }
-  }
-
-  // Initialize new loader
-  (*loaders)[*loadersCount - 1] = (Loader_t){.id = loaderId, .shapes = NULL};
-
-  // Create empty shapes stack
-  (*loaders)[*loadersCount - 1].shapes = malloc(sizeof(Stack));
-  if ((*loaders)[*loadersCount - 1].shapes == NULL) {
-    printf("Error: Failed to allocate memory for Loader stack\n");
-    exit(1);
-  }
-
-  FreeItem *stack_item = malloc(sizeof(FreeItem));
-  if (stack_item != NULL) {
-    stack_item->ptr = (*loaders)[*loadersCount - 1].shapes;
-    stack_item->type = FREE_STACK_HANDLE;
-    stack_push(stackToFree, stack_item);
-  }
-
-  *(*loaders)[*loadersCount - 1].shapes = stack_create();
-  if (*(*loaders)[*loadersCount - 1].shapes == NULL) {
-    printf("Error: Failed to create stack for Loader\n");
-    exit(1);
+static void execute_atch_command(Qry_t *qry, const QryInstruction *in) {
+  Shooter_t *shooter = find_shooter(qry, in->shooter);
+  if (shooter == NULL) {
+    printf("Error: Shooter with ID %d not found\n",
+           qry_program_fast_shooter_id(qry->program, in->shooter));
+    return;
   }
 
-  return &(*loaders)[*loadersCount - 1];
+  Loader_t *leftLoader = &qry->loaders[in->loader];
+  Loader_t *rightLoader = &qry->loaders[in->rightLoader];
+  create_loader_stack(leftLoader);
+  create_loader_stack(rightLoader);
+  shooter->leftLoader = leftLoader;
+  shooter->rightLoader = rightLoader;
 }
 
-static void execute_atch_command(Loader_t **loaders, int *loadersCount,
-                                 Shooter_t **shooters, int *shootersCount,
-                                 Stack stackToFree) {
-  char *shooterId = strtok(NULL, " ");
-  char *leftLoaderId = strtok(NULL, " ");
-  char *rightLoaderId = strtok(NULL, " ");
-
-  int shooterIdInt = atoi(shooterId);
-  int leftLoaderIdInt = atoi(leftLoaderId);
-  int rightLoaderIdInt = atoi(rightLoaderId);
-
-  int shooterIndex =
-      find_shooter_index_by_id(shooters, *shootersCount, shooterIdInt);
-  if (shooterIndex != -1) {
-    Loader_t *leftLoaderPtr = find_or_create_loader(
-        loaders, loadersCount, leftLoaderIdInt, stackToFree);
-    Loader_t *rightLoaderPtr = find_or_create_loader(
-        loaders, loadersCount, rightLoaderIdInt, stackToFree);
-
-    (*shooters)[shooterIndex].leftLoader = leftLoaderPtr;
-    (*shooters)[shooterIndex].rightLoader = rightLoaderPtr;
-    (*shooters)[shooterIndex].leftLoaderId = leftLoaderIdInt;
-    (*shooters)[shooterIndex].rightLoaderId = rightLoaderIdInt;
-  } else {
-    printf("Error: Shooter with ID %d not found\n", shooterIdInt);
+static void perform_shift_operation(Shooter_t *shooter, QryButton button,
+                                    int times, Discarded_t *discarded) {
+  Loader_t *source = NULL;
+  Loader_t *target = NULL;
+  if (button == QRY_BUTTON_LEFT) {
+    // Left button: takes from RIGHT loader, displaced shape goes to LEFT
+    source = shooter->rightLoader;
+    target = shooter->leftLoader;
+  } else if (button == QRY_BUTTON_RIGHT) {
+    // Right button: takes from LEFT loader, displaced shape goes to RIGHT
+    source = shooter->leftLoader;
+    target = shooter->rightLoader;
+  }
+  if (source == NULL) {
+    return;
   }
-}
 
-static void perform_shift_operation(Shooter_t **shooters, int shootersCount,
-                                    int shooterId, const char *direction,
-                                    int times, Loader_t *loaders,
-                                    int loadersCount) {
-  int shooterIndex =
-      find_shooter_index_by_id(shooters, shootersCount, shooterId);
-  if (shooterIndex == -1) {
-    printf("Error: Shooter with ID %d not found\n", shooterId);
+  // Presses made while the source loader is empty are skipped silently, so
+  // only min(times, available) presses change anything
+  Stack sourceShapes = source->shapes;
+  int available = stack_size(sourceShapes);
+  int moves = times < available ? times : available;
+  if (moves <= 0) {
     return;
   }
+  sourceShapes = writable_loader_shapes(source);
 
-  Shooter_t *shooter = &(*shooters)[shooterIndex];
-
-  // Resolve current loader pointers from stored IDs (rebinding after reallocs)
-  Loader_t *resolvedLeft = NULL;
-  Loader_t *resolvedRight = NULL;
-  if (shooter->leftLoaderId != -1) {
-    for (int i = 0; i < loadersCount; i++) {
-      if (loaders[i].id == shooter->leftLoaderId) {
-        resolvedLeft = &loaders[i];
-        break;
-      }
-    }
-  }
-  if (shooter->rightLoaderId != -1) {
-    for (int i = 0; i < loadersCount; i++) {
-      if (loaders[i].id == shooter->rightLoaderId) {
-        resolvedRight = &loaders[i];
-        break;
-      }
+  if (target == source) {
+    // Both sides share one loader: every press after the first pushes the
+    // displaced shape back and takes it again
+    if (shooter->shootingPosition == NULL) {
+      shooter->shootingPosition = stack_pop(sourceShapes);
     }
+    return;
   }
-  shooter->leftLoader = resolvedLeft;
-  shooter->rightLoader = resolvedRight;
-
-  for (int i = 0; i < times; i++) {
-    if (strcmp(direction, "e") == 0) {
-      // Left button: takes from RIGHT loader, displaced shape goes to LEFT
-      if (shooter->rightLoader == NULL ||
-          stack_is_empty(*(shooter->rightLoader->shapes))) {
-        continue; // Skip silently if no shapes available
-      }
 
-      // If shooter has a shape, move it to left loader
-      if (shooter->shootingPosition != NULL && shooter->leftLoader != NULL) {
-        stack_push(*(shooter->leftLoader->shapes), shooter->shootingPosition);
-      }
-
-      shooter->shootingPosition = stack_pop(*(shooter->rightLoader->shapes));
+  // Each press moves the shape in the shooting position to the target
+  // loader and loads the next one, so the first moves - 1 shapes taken from
+  // the source pass through the shooting position in a single transfer
+  if (target != NULL) {
+    Stack targetShapes = writable_loader_shapes(target);
+    if (shooter->shootingPosition != NULL) {
+      stack_push(targetShapes, shooter->shootingPosition);
     }
-    if (strcmp(direction, "d") == 0) {
-      // Right button: takes from LEFT loader, displaced shape goes to RIGHT
-      if (shooter->leftLoader == NULL ||
-          stack_is_empty(*(shooter->leftLoader->shapes))) {
-        continue; // Skip silently if no shapes available
-      }
-
-      // If shooter has a shape, move it to right loader
-      if (shooter->shootingPosition != NULL && shooter->rightLoader != NULL) {
-        stack_push(*(shooter->rightLoader->shapes), shooter->shootingPosition);
-      }
-
-      shooter->shootingPosition = stack_pop(*(shooter->leftLoader->shapes));
+    stack_transfer(targetShapes, sourceShapes, moves - 1);
+  } else {
+    // No loader on the target side: displaced shapes are discarded
+    if (shooter->shootingPosition != NULL) {
+      discard_shape(discarded, shooter->shootingPosition);
+    }
+    for (int i = 0; i < moves - 1; i++) {
+      discard_shape(discarded, stack_pop(sourceShapes));
     }
   }
+  shooter->shootingPosition = stack_pop(sourceShapes);
 }
 
-static void execute_shft_command(Shooter_t **shooters, int *shootersCount,
-                                 Loader_t *loaders, int *loadersCount,
-                                 FILE *txtFile) {
-  char *shooterId = strtok(NULL, " ");
-  char *leftOrRightButton = strtok(NULL, " ");
-  char *timesPressed = strtok(NULL, " ");
-  fprintf(txtFile, "[shft]");
-
-  int shooterIdInt = atoi(shooterId);
-  int timesPressedInt = atoi(timesPressed);
-
-  fprintf(txtFile, "\tShooter ID: %d", shooterIdInt);
-  fprintf(txtFile, "\tButton: %s", leftOrRightButton);
-  fprintf(txtFile, "\tTimes pressed: %d", timesPressedInt);
-  fprintf(txtFile, "\n");
-
-  perform_shift_operation(shooters, *shootersCount, shooterIdInt,
-                          leftOrRightButton, timesPressedInt, loaders,
-                          *loadersCount);
-}
-
-static void perform_shoot_operation(Shooter_t **shooters, int shootersCount,
-                                    int shooterId, double dx, double dy,
-                                    const char *annotate, Stack arena,
-                                    Stack stackToFree) {
-  int shooterIndex =
-      find_shooter_index_by_id(shooters, shootersCount, shooterId);
-  if (shooterIndex == -1) {
-    printf("Error: Shooter with ID %d not found\n", shooterId);
-    return;
-  }
-
-  Shooter_t *shooter = &(*shooters)[shooterIndex];
-
+static void perform_shoot_operation(Shooter_t *shooter, double dx, double dy,
+                                    bool annotate, Arena_t *arena) {
   // Check if shooter has a shape to shoot
   if (shooter->shootingPosition == NULL) {
     return; // Skip silently if no shape to shoot
@@ -605,755 +1201,1159 @@ static void perform_shoot_operation(Shooter_t **shooters, int shootersCount,
   double shapeXOnArena = shooter->x + dx;
   double shapeYOnArena = shooter->y + dy;
 
-  Shape_t *shape = (Shape_t *)shooter->shootingPosition;
-  ShapeType shapeType = shape->type;
-
   // Add shape to arena
-  ShapePositionOnArena_t *shapePositionOnArena =
-      malloc(sizeof(ShapePositionOnArena_t));
-  if (shapePositionOnArena == NULL) {
-    printf("Error: Failed to allocate memory for ShapePositionOnArena\n");
-    exit(1);
-  }
-  shapePositionOnArena->shape = shape;
+  ShapePositionOnArena_t *shapePositionOnArena = arena_append(arena, 1);
+  shapePositionOnArena->shape = (Shape)shooter->shootingPosition;
   shapePositionOnArena->x = shapeXOnArena;
   shapePositionOnArena->y = shapeYOnArena;
-  shapePositionOnArena->isAnnotated = strcmp(annotate, "v") == 0;
+  shapePositionOnArena->isAnnotated = annotate;
   shapePositionOnArena->shooterX = shooter->x;
   shapePositionOnArena->shooterY = shooter->y;
 
   // Clear shooter shooting position
   shooter->shootingPosition = NULL;
+}
 
-  stack_push(arena, (void *)shapePositionOnArena);
-  FreeItem *shape_item = malloc(sizeof(FreeItem));
-  if (shape_item != NULL) {
-    shape_item->ptr = shapePositionOnArena;
-    shape_item->type = FREE_SHAPE_POSITION;
-    stack_push(stackToFree, shape_item);
-  }
-}
-
-static void execute_dsp_command(Shooter_t **shooters, int *shootersCount,
-                                Stack arena, Stack stackToFree, FILE *txtFile) {
-  char *shooterId = strtok(NULL, " ");
-  char *dx = strtok(NULL, " ");
-  char *dy = strtok(NULL, " ");
-  char *annotateDimensions = strtok(NULL, " "); // this can be "v" or "i"
-
-  int shooterIdInt = atoi(shooterId);
-  double dxDouble = atof(dx);
-  double dyDouble = atof(dy);
-
-  fprintf(txtFile, "[dsp]\n");
-  fprintf(txtFile, "\tShooter ID: %d\n", shooterIdInt);
-  fprintf(txtFile, "\tDX: %f\n", dxDouble);
-  fprintf(txtFile, "\tDY: %f\n", dyDouble);
-  fprintf(txtFile, "\tAnnotate dimensions: %s\n", annotateDimensions);
-
-  perform_shoot_operation(shooters, *shootersCount, shooterIdInt, dxDouble,
-                          dyDouble, annotateDimensions, arena, stackToFree);
-}
-
-static void execute_rjd_command(Shooter_t **shooters, int *shootersCount,
-                                Stack stackToFree, Stack arena,
-                                Loader_t *loaders, int *loadersCount,
-                                FILE *txtFile) {
-  char *shooterId = strtok(NULL, " ");
-  char *leftOrRightButton = strtok(NULL, " ");
-  char *dx = strtok(NULL, " ");
-  char *dy = strtok(NULL, " ");
-  char *incrementX = strtok(NULL, " ");
-  char *incrementY = strtok(NULL, " ");
-
-  int shooterIdInt = atoi(shooterId);
-  double dxDouble = atof(dx);
-  double dyDouble = atof(dy);
-  double incrementXDouble = atof(incrementX);
-  double incrementYDouble = atof(incrementY);
-
-  int shooterIndex =
-      find_shooter_index_by_id(shooters, *shootersCount, shooterIdInt);
-  if (shooterIndex == -1) {
-    printf("Error: Shooter with ID %d not found\n", shooterIdInt);
-    return;
+// Runs the run of shooter commands code[first .. end - 1] of the program.
+// The txt report, the error messages, the arena order and, in incremental
+// mode, the pairs resolved are the same as running the commands one by one.
+static void run_shooter_commands(Qry_t *qry, int first, int end,
+                                 Ground ground, TextWriter report) {
+  const QryInstruction *code = qry_program_fast_code(qry->program) + first;
+  int count = end - first;
+  ShooterOutcome_t *outcomes = malloc((size_t)count * sizeof(ShooterOutcome_t));
+  if (outcomes == NULL) {
+    printf("Error: Failed to allocate memory for shooter commands\n");
+    exit(1);
   }
+  int groupCount = group_shooter_commands(qry, code, outcomes, count);
 
-  Shooter_t *shooter = &(*shooters)[shooterIndex];
-  Loader_t *loader = NULL;
-  // Rebind current pointers based on IDs in case loaders was reallocated
-  if (strcmp(leftOrRightButton, "e") == 0) {
-    // Left button uses RIGHT loader (inverted logic)
-    int targetId = (*shooters)[shooterIndex].rightLoaderId;
-    if (targetId != -1) {
-      for (int i = 0; i < *loadersCount; i++) {
-        if (loaders[i].id == targetId) {
-          (*shooters)[shooterIndex].rightLoader = &loaders[i];
-          break;
-        }
-      }
-    }
-  } else if (strcmp(leftOrRightButton, "d") == 0) {
-    // Right button uses LEFT loader (inverted logic)
-    int targetId = (*shooters)[shooterIndex].leftLoaderId;
-    if (targetId != -1) {
-      for (int i = 0; i < *loadersCount; i++) {
-        if (loaders[i].id == targetId) {
-          (*shooters)[shooterIndex].leftLoader = &loaders[i];
-          break;
-        }
-      }
-    }
+  // Commands are listed group by group, keeping command order in a group
+  int *groupStart = calloc((size_t)groupCount + 1, sizeof(int));
+  int *order = malloc((size_t)count * sizeof(int));
+  Arena_t *staged = calloc((size_t)groupCount, sizeof(Arena_t));
+  Discarded_t *discarded = calloc((size_t)groupCount, sizeof(Discarded_t));
+  if (groupStart == NULL || order == NULL || staged == NULL ||
+      discarded == NULL) {
+    printf("Error: Failed to allocate memory for shooter commands\n");
+    exit(1);
   }
-  // Select the same side that perform_shift_operation will consume from
-  if (strcmp(leftOrRightButton, "e") == 0) {
-    loader = shooter->rightLoader;
-  } else if (strcmp(leftOrRightButton, "d") == 0) {
-    loader = shooter->leftLoader;
-  } else {
-    printf("Error: Invalid button (should be 'e' or 'd')\n");
-    return;
+  for (int i = 0; i < count; i++) {
+    groupStart[outcomes[i].group + 1]++;
   }
-
-  if (loader == NULL || loader->shapes == NULL) {
-    printf("Error: Loader not found or shapes stack is NULL\n");
-    return;
+  for (int g = 0; g < groupCount; g++) {
+    groupStart[g + 1] += groupStart[g];
   }
+  for (int i = 0; i < count; i++) {
+    order[groupStart[outcomes[i].group]++] = i;
+  }
+  for (int g = groupCount; g > 0; g--) {
+    groupStart[g] = groupStart[g - 1];
+  }
+  groupStart[0] = 0;
 
-  int times = 0;
-
-  fprintf(txtFile, "[rjd]\n");
-  fprintf(txtFile, "\tShooter ID: %d\n", shooterIdInt);
-  fprintf(txtFile, "\tButton: %s\n", leftOrRightButton);
-  fprintf(txtFile, "\tDX: %f\n", dxDouble);
-  fprintf(txtFile, "\tDY: %f\n", dyDouble);
-  fprintf(txtFile, "\tIncrement X: %f\n", incrementXDouble);
-  fprintf(txtFile, "\tIncrement Y: %f\n", incrementYDouble);
-  fprintf(txtFile, "\n");
+  ShooterGroupsJob_t job = {.qry = qry,
+                            .code = code,
+                            .outcomes = outcomes,
+                            .order = order,
+                            .groupStart = groupStart,
+                            .staged = staged,
+                            .discarded = discarded};
+  if (groupCount > 1 && count >= SHOOTER_PARALLEL_MIN_COMMANDS) {
+    thread_pool_parallel_for(qry->workerPool, groupCount,
+                             run_shooter_groups_task, &job);
+  } else {
+    run_shooter_groups_task(&job, 0, groupCount);
+  }
+
+  for (int i = 0; i < count; i++) {
+    const ShooterOutcome_t *outcome = &outcomes[i];
+    report_shooter_command(qry, &code[i], outcome, report);
+    if (outcome->recordCount > 0) {
+      ShapePositionOnArena_t *launched =
+          arena_append(&qry->arena, outcome->recordCount);
+      memcpy(launched,
+             &staged[outcome->group].records[outcome->firstRecord],
+             (size_t)outcome->recordCount * sizeof(ShapePositionOnArena_t));
+    }
+    // Discarded shapes are referred to by nothing anymore; the ground is
+    // only touched here, on the calling thread
+    Shape *dropped = discarded[outcome->group].shapes + outcome->firstDiscarded;
+    for (int d = 0; d < outcome->discardedCount; d++) {
+      release_ground_shape(ground, dropped[d]);
+    }
+    if (code[i].op != QRY_OP_SHFT && qry->incrementalCalc) {
+      resolve_completed_pairs(qry, ground);
+    }
+  }
 
-  // Loop until loader is empty
-  while (!stack_is_empty(*(loader->shapes))) {
-    perform_shift_operation(shooters, *shootersCount, shooterIdInt,
-                            leftOrRightButton, 1, loaders, *loadersCount);
-    perform_shoot_operation(shooters, *shootersCount, shooterIdInt,
-                            times * incrementXDouble + dxDouble,
-                            times * incrementYDouble + dyDouble, "i", arena,
-                            stackToFree);
-    times++;
+  for (int g = 0; g < groupCount; g++) {
+    free(staged[g].records);
+    free(discarded[g].shapes);
   }
+  free(staged);
+  free(discarded);
+  free(order);
+  free(groupStart);
+  free(outcomes);
 }
 
-void execute_calc_command(Stack arena, Ground ground, FILE *txtFile,
-                          int totalCommands, FileData qryFileData,
-                          FileData geoFileData, const char *output_path) {
-  // We need to process in launch order (oldest to newest). Arena is a stack
-  // (LIFO), so first reverse into a temporary stack to get FIFO order when
-  // popping.
-  Stack temp = stack_create();
-  while (!stack_is_empty(arena)) {
-    stack_push(temp, stack_pop(arena));
-  }
-
-  // Accumulate crushed area only for overlapping pairs (min area per pair)
-  double total_crushed_area = 0.0;
-
-  // Now process adjacent pairs I (older) and J (I+1 newer).
-  while (!stack_is_empty(temp)) {
-    ShapePositionOnArena_t *I = (ShapePositionOnArena_t *)stack_pop(temp);
-    if (stack_is_empty(temp)) {
-      // No pair for I, return to ground at its arena position
-      Shape_t *Ipos = clone_with_position(I->shape, I->x, I->y, ground);
-      if (Ipos != NULL) {
-        queue_enqueue(get_ground_queue(ground), Ipos);
-      }
-      continue;
-    }
-    ShapePositionOnArena_t *J = (ShapePositionOnArena_t *)stack_pop(temp);
-
-    bool overlap = shapes_overlap(I, J);
-    if (overlap) {
-      double areaI = shape_area(I->shape->type, I->shape->data);
-      double areaJ = shape_area(J->shape->type, J->shape->data);
-      // Add only the crushed area for this overlapping pair
-      total_crushed_area += (areaI < areaJ) ? areaI : areaJ;
-
-      if (areaI < areaJ) {
-        // I is destroyed; J goes back to ground at its arena position
-        Shape_t *Jpos = clone_with_position(J->shape, J->x, J->y, ground);
-        if (Jpos != NULL) {
-          queue_enqueue(get_ground_queue(ground), Jpos);
-        }
-      } else if (areaI >= areaJ) {
-        // I changes border color of J to fill color of I, if applicable
-        const char *fillColorI = NULL;
-        switch (I->shape->type) {
-        case CIRCLE:
-          fillColorI = circle_get_fill_color((Circle)I->shape->data);
-          break;
-        case RECTANGLE:
-          fillColorI = rectangle_get_fill_color((Rectangle)I->shape->data);
-          break;
-        case TEXT:
-          fillColorI = text_get_fill_color((Text)I->shape->data);
-          break;
-        case LINE:
-        case TEXT_STYLE:
-          fillColorI = NULL;
-          break;
-        }
-
-        // Prepare J' with new border and positioned at J
-        Shape_t *JprimePos = NULL;
-        if (fillColorI != NULL) {
-          JprimePos = clone_with_border_color_at_position(J->shape, fillColorI,
-                                                          J->x, J->y, ground);
-        } else {
-          JprimePos = clone_with_position(J->shape, J->x, J->y, ground);
-        }
+// Sets the group of every command of a run and returns the number of
+// groups. Commands of one shooter share a group, and so do the shooters
+// attached to a common loader. Commands naming no registered shooter
+// change nothing, so each gets a group of its own.
+static int group_shooter_commands(Qry_t *qry, const QryInstruction *code,
+                                  ShooterOutcome_t *outcomes, int count) {
+  // Union-find over the shooters and loaders named by the run, with at
+  // most three nodes per command
+  int *parent = malloc((size_t)count * 3 * sizeof(int));
+  int *groupOfRoot = malloc((size_t)count * 3 * sizeof(int));
+  if (parent == NULL || groupOfRoot == NULL) {
+    printf("Error: Failed to allocate memory for shooter commands\n");
+    exit(1);
+  }
 
-        // Both return to ground in original relative order (I, then J') at
-        // their positions
-        Shape_t *Ipos = clone_with_position(I->shape, I->x, I->y, ground);
-        if (Ipos != NULL) {
-          queue_enqueue(get_ground_queue(ground), Ipos);
-        }
-        if (JprimePos != NULL) {
-          queue_enqueue(get_ground_queue(ground), JprimePos);
-        }
+  for (int i = 0; i < count; i++) {
+    Shooter_t *shooter = &qry->shooters[code[i].shooter];
+    shooter->node = -1;
+    if (shooter->leftLoader != NULL) {
+      shooter->leftLoader->node = -1;
+    }
+    if (shooter->rightLoader != NULL) {
+      shooter->rightLoader->node = -1;
+    }
+  }
 
-        // Clone I swapping border and fill (only if applicable), at I position
-        Shape_t *IclonePos =
-            clone_with_swapped_colors_at_position(I->shape, I->x, I->y, ground);
-        if (IclonePos != NULL) {
-          queue_enqueue(get_ground_queue(ground), IclonePos);
-        }
-      } else {
-        // Equal areas: both return unchanged at their positions
-        Shape_t *Ipos = clone_with_position(I->shape, I->x, I->y, ground);
-        Shape_t *Jpos = clone_with_position(J->shape, J->x, J->y, ground);
-        if (Ipos != NULL) {
-          queue_enqueue(get_ground_queue(ground), Ipos);
+  int nodes = 0;
+  for (int i = 0; i < count; i++) {
+    Shooter_t *shooter = find_shooter(qry, code[i].shooter);
+    if (shooter == NULL) {
+      parent[nodes] = nodes;
+      outcomes[i].group = nodes++; // node for now, group below
+      continue;
+    }
+    if (shooter->node == -1) {
+      parent[nodes] = nodes;
+      shooter->node = nodes++;
+      Loader_t *attached[2] = {shooter->leftLoader, shooter->rightLoader};
+      for (int side = 0; side < 2; side++) {
+        Loader_t *loader = attached[side];
+        if (loader == NULL) {
+          continue;
         }
-        if (Jpos != NULL) {
-          queue_enqueue(get_ground_queue(ground), Jpos);
+        if (loader->node == -1) {
+          parent[nodes] = nodes;
+          loader->node = nodes++;
         }
-      }
-    } else {
-      // No overlap: both return unchanged in the same relative order, placed at
-      // their positions
-      Shape_t *Ipos = clone_with_position(I->shape, I->x, I->y, ground);
-      Shape_t *Jpos = clone_with_position(J->shape, J->x, J->y, ground);
-      if (Ipos != NULL) {
-        queue_enqueue(get_ground_queue(ground), Ipos);
-      }
-      if (Jpos != NULL) {
-        queue_enqueue(get_ground_queue(ground), Jpos);
+        int a = find_group_root(parent, shooter->node);
+        int b = find_group_root(parent, loader->node);
+        parent[a < b ? b : a] = a < b ? a : b;
       }
     }
+    outcomes[i].group = shooter->node;
   }
 
-  // Output the calculated result
-  fprintf(txtFile, "[calc]\n");
-  fprintf(txtFile, "\tResult: %.2lf\n", total_crushed_area);
-  fprintf(txtFile, "\tTotal commands executed: %d\n", totalCommands);
-  fprintf(txtFile, "\n");
-  // Clean up temporary stack
-  stack_destroy(temp);
+  int groupCount = 0;
+  for (int n = 0; n < nodes; n++) {
+    groupOfRoot[n] = -1;
+  }
+  for (int i = 0; i < count; i++) {
+    int root = find_group_root(parent, outcomes[i].group);
+    if (groupOfRoot[root] == -1) {
+      groupOfRoot[root] = groupCount++;
+    }
+    outcomes[i].group = groupOfRoot[root];
+  }
 
-  // Generate SVG AFTER processing collisions, showing only surviving shapes
-  write_qry_result_svg(qryFileData, geoFileData, ground, arena, output_path);
+  free(groupOfRoot);
+  free(parent);
+  return groupCount;
+}
 
-  // Output the calculated result
+static int find_group_root(int *parent, int node) {
+  while (parent[node] != node) {
+    parent[node] = parent[parent[node]];
+    node = parent[node];
+  }
+  return node;
 }
 
-static int find_shooter_index_by_id(Shooter_t **shooters, int shootersCount,
-                                    int id) {
-  for (int i = 0; i < shootersCount; i++) {
-    if ((*shooters)[i].id == id) {
-      return i;
+// Runs groups [begin, end) of a run, each command in order; runs on the
+// worker thread pool
+static void run_shooter_groups_task(void *ctx, int begin, int end) {
+  ShooterGroupsJob_t *job = (ShooterGroupsJob_t *)ctx;
+  for (int g = begin; g < end; g++) {
+    for (int k = job->groupStart[g]; k < job->groupStart[g + 1]; k++) {
+      int i = job->order[k];
+      perform_shooter_command(job->qry, &job->code[i], &job->outcomes[i],
+                              &job->staged[g], &job->discarded[g]);
     }
   }
-  return -1;
 }
 
-// =====================
-// Helpers implementation
-// =====================
+// Applies a command to its shooter and loaders; launches are appended to
+// arena, discarded shapes to discarded, and both are recorded in the outcome
+static void perform_shooter_command(Qry_t *qry, const QryInstruction *in,
+                                    ShooterOutcome_t *outcome, Arena_t *arena,
+                                    Discarded_t *discarded) {
+  int before = arena->count;
+  int discardedBefore = discarded->count;
+  Shooter_t *shooter = find_shooter(qry, in->shooter);
+  outcome->status =
+      shooter != NULL ? SHOOTER_COMMAND_DONE : SHOOTER_NOT_FOUND;
+  if (shooter != NULL) {
+    switch (in->op) {
+    case QRY_OP_SHFT:
+      perform_shift_operation(shooter, in->button, in->count, discarded);
+      break;
+    case QRY_OP_DSP:
+      perform_shoot_operation(shooter, in->operand[0], in->operand[1],
+                              in->annotate, arena);
+      break;
+    case QRY_OP_RJD:
+      outcome->status =
+          perform_volley_operation(shooter, in, arena, discarded);
+      break;
+    default:
+      break;
+    }
+  }
+  outcome->firstRecord = before;
+  outcome->recordCount = arena->count - before;
+  outcome->firstDiscarded = discardedBefore;
+  outcome->discardedCount = discarded->count - discardedBefore;
+}
 
-static Shape_t *make_shape_wrapper(ShapeType type, void *data) {
-  Shape_t *s = (Shape_t *)malloc(sizeof(Shape_t));
-  if (s == NULL) {
-    printf("Error: Failed to allocate shape wrapper\n");
-    exit(1);
+static ShooterCommandStatus perform_volley_operation(Shooter_t *shooter,
+                                                     const QryInstruction *in,
+                                                     Arena_t *arena,
+                                                     Discarded_t *discarded) {
+  // Left button fires from the RIGHT loader and vice versa (inverted logic)
+  Loader_t *loader = NULL;
+  Loader_t *target = NULL;
+  if (in->button == QRY_BUTTON_LEFT) {
+    loader = shooter->rightLoader;
+    target = shooter->leftLoader;
+  } else if (in->button == QRY_BUTTON_RIGHT) {
+    loader = shooter->leftLoader;
+    target = shooter->rightLoader;
+  } else {
+    return SHOOTER_INVALID_BUTTON;
   }
-  s->type = type;
-  s->data = data;
-  return s;
+
+  if (loader == NULL) {
+    return SHOOTER_LOADER_NOT_FOUND;
+  }
+
+  fire_volley(shooter, loader, target, in->operand[0], in->operand[1],
+              in->operand[2], in->operand[3], arena, discarded);
+  return SHOOTER_COMMAND_DONE;
 }
 
-static double shape_area(ShapeType type, void *shapeData) {
-  switch (type) {
-  case CIRCLE: {
-    double r = circle_get_radius((Circle)shapeData);
-    return 3.141592653589793 * r * r;
+// Writes the txt report and the error message of a command that already ran
+static void report_shooter_command(const Qry_t *qry, const QryInstruction *in,
+                                   const ShooterOutcome_t *outcome,
+                                   TextWriter report) {
+  int shooterId = qry_program_fast_shooter_id(qry->program, in->shooter);
+  switch (in->op) {
+  case QRY_OP_SHFT:
+    // Fields of shft share a single line
+    text_writer_put_text(report, "[shft]\tShooter ID: ");
+    text_writer_put_int(report, shooterId);
+    text_writer_put_text(report, "\tButton: ");
+    text_writer_put_text(report, qry_program_fast_text(qry->program, in->text));
+    text_writer_put_text(report, "\tTimes pressed: ");
+    text_writer_put_int(report, in->count);
+    text_writer_put_char(report, '\n');
+    break;
+  case QRY_OP_DSP:
+    text_writer_put_text(report, "[dsp]\n");
+    write_int_line(report, "\tShooter ID: ", shooterId);
+    write_fixed_line(report, "\tDX: ", in->operand[0], 6);
+    write_fixed_line(report, "\tDY: ", in->operand[1], 6);
+    text_writer_put_text(report, "\tAnnotate dimensions: ");
+    text_writer_put_text(report, qry_program_fast_text(qry->program, in->text));
+    text_writer_put_char(report, '\n');
+    break;
+  case QRY_OP_RJD:
+    if (outcome->status == SHOOTER_COMMAND_DONE) {
+      text_writer_put_text(report, "[rjd]\n");
+      write_int_line(report, "\tShooter ID: ", shooterId);
+      text_writer_put_text(report, in->button == QRY_BUTTON_LEFT
+                                       ? "\tButton: e\n"
+                                       : "\tButton: d\n");
+      write_fixed_line(report, "\tDX: ", in->operand[0], 6);
+      write_fixed_line(report, "\tDY: ", in->operand[1], 6);
+      write_fixed_line(report, "\tIncrement X: ", in->operand[2], 6);
+      write_fixed_line(report, "\tIncrement Y: ", in->operand[3], 6);
+      text_writer_put_char(report, '\n');
+    }
+    break;
+  default:
+    break;
   }
-  case RECTANGLE: {
-    double w = rectangle_get_width((Rectangle)shapeData);
-    double h = rectangle_get_height((Rectangle)shapeData);
-    return w * h;
+
+  switch (outcome->status) {
+  case SHOOTER_COMMAND_DONE:
+    break;
+  case SHOOTER_NOT_FOUND:
+    printf("Error: Shooter with ID %d not found\n", shooterId);
+    break;
+  case SHOOTER_INVALID_BUTTON:
+    printf("Error: Invalid button (should be 'e' or 'd')\n");
+    break;
+  case SHOOTER_LOADER_NOT_FOUND:
+    printf("Error: Loader not found or shapes stack is NULL\n");
+    break;
   }
-  case LINE: {
-    double x1 = line_get_x1((Line)shapeData);
-    double y1 = line_get_y1((Line)shapeData);
-    double x2 = line_get_x2((Line)shapeData);
-    double y2 = line_get_y2((Line)shapeData);
-    double dx = x2 - x1;
-    double dy = y2 - y1;
-    double len = (dx * dx + dy * dy) > 0.0 ? sqrt(dx * dx + dy * dy) : 0.0;
-    return 2.0 * len;
+}
+
+// Resolves the arena and reports the crushed area; the .svg is written only
+// if render is set
+void execute_calc_command(Qry_t *qry, Ground ground, TextWriter report,
+                          int totalCommands, FileData qryFileData,
+                          FileData geoFileData, const char *output_path,
+                          bool render) {
+  Arena_t *arena = &qry->arena;
+
+  // In incremental mode the completed pairs were already resolved as they
+  // were launched; otherwise the whole arena is resolved here
+  resolve_completed_pairs(qry, ground);
+  if (arena->count == 1) {
+    // No pair for the last launch, return it to ground at its arena position
+    const ShapePositionOnArena_t *I = &arena->records[0];
+    Shape Ipos = clone_with_position(I->shape, I->x, I->y, ground);
+    if (Ipos != NULL) {
+      queue_enqueue(qry->resolvedShapes, Ipos);
+    }
   }
-  case TEXT: {
-    const char *txt = text_get_text((Text)shapeData);
-    int len = (int)strlen(txt);
-    return 20.0 * (double)len;
+  // Every launched shape went back to the ground, so the arena is emptied
+  for (int i = 0; i < arena->count; i++) {
+    release_ground_shape(ground, arena->records[i].shape);
   }
-  case TEXT_STYLE:
-    return 0.0;
+  arena->count = 0;
+
+  // Once started, the ground numbering follows the shapes coming back
+  if (qry->groundIndex.numbered) {
+    queue_for_each(qry->resolvedShapes, number_ground_shape,
+                   &qry->groundIndex);
+  }
+  add_ground_shapes(ground, qry->resolvedShapes);
+  // Crushed area accumulated only for overlapping pairs (min area per pair)
+  double total_crushed_area = qry->crushedArea;
+  qry->crushedArea = 0.0;
+
+  // Output the calculated result
+  text_writer_put_text(report, "[calc]\n");
+  write_fixed_line(report, "\tResult: ", total_crushed_area, 2);
+  write_int_line(report, "\tTotal commands executed: ", totalCommands);
+  if (qry->exactOverlap) {
+    write_int_line(report, "\tPairs apart by bounding box: ",
+                   qry->broadphaseRejects);
+    write_int_line(report, "\tPairs apart by exact test: ",
+                   qry->narrowphaseRejects);
+  }
+  qry->broadphaseRejects = 0;
+  qry->narrowphaseRejects = 0;
+  text_writer_put_char(report, '\n');
+
+  // Generate SVG AFTER processing collisions, showing only surviving shapes
+  if (render) {
+    write_qry_result_svg(qryFileData, geoFileData, ground, arena,
+                         output_path);
   }
-  return 0.0;
 }
 
-static Aabb make_aabb_for_shape_on_arena(const ShapePositionOnArena_t *s) {
-  Aabb box;
-  switch (s->shape->type) {
-  case CIRCLE: {
-    double r = circle_get_radius((Circle)s->shape->data);
-    box.minX = s->x - r;
-    box.maxX = s->x + r;
-    box.minY = s->y - r;
-    box.maxY = s->y + r;
-    break;
+// Reports every pair of overlapping shapes among those on the arena and on
+// the ground. Shapes whose pair was already resolved in incremental mode are
+// counted as ground, where the next calc puts them.
+static void execute_sob_command(Qry_t *qry, Ground ground,
+                                TextWriter report) {
+  int capacity = qry->arena.count + count_ground_shapes(ground) +
+                 queue_size(qry->resolvedShapes);
+  OverlapScan_t scan = {.items = malloc((size_t)(capacity > 0 ? capacity : 1) *
+                                        sizeof(ShapePositionOnArena_t)),
+                        .count = 0,
+                        .arenaCount = 0,
+                        .exactOverlap = qry->exactOverlap,
+                        .report = report,
+                        .pairCount = 0};
+  SpatialGrid grid = spatial_grid_create(capacity);
+  if (scan.items == NULL || grid == NULL) {
+    printf("Error: Failed to allocate memory for sob\n");
+    exit(1);
   }
-  case RECTANGLE: {
-    double w = rectangle_get_width((Rectangle)s->shape->data);
-    double h = rectangle_get_height((Rectangle)s->shape->data);
-    box.minX = s->x;
-    box.minY = s->y;
-    box.maxX = s->x + w;
-    box.maxY = s->y + h;
-    break;
+
+  // Text styles have no geometry and never overlap anything
+  for (int i = 0; i < qry->arena.count; i++) {
+    if (shape_fast_get_type(qry->arena.records[i].shape) != TEXT_STYLE) {
+      scan.items[scan.count++] = qry->arena.records[i];
+    }
   }
-  case TEXT: {
-    // Treat text as a horizontal segment based on anchor, with length 10.0 *
-    // |t|
-    Text t = (Text)s->shape->data;
-    const char *txt = text_get_text(t);
-    int len = (int)strlen(txt);
-    double segLen = 10.0 * (double)len;
-    char anchor = text_get_anchor(t);
-    double x1 = s->x;
-    double y1 = s->y;
-    double x2 = s->x;
-    double y2 = s->y;
-    if (anchor == 'i' || anchor == 'I') {
-      // start anchor to the right
-      x2 = s->x + segLen;
-      y2 = s->y;
-    } else if (anchor == 'f' || anchor == 'F' || anchor == 'e' ||
-               anchor == 'E') {
-      // end anchor to the left (Portuguese 'f'inal / 'e'nd)
-      x1 = s->x - segLen;
-      y1 = s->y;
-    } else if (anchor == 'm' || anchor == 'M') {
-      // middle anchor centered at s->x
-      x1 = s->x - segLen * 0.5;
-      y1 = s->y;
-      x2 = s->x + segLen * 0.5;
-      y2 = s->y;
-    } else {
-      // default to start ('i') if unknown
-      x2 = s->x + segLen;
-      y2 = s->y;
+  scan.arenaCount = scan.count;
+  for_each_ground_shape(ground, add_ground_item, &scan);
+  queue_for_each(qry->resolvedShapes, add_ground_item, &scan);
+
+  for (int i = 0; i < scan.count; i++) {
+    const ShapePositionOnArena_t *item = &scan.items[i];
+    Scalar minX, minY, maxX, maxY;
+    shape_fast_get_local_bounds(item->shape, &minX, &minY, &maxX, &maxY);
+    if (!spatial_grid_add(grid, minX + item->x, minY + item->y,
+                          maxX + item->x, maxY + item->y)) {
+      printf("Error: Failed to allocate memory for sob\n");
+      exit(1);
     }
-
-    double dx = x2 - x1;
-    double dy = y2 - y1; // will be 0.0 for horizontal segment
-    double minLocalX = (dx < 0.0) ? dx : 0.0;
-    double maxLocalX = (dx > 0.0) ? dx : 0.0;
-    double minLocalY = (dy < 0.0) ? dy : 0.0;
-    double maxLocalY = (dy > 0.0) ? dy : 0.0;
-    // thickness 2.0 => inflate by 1 on each side (same rule as LINE)
-    box.minX = x1 + minLocalX - 1.0;
-    box.maxX = x1 + maxLocalX + 1.0;
-    box.minY = y1 + minLocalY - 1.0;
-    box.maxY = y1 + maxLocalY + 1.0;
-    break;
   }
-  case LINE: {
-    double x1 = line_get_x1((Line)s->shape->data);
-    double y1 = line_get_y1((Line)s->shape->data);
-    double x2 = line_get_x2((Line)s->shape->data);
-    double y2 = line_get_y2((Line)s->shape->data);
-    double dx = x2 - x1;
-    double dy = y2 - y1;
-    double minLocalX = (dx < 0.0) ? dx : 0.0;
-    double maxLocalX = (dx > 0.0) ? dx : 0.0;
-    double minLocalY = (dy < 0.0) ? dy : 0.0;
-    double maxLocalY = (dy > 0.0) ? dy : 0.0;
-    // thickness 2.0 => inflate by 1 on each side
-    box.minX = s->x + minLocalX - 1.0;
-    box.maxX = s->x + maxLocalX + 1.0;
-    box.minY = s->y + minLocalY - 1.0;
-    box.maxY = s->y + maxLocalY + 1.0;
-    break;
+  // Pairs are written as the grid finds them, already in item order
+  text_writer_put_text(report, "[sob]\n");
+  write_int_line(report, "\tShapes: ", scan.count);
+  if (!spatial_grid_for_each_overlap(grid, report_overlap_pair, &scan)) {
+    printf("Error: Failed to allocate memory for sob\n");
+    exit(1);
   }
-  case TEXT_STYLE: {
-    // No extent, treat as empty box
-    box.minX = box.maxX = s->x;
-    box.minY = box.maxY = s->y;
-    break;
+  write_int_line(report, "\tOverlapping pairs: ", scan.pairCount);
+  text_writer_put_char(report, '\n');
+
+  spatial_grid_destroy(grid);
+  free(scan.items);
+}
+
+// Adds a ground shape to a sob scan, at its own position
+static void add_ground_item(void *shape, void *ctx) {
+  OverlapScan_t *scan = (OverlapScan_t *)ctx;
+  if (shape_fast_get_type(shape) == TEXT_STYLE) {
+    return;
   }
+
+  double x, y;
+  shape_get_position(shape, &x, &y);
+  scan->items[scan->count++] = (ShapePositionOnArena_t){
+      .shape = shape, .x = x, .y = y, .isAnnotated = false};
+}
+
+// Writes a pair whose boxes overlap, after the exact test if enabled
+static void report_overlap_pair(void *ctx, int first, int second) {
+  OverlapScan_t *scan = (OverlapScan_t *)ctx;
+  if (scan->exactOverlap &&
+      !shapes_touch(&scan->items[first], &scan->items[second])) {
+    return;
   }
-  return box;
+
+  TextWriter report = scan->report;
+  text_writer_put_text(report,
+                       first < scan->arenaCount ? "\tarena " : "\tground ");
+  text_writer_put_int(report, shape_get_id(scan->items[first].shape));
+  text_writer_put_text(report,
+                       second < scan->arenaCount ? " - arena " : " - ground ");
+  text_writer_put_int(report, shape_get_id(scan->items[second].shape));
+  text_writer_put_char(report, '\n');
+  scan->pairCount++;
 }
 
-static bool aabb_overlap(Aabb a, Aabb b) {
-  if (a.maxX < b.minX)
-    return false;
-  if (b.maxX < a.minX)
-    return false;
-  if (a.maxY < b.minY)
-    return false;
-  if (b.maxY < a.minY)
-    return false;
-  return true;
+// Reports the ground shapes whose box meets the rectangle of the command
+// (x, y, width, height), in ground order
+static void execute_sel_command(Qry_t *qry, const QryInstruction *in,
+                                Ground ground, TextWriter report) {
+  double xDouble = in->operand[0];
+  double yDouble = in->operand[1];
+  double wDouble = in->operand[2];
+  double hDouble = in->operand[3];
+
+  GroundIndex_t *index = &qry->groundIndex;
+  int firstOnGround = prepare_ground_index(index, ground);
+  sync_ground_boxes(index, firstOnGround);
+
+  RegionSelection_t selection = {
+      .qry = qry,
+      .firstOnGround = firstOnGround,
+      .window = {xDouble, yDouble, xDouble + wDouble, yDouble + hDouble},
+      .found = NULL,
+      .foundCount = 0,
+      .foundCapacity = 0};
+  if (!rtree_search(index->boxes, selection.window[0], selection.window[1],
+                    selection.window[2], selection.window[3],
+                    collect_selected_shape, &selection)) {
+    printf("Error: Failed to allocate memory for sel\n");
+    exit(1);
+  }
+  // An empty window leaves found NULL, which qsort must not be given
+  if (selection.foundCount > 1) {
+    qsort(selection.found, (size_t)selection.foundCount, sizeof(int),
+          compare_ints);
+  }
+
+  text_writer_put_text(report, "[sel]\n");
+  write_fixed_line(report, "\tX: ", xDouble, 6);
+  write_fixed_line(report, "\tY: ", yDouble, 6);
+  write_fixed_line(report, "\tWidth: ", wDouble, 6);
+  write_fixed_line(report, "\tHeight: ", hDouble, 6);
+  for (int k = 0; k < selection.foundCount; k++) {
+    Shape shape = index->shapes[selection.found[k]];
+    text_writer_put_char(report, '\t');
+    text_writer_put_text(report, shape_type_names[shape_get_type(shape)]);
+    text_writer_put_char(report, ' ');
+    text_writer_put_int(report, shape_get_id(shape));
+    text_writer_put_char(report, '\n');
+  }
+  write_int_line(report, "\tShapes found: ", selection.foundCount);
+  text_writer_put_char(report, '\n');
+
+  free(selection.found);
 }
 
-static bool shapes_overlap(const ShapePositionOnArena_t *a,
-                           const ShapePositionOnArena_t *b) {
-  Aabb aa = make_aabb_for_shape_on_arena(a);
-  Aabb bb = make_aabb_for_shape_on_arena(b);
-  return aabb_overlap(aa, bb);
-}
-
-static Shape_t *clone_with_border_color(Shape_t *src,
-                                        const char *newBorderColor) {
-  switch (src->type) {
-  case CIRCLE: {
-    Circle c = (Circle)src->data;
-    int id = circle_get_id(c);
-    double x = 0.0; // position handled by arena, keep model values
-    double y = 0.0;
-    // Preserve original geometry from getters
-    x = circle_get_x(c);
-    y = circle_get_y(c);
-    double r = circle_get_radius(c);
-    const char *fill = circle_get_fill_color(c);
-    Circle nc = circle_create(id, x, y, r, newBorderColor, fill);
-    return make_shape_wrapper(CIRCLE, nc);
-  }
-  case RECTANGLE: {
-    Rectangle r = (Rectangle)src->data;
-    int id = rectangle_get_id(r);
-    double x = rectangle_get_x(r);
-    double y = rectangle_get_y(r);
-    double w = rectangle_get_width(r);
-    double h = rectangle_get_height(r);
-    const char *fill = rectangle_get_fill_color(r);
-    Rectangle nr = rectangle_create(id, x, y, w, h, newBorderColor, fill);
-    return make_shape_wrapper(RECTANGLE, nr);
-  }
-  case TEXT: {
-    Text t = (Text)src->data;
-    int id = text_get_id(t);
-    double x = text_get_x(t);
-    double y = text_get_y(t);
-    const char *fill = text_get_fill_color(t);
-    char anchor = text_get_anchor(t);
-    const char *txt = text_get_text(t);
-    Text nt = text_create(id, x, y, newBorderColor, fill, anchor, txt);
-    return make_shape_wrapper(TEXT, nt);
+// Reports the k ground shapes whose anchors are nearest to a shooter, or to
+// the point a dsp with the given offsets would land at
+static void execute_prox_command(Qry_t *qry, const QryInstruction *in,
+                                 Ground ground, TextWriter report) {
+  int shooterIdInt = qry_program_fast_shooter_id(qry->program, in->shooter);
+  int kInt = in->count;
+  Shooter_t *shooter = find_shooter(qry, in->shooter);
+  if (shooter == NULL) {
+    printf("Error: Shooter %d not found\n", shooterIdInt);
+    return;
   }
-  case LINE: {
-    Line l = (Line)src->data;
-    int id = line_get_id(l);
-    double x1 = line_get_x1(l);
-    double y1 = line_get_y1(l);
-    double x2 = line_get_x2(l);
-    double y2 = line_get_y2(l);
-    Line nl = line_create(id, x1, y1, x2, y2, newBorderColor);
-    return make_shape_wrapper(LINE, nl);
+  double x = shooter->x + in->operand[0];
+  double y = shooter->y + in->operand[1];
+
+  GroundIndex_t *index = &qry->groundIndex;
+  int firstOnGround = prepare_ground_index(index, ground);
+  sync_ground_anchors(index, firstOnGround);
+
+  // No more items than anchor points can be found, whatever k the .qry asks
+  int points = kd_tree_size(index->anchors);
+  if (kInt > points) {
+    kInt = points;
   }
-  case TEXT_STYLE:
-    return NULL;
+
+  int found = 0;
+  int *items = NULL;
+  double *distances = NULL;
+  if (kInt > 0) {
+    items = malloc((size_t)kInt * sizeof(int));
+    distances = malloc((size_t)kInt * sizeof(double));
+    if (items == NULL || distances == NULL) {
+      printf("Error: Failed to allocate memory for prox\n");
+      exit(1);
+    }
+    found = kd_tree_nearest(index->anchors, x, y, kInt, is_on_ground,
+                            &firstOnGround, items, distances);
+  }
+
+  text_writer_put_text(report, "[prox]\n");
+  write_int_line(report, "\tShooter ID: ", shooterIdInt);
+  write_fixed_line(report, "\tX: ", x, 6);
+  write_fixed_line(report, "\tY: ", y, 6);
+  for (int i = 0; i < found; i++) {
+    Shape shape = index->shapes[items[i]];
+    text_writer_put_char(report, '\t');
+    text_writer_put_text(report, shape_type_names[shape_get_type(shape)]);
+    text_writer_put_char(report, ' ');
+    text_writer_put_int(report, shape_get_id(shape));
+    write_fixed_line(report, ": ", distances[i], 6);
+  }
+  write_int_line(report, "\tShapes found: ", found);
+  text_writer_put_char(report, '\n');
+
+  free(items);
+  free(distances);
+}
+
+// Numbers the ground on the first query, and renumbers it when most
+// numbered shapes have left it. Returns the number of the first shape still
+// on the ground.
+static int prepare_ground_index(GroundIndex_t *index, Ground ground) {
+  int onGround = count_ground_shapes(ground);
+  if (!index->numbered || index->count - onGround > onGround) {
+    index->numbered = true;
+    index->count = 0;
+    index->boxesIndexed = 0;
+    index->anchorsIndexed = 0;
+    rtree_clear(index->boxes);
+    kd_tree_clear(index->anchors);
+    for_each_ground_shape(ground, number_ground_shape, index);
+  }
+  return index->count - onGround;
+}
+
+static void number_ground_shape(void *shape, void *ctx) {
+  GroundIndex_t *index = (GroundIndex_t *)ctx;
+  if (index->count == index->capacity) {
+    int capacity = index->capacity > 0 ? index->capacity * 2 : 1024;
+    Shape *shapes = realloc(index->shapes, (size_t)capacity * sizeof(Shape));
+    if (shapes == NULL) {
+      printf("Error: Failed to allocate memory for the ground index\n");
+      exit(1);
+    }
+    index->shapes = shapes;
+    index->capacity = capacity;
   }
-  return NULL;
-}
-
-static Shape_t *clone_with_swapped_colors(Shape_t *src) {
-  switch (src->type) {
-  case CIRCLE: {
-    Circle c = (Circle)src->data;
-    int id = circle_get_id(c);
-    double x = circle_get_x(c);
-    double y = circle_get_y(c);
-    double r = circle_get_radius(c);
-    const char *border = circle_get_border_color(c);
-    const char *fill = circle_get_fill_color(c);
-    Circle nc = circle_create(id, x, y, r, fill, border);
-    return make_shape_wrapper(CIRCLE, nc);
-  }
-  case RECTANGLE: {
-    Rectangle r = (Rectangle)src->data;
-    int id = rectangle_get_id(r);
-    double x = rectangle_get_x(r);
-    double y = rectangle_get_y(r);
-    double w = rectangle_get_width(r);
-    double h = rectangle_get_height(r);
-    const char *border = rectangle_get_border_color(r);
-    const char *fill = rectangle_get_fill_color(r);
-    Rectangle nr = rectangle_create(id, x, y, w, h, fill, border);
-    return make_shape_wrapper(RECTANGLE, nr);
-  }
-  case TEXT: {
-    Text t = (Text)src->data;
-    int id = text_get_id(t);
-    double x = text_get_x(t);
-    double y = text_get_y(t);
-    const char *border = text_get_border_color(t);
-    const char *fill = text_get_fill_color(t);
-    char anchor = text_get_anchor(t);
-    const char *txt = text_get_text(t);
-    Text nt = text_create(id, x, y, fill, border, anchor, txt);
-    return make_shape_wrapper(TEXT, nt);
+  index->shapes[index->count++] = shape;
+}
+
+// Adds the boxes of the numbered shapes still missing from the box tree.
+// Text styles have no box to be found by.
+static void sync_ground_boxes(GroundIndex_t *index, int firstOnGround) {
+  if (index->boxes == NULL) {
+    index->boxes = rtree_create();
+    if (index->boxes == NULL) {
+      printf("Error: Failed to allocate memory for the ground index\n");
+      exit(1);
+    }
   }
-  case LINE: {
-    Line l = (Line)src->data;
-    int id = line_get_id(l);
-    double x1 = line_get_x1(l);
-    double y1 = line_get_y1(l);
-    double x2 = line_get_x2(l);
-    double y2 = line_get_y2(l);
-    const char *c = line_get_color(l);
-    char *inv = invert_color(c);
-    if (inv == NULL)
-      return NULL;
-    Line nl = line_create(id, x1, y1, x2, y2, inv);
-    free(inv);
-    return make_shape_wrapper(LINE, nl);
+
+  int number = index->boxesIndexed > firstOnGround ? index->boxesIndexed
+                                                   : firstOnGround;
+  for (; number < index->count; number++) {
+    Shape shape = index->shapes[number];
+    if (shape_fast_get_type(shape) == TEXT_STYLE) {
+      continue;
+    }
+    double x, y;
+    Scalar minX, minY, maxX, maxY;
+    shape_get_position(shape, &x, &y);
+    shape_fast_get_local_bounds(shape, &minX, &minY, &maxX, &maxY);
+    if (!rtree_insert(index->boxes, minX + x, minY + y, maxX + x, maxY + y,
+                      number)) {
+      printf("Error: Failed to allocate memory for the ground index\n");
+      exit(1);
+    }
   }
-  case TEXT_STYLE:
-    // No color to invert on style descriptor
-    return NULL;
+  index->boxesIndexed = index->count;
+}
+
+// Adds the anchors of the numbered shapes still missing from the point
+// tree: circle centers, rectangle corners, both ends of lines and text
+// anchors
+static void sync_ground_anchors(GroundIndex_t *index, int firstOnGround) {
+  if (index->anchors == NULL) {
+    index->anchors = kd_tree_create();
+    if (index->anchors == NULL) {
+      printf("Error: Failed to allocate memory for the ground index\n");
+      exit(1);
+    }
+  }
+
+  int number = index->anchorsIndexed > firstOnGround ? index->anchorsIndexed
+                                                     : firstOnGround;
+  for (; number < index->count; number++) {
+    Shape shape = index->shapes[number];
+    ShapeType type = shape_fast_get_type(shape);
+    if (type == TEXT_STYLE) {
+      continue;
+    }
+    double x, y;
+    shape_get_position(shape, &x, &y);
+    bool ok = kd_tree_insert(index->anchors, x, y, number);
+    if (ok && type == LINE) {
+      Line line = (Line)shape_fast_get_data(shape);
+      ok = kd_tree_insert(index->anchors, line_fast_get_x2(line),
+                          line_fast_get_y2(line), number);
+    }
+    if (!ok) {
+      printf("Error: Failed to allocate memory for the ground index\n");
+      exit(1);
+    }
   }
-  return NULL;
+  index->anchorsIndexed = index->count;
 }
 
-// =====================
-// Positioning helpers
-// =====================
+// Filter for numbered shapes; ctx points at the first number on the ground
+static bool is_on_ground(void *ctx, int item) {
+  return item >= *(const int *)ctx;
+}
 
-static void destroy_shape(Shape_t *s) {
-  if (s == NULL)
+// Keeps a shape found in the window if it is still on the ground and, with
+// the exact test enabled, really meets the window
+static void collect_selected_shape(void *ctx, int item) {
+  RegionSelection_t *selection = (RegionSelection_t *)ctx;
+  if (item < selection->firstOnGround) {
     return;
-  switch (s->type) {
-  case CIRCLE:
-    circle_destroy((Circle)s->data);
-    break;
-  case RECTANGLE:
-    rectangle_destroy((Rectangle)s->data);
-    break;
-  case LINE:
-    line_destroy((Line)s->data);
-    break;
-  case TEXT:
-    text_destroy((Text)s->data);
-    break;
-  case TEXT_STYLE:
-    // nothing allocated
-    break;
   }
-  free(s);
-}
+  if (selection->qry->exactOverlap) {
+    ShapePositionOnArena_t placed = {
+        .shape = selection->qry->groundIndex.shapes[item]};
+    double x, y;
+    shape_get_position(placed.shape, &x, &y);
+    placed.x = x;
+    placed.y = y;
+    if (!shape_touches_window(&placed, selection->window)) {
+      return;
+    }
+  }
 
-static Shape_t *clone_with_position(Shape_t *src, double x, double y,
-                                    Ground ground) {
-  if (src == NULL)
-    return NULL;
-  Shape_t *cloned = NULL;
-  switch (src->type) {
-  case CIRCLE: {
-    Circle c = (Circle)src->data;
-    int id = circle_get_id(c);
-    double r = circle_get_radius(c);
-    const char *border = circle_get_border_color(c);
-    const char *fill = circle_get_fill_color(c);
-    Circle nc = circle_create(id, x, y, r, border, fill);
-    cloned = make_shape_wrapper(CIRCLE, nc);
-    break;
+  if (selection->foundCount == selection->foundCapacity) {
+    int capacity =
+        selection->foundCapacity > 0 ? selection->foundCapacity * 2 : 64;
+    int *found = realloc(selection->found, (size_t)capacity * sizeof(int));
+    if (found == NULL) {
+      printf("Error: Failed to allocate memory for sel\n");
+      exit(1);
+    }
+    selection->found = found;
+    selection->foundCapacity = capacity;
   }
-  case RECTANGLE: {
-    Rectangle r = (Rectangle)src->data;
-    int id = rectangle_get_id(r);
-    double w = rectangle_get_width(r);
-    double h = rectangle_get_height(r);
-    const char *border = rectangle_get_border_color(r);
-    const char *fill = rectangle_get_fill_color(r);
-    Rectangle nr = rectangle_create(id, x, y, w, h, border, fill);
-    cloned = make_shape_wrapper(RECTANGLE, nr);
-    break;
+  selection->found[selection->foundCount++] = item;
+}
+
+static int compare_ints(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+// Resolves every complete pair on the arena, in launch order, into
+// qry->resolvedShapes. Only a launch still waiting for its partner is kept
+// on the arena.
+static void resolve_completed_pairs(Qry_t *qry, Ground ground) {
+  Arena_t *arena = &qry->arena;
+  int pairs = arena->count / 2;
+  if (pairs > 0) {
+    PairOutcome_t *outcomes =
+        malloc((size_t)(pairs < CALC_PAIRS_PER_BATCH ? pairs
+                                                     : CALC_PAIRS_PER_BATCH) *
+               sizeof(PairOutcome_t));
+    if (outcomes == NULL) {
+      printf("Error: Failed to allocate memory for calc\n");
+      exit(1);
+    }
+
+    // Pairs are planned concurrently in bounded batches; merging each batch
+    // in pair order keeps the ground order and the crushed area sum exactly
+    // as a sequential pass would leave them
+    for (int first = 0; first < pairs; first += CALC_PAIRS_PER_BATCH) {
+      int batch = pairs - first < CALC_PAIRS_PER_BATCH ? pairs - first
+                                                       : CALC_PAIRS_PER_BATCH;
+      PlanPairsJob_t job = {.records = &arena->records[2 * first],
+                            .outcomes = outcomes,
+                            .exactOverlap = qry->exactOverlap};
+      if (batch >= CALC_PARALLEL_MIN_PAIRS) {
+        thread_pool_parallel_for(qry->workerPool, batch, plan_pairs_task,
+                                 &job);
+      } else {
+        plan_pairs_task(&job, 0, batch);
+      }
+      for (int k = 0; k < batch; k++) {
+        merge_pair_outcome(qry, &outcomes[k], ground);
+      }
+    }
+    free(outcomes);
+
+    // The resolved shapes went back to the ground as clones or were
+    // crushed, so they are freed with their records. Nothing else refers to
+    // them: loaders and shooters gave them up when launching, and the ground
+    // index never reads the numbers of shapes that left the ground.
+    for (int i = 0; i < 2 * pairs; i++) {
+      release_ground_shape(ground, arena->records[i].shape);
+    }
   }
-  case TEXT: {
-    Text t = (Text)src->data;
-    int id = text_get_id(t);
-    const char *border = text_get_border_color(t);
-    const char *fill = text_get_fill_color(t);
-    char anchor = text_get_anchor(t);
-    const char *txt = text_get_text(t);
-    Text nt = text_create(id, x, y, border, fill, anchor, txt);
-    cloned = make_shape_wrapper(TEXT, nt);
-    break;
+
+  if (arena->count % 2 == 1) {
+    arena->records[0] = arena->records[arena->count - 1];
   }
-  case LINE: {
-    Line l = (Line)src->data;
-    int id = line_get_id(l);
-    double dx = line_get_x2(l) - line_get_x1(l);
-    double dy = line_get_y2(l) - line_get_y1(l);
-    Line nl = line_create(id, x, y, x + dx, y + dy, line_get_color(l));
-    cloned = make_shape_wrapper(LINE, nl);
-    break;
+  arena->count %= 2;
+}
+
+// Plans pairs [begin, end) of a batch; runs on the calc thread pool
+static void plan_pairs_task(void *ctx, int begin, int end) {
+  PlanPairsJob_t *job = (PlanPairsJob_t *)ctx;
+  AabbBatch boxesI;
+  AabbBatch boxesJ;
+  uint64_t overlaps[AABB_BATCH_SIZE / 64];
+
+  for (int first = begin; first < end; first += AABB_BATCH_SIZE) {
+    int count = end - first < AABB_BATCH_SIZE ? end - first : AABB_BATCH_SIZE;
+    const ShapePositionOnArena_t *records = &job->records[2 * first];
+
+    // Gather the boxes of the chunk into SoA rows so the overlap of many
+    // pairs is tested per instruction
+    for (int k = 0; k < count; k++) {
+      store_arena_box(&records[2 * k], boxesI, k);
+      store_arena_box(&records[2 * k + 1], boxesJ, k);
+    }
+    aabb_batch_overlap(boxesI, boxesJ, count, overlaps);
+
+    for (int k = 0; k < count; k++) {
+      PairOutcome_t *outcome = &job->outcomes[first + k];
+      const ShapePositionOnArena_t *I = &records[2 * k];
+      const ShapePositionOnArena_t *J = &records[2 * k + 1];
+      // The box test is the broadphase; only its hits pay for the exact test
+      bool boxesOverlap = (overlaps[k / 64] >> (k % 64)) & 1u;
+      bool overlap =
+          boxesOverlap && (!job->exactOverlap || shapes_touch(I, J));
+      plan_pair(I, J, overlap, outcome);
+      outcome->boxesOverlap = boxesOverlap;
+
+      // Text clones retain their shared body under a lock, so they are left
+      // for the sequential merge instead of contending for it
+      for (int c = 0; c < outcome->cloneCount; c++) {
+        PlannedClone_t *planned = &outcome->clones[c];
+        if (shape_fast_get_type(planned->source->shape) != TEXT) {
+          planned->clone = build_planned_clone(planned);
+          planned->built = true;
+        }
+      }
+    }
   }
-  case TEXT_STYLE:
-    return NULL;
+}
+
+// Decides what the pair I (older), J (newer), whose boxes overlap or not,
+// sends back to the ground. Only the two records are read, so pairs can be
+// planned concurrently.
+static void plan_pair(const ShapePositionOnArena_t *I,
+                      const ShapePositionOnArena_t *J, bool overlap,
+                      PairOutcome_t *outcome) {
+  outcome->overlap = overlap;
+  outcome->crushedArea = 0.0;
+  outcome->cloneCount = 0;
+
+  if (!outcome->overlap) {
+    // No overlap: both return unchanged in the same relative order, placed at
+    // their positions
+    plan_clone(outcome, I, CLONE_AT_POSITION, NULL);
+    plan_clone(outcome, J, CLONE_AT_POSITION, NULL);
+    return;
   }
 
-  // Add cloned shape to shapesStackToFree for proper cleanup
-  if (cloned != NULL && ground != NULL) {
-    stack_push(get_ground_shapes_stack_to_free(ground), cloned);
+  double areaI = shape_fast_get_area(I->shape);
+  double areaJ = shape_fast_get_area(J->shape);
+  // Only the crushed area of overlapping pairs counts
+  outcome->crushedArea = (areaI < areaJ) ? areaI : areaJ;
+
+  if (areaI < areaJ) {
+    // I is destroyed; J goes back to ground at its arena position
+    plan_clone(outcome, J, CLONE_AT_POSITION, NULL);
+  } else if (areaI >= areaJ) {
+    // Both return to ground in original relative order (I, then J'), where
+    // J' takes the fill color of I as border color, if applicable
+    const char *fillColorI = shape_get_fill_color(I->shape);
+    plan_clone(outcome, I, CLONE_AT_POSITION, NULL);
+    if (fillColorI != NULL) {
+      plan_clone(outcome, J, CLONE_WITH_BORDER_COLOR, fillColorI);
+    } else {
+      plan_clone(outcome, J, CLONE_AT_POSITION, NULL);
+    }
+    // Clone I swapping border and fill (only if applicable), at I position
+    plan_clone(outcome, I, CLONE_WITH_SWAPPED_COLORS, NULL);
+  } else {
+    // Equal areas: both return unchanged at their positions
+    plan_clone(outcome, I, CLONE_AT_POSITION, NULL);
+    plan_clone(outcome, J, CLONE_AT_POSITION, NULL);
   }
+}
 
-  return cloned;
+static void plan_clone(PairOutcome_t *outcome,
+                       const ShapePositionOnArena_t *source, CloneKind kind,
+                       const char *borderColor) {
+  PlannedClone_t *planned = &outcome->clones[outcome->cloneCount++];
+  planned->source = source;
+  planned->kind = kind;
+  planned->borderColor = borderColor;
+  planned->clone = NULL;
+  planned->built = false;
 }
 
-static Shape_t *clone_with_border_color_at_position(Shape_t *src,
-                                                    const char *newBorderColor,
-                                                    double x, double y,
-                                                    Ground ground) {
-  if (src == NULL)
-    return NULL;
-  Shape_t *cloned = NULL;
-  switch (src->type) {
-  case CIRCLE: {
-    Circle c = (Circle)src->data;
-    int id = circle_get_id(c);
-    double r = circle_get_radius(c);
-    const char *fill = circle_get_fill_color(c);
-    Circle nc = circle_create(id, x, y, r, newBorderColor, fill);
-    cloned = make_shape_wrapper(CIRCLE, nc);
-    break;
+// Builds a planned clone at its arena position, without tracking it
+static Shape build_planned_clone(const PlannedClone_t *planned) {
+  const ShapePositionOnArena_t *s = planned->source;
+  switch (planned->kind) {
+  case CLONE_WITH_BORDER_COLOR:
+    return shape_clone(s->shape, s->x, s->y, planned->borderColor);
+  case CLONE_WITH_SWAPPED_COLORS:
+    return shape_clone_swapped(s->shape, s->x, s->y);
+  case CLONE_AT_POSITION:
+  default:
+    return shape_clone(s->shape, s->x, s->y, NULL);
   }
-  case RECTANGLE: {
-    Rectangle r = (Rectangle)src->data;
-    int id = rectangle_get_id(r);
-    double w = rectangle_get_width(r);
-    double h = rectangle_get_height(r);
-    const char *fill = rectangle_get_fill_color(r);
-    Rectangle nr = rectangle_create(id, x, y, w, h, newBorderColor, fill);
-    cloned = make_shape_wrapper(RECTANGLE, nr);
-    break;
+}
+
+// Sends the shapes of a planned pair back to the ground, in plan order
+static void merge_pair_outcome(Qry_t *qry, PairOutcome_t *outcome,
+                               Ground ground) {
+  if (outcome->overlap) {
+    qry->crushedArea += outcome->crushedArea;
+  } else if (outcome->boxesOverlap) {
+    qry->narrowphaseRejects++;
+  } else {
+    qry->broadphaseRejects++;
+  }
+  for (int c = 0; c < outcome->cloneCount; c++) {
+    PlannedClone_t *planned = &outcome->clones[c];
+    Shape clone = planned->built ? planned->clone
+                                 : build_planned_clone(planned);
+    clone = track_ground_clone(clone, ground);
+    if (clone != NULL) {
+      queue_enqueue(qry->resolvedShapes, clone);
+    }
   }
-  case TEXT: {
-    Text t = (Text)src->data;
-    int id = text_get_id(t);
-    const char *fill = text_get_fill_color(t);
-    char anchor = text_get_anchor(t);
-    const char *txt = text_get_text(t);
-    Text nt = text_create(id, x, y, newBorderColor, fill, anchor, txt);
-    cloned = make_shape_wrapper(TEXT, nt);
-    break;
+}
+
+// Writes label, value and a line break to the report
+static void write_int_line(TextWriter report, const char *label, int value) {
+  text_writer_put_text(report, label);
+  text_writer_put_int(report, value);
+  text_writer_put_char(report, '\n');
+}
+
+// Writes label, value with the given decimals and a line break to the report
+static void write_fixed_line(TextWriter report, const char *label,
+                             double value, int decimals) {
+  text_writer_put_text(report, label);
+  text_writer_put_fixed(report, value, decimals);
+  text_writer_put_char(report, '\n');
+}
+
+// Returns the shooter of a slot, or NULL if no pd registered it yet
+static Shooter_t *find_shooter(Qry_t *qry, int slot) {
+  Shooter_t *shooter = &qry->shooters[slot];
+  return shooter->registered ? shooter : NULL;
+}
+
+// Creates the shapes stack of a loader the first time a command names it
+static void create_loader_stack(Loader_t *loader) {
+  if (loader->shapes == NULL) {
+    loader->shapes = stack_create();
+    if (loader->shapes == NULL) {
+      printf("Error: Failed to create stack for Loader\n");
+      exit(1);
+    }
   }
-  case LINE: {
-    Line l = (Line)src->data;
-    int id = line_get_id(l);
-    double dx = line_get_x2(l) - line_get_x1(l);
-    double dy = line_get_y2(l) - line_get_y1(l);
-    Line nl = line_create(id, x, y, x + dx, y + dy, newBorderColor);
-    cloned = make_shape_wrapper(LINE, nl);
-    break;
+}
+
+// Returns the shapes stack of a loader for a command that changes it. A
+// loader still sharing the stack of the run it was forked from gets its own
+// copy first, so the other branches of that run keep seeing the original.
+static Stack writable_loader_shapes(Loader_t *loader) {
+  if (loader->shared) {
+    Stack shapes = stack_copy(loader->shapes);
+    if (shapes == NULL) {
+      printf("Error: Failed to create stack for Loader\n");
+      exit(1);
+    }
+    loader->shapes = shapes;
+    loader->shared = false;
   }
-  case TEXT_STYLE:
-    return NULL;
+  return loader->shapes;
+}
+
+// Fires every shape of source, as repeated one-press shifts followed by a
+// shot would: the shape in the shooting position is displaced into target
+// by the first press, and shot k lands at (dx + k * incrementX,
+// dy + k * incrementY) from the shooter. The whole volley is appended to the
+// arena as one contiguous block of records.
+static void fire_volley(Shooter_t *shooter, Loader_t *source,
+                        Loader_t *target, double dx, double dy,
+                        double incrementX, double incrementY,
+                        Arena_t *arena, Discarded_t *discarded) {
+  Stack sourceShapes = source->shapes;
+  int count = stack_size(sourceShapes);
+  if (count == 0) {
+    return;
   }
+  sourceShapes = writable_loader_shapes(source);
 
-  // Add cloned shape to shapesStackToFree for proper cleanup
-  if (cloned != NULL && ground != NULL) {
-    stack_push(get_ground_shapes_stack_to_free(ground), cloned);
+  if (shooter->shootingPosition != NULL) {
+    if (target == source) {
+      // Pushed back onto the loader being fired, so it is shot first
+      count++;
+      stack_push(sourceShapes, shooter->shootingPosition);
+    } else if (target != NULL) {
+      stack_push(writable_loader_shapes(target), shooter->shootingPosition);
+    } else {
+      discard_shape(discarded, shooter->shootingPosition);
+    }
+    shooter->shootingPosition = NULL;
   }
 
-  return cloned;
+  ShapePositionOnArena_t *volley = arena_append(arena, count);
+
+  // Landing positions form an arithmetic progression; this loop has no
+  // calls or branches so the compiler can vectorize it
+  Scalar shooterX = shooter->x;
+  Scalar shooterY = shooter->y;
+  for (int k = 0; k < count; k++) {
+    volley[k].x = shooterX + (k * incrementX + dx);
+    volley[k].y = shooterY + (k * incrementY + dy);
+    volley[k].isAnnotated = false;
+    volley[k].shooterX = shooterX;
+    volley[k].shooterY = shooterY;
+  }
+
+  for (int k = 0; k < count; k++) {
+    volley[k].shape = (Shape)stack_pop(sourceShapes);
+  }
 }
 
-static Shape_t *clone_with_swapped_colors_at_position(Shape_t *src, double x,
-                                                      double y, Ground ground) {
-  if (src == NULL)
-    return NULL;
-  Shape_t *cloned = NULL;
-  switch (src->type) {
-  case CIRCLE: {
-    Circle c = (Circle)src->data;
-    int id = circle_get_id(c);
-    double r = circle_get_radius(c);
-    const char *border = circle_get_border_color(c);
-    const char *fill = circle_get_fill_color(c);
-    Circle nc = circle_create(id, x, y, r, fill, border);
-    cloned = make_shape_wrapper(CIRCLE, nc);
-    break;
+// Reserves count new records at the end of the arena and returns the first.
+// The returned block is only valid until the next append.
+static ShapePositionOnArena_t *arena_append(Arena_t *arena, int count) {
+  if (arena->count + count > arena->capacity) {
+    int newCapacity = arena->capacity > 0 ? arena->capacity * 2 : 64;
+    while (newCapacity < arena->count + count) {
+      newCapacity *= 2;
+    }
+    ShapePositionOnArena_t *records =
+        realloc(arena->records,
+                (size_t)newCapacity * sizeof(ShapePositionOnArena_t));
+    if (records == NULL) {
+      printf("Error: Failed to allocate memory for ShapePositionOnArena\n");
+      exit(1);
+    }
+    arena->records = records;
+    arena->capacity = newCapacity;
   }
-  case RECTANGLE: {
-    Rectangle r = (Rectangle)src->data;
-    int id = rectangle_get_id(r);
-    double w = rectangle_get_width(r);
-    double h = rectangle_get_height(r);
-    const char *border = rectangle_get_border_color(r);
-    const char *fill = rectangle_get_fill_color(r);
-    Rectangle nr = rectangle_create(id, x, y, w, h, fill, border);
-    cloned = make_shape_wrapper(RECTANGLE, nr);
-    break;
+
+  ShapePositionOnArena_t *first = &arena->records[arena->count];
+  arena->count += count;
+  return first;
+}
+
+// Appends a shape to the discarded list of a group
+static void discard_shape(Discarded_t *discarded, Shape shape) {
+  if (discarded->count == discarded->capacity) {
+    int capacity = discarded->capacity > 0 ? discarded->capacity * 2 : 64;
+    Shape *shapes =
+        realloc(discarded->shapes, (size_t)capacity * sizeof(Shape));
+    if (shapes == NULL) {
+      printf("Error: Failed to allocate memory for discarded shapes\n");
+      exit(1);
+    }
+    discarded->shapes = shapes;
+    discarded->capacity = capacity;
   }
-  case TEXT: {
-    Text t = (Text)src->data;
-    int id = text_get_id(t);
-    const char *border = text_get_border_color(t);
-    const char *fill = text_get_fill_color(t);
-    char anchor = text_get_anchor(t);
-    const char *txt = text_get_text(t);
-    Text nt = text_create(id, x, y, fill, border, anchor, txt);
-    cloned = make_shape_wrapper(TEXT, nt);
+  discarded->shapes[discarded->count++] = shape;
+}
+
+
+// =====================
+// Helpers implementation
+// =====================
+
+// Writes the box of an arena record, its cached local-space box translated
+// to the arena position, into column k of batch
+static void store_arena_box(const ShapePositionOnArena_t *s, AabbBatch batch,
+                            int k) {
+  Scalar minX, minY, maxX, maxY;
+  shape_fast_get_local_bounds(s->shape, &minX, &minY, &maxX, &maxY);
+  batch[AABB_MIN_X][k] = minX + s->x;
+  batch[AABB_MIN_Y][k] = minY + s->y;
+  batch[AABB_MAX_X][k] = maxX + s->x;
+  batch[AABB_MAX_Y][k] = maxY + s->y;
+}
+
+// Describes the exact geometry of an arena record. Lines and texts are
+// segments 2.0 wide, following the same rule as their bounding boxes
+static void make_collider(const ShapePositionOnArena_t *s,
+                          Collider_t *collider) {
+  void *data = shape_fast_get_data(s->shape);
+  Scalar minX, minY, maxX, maxY;
+  shape_fast_get_local_bounds(s->shape, &minX, &minY, &maxX, &maxY);
+
+  switch (shape_fast_get_type(s->shape)) {
+  case CIRCLE:
+    collider->kind = COLLIDER_CIRCLE;
+    collider->x1 = s->x;
+    collider->y1 = s->y;
+    collider->radius = circle_fast_get_radius((Circle)data);
     break;
-  }
   case LINE: {
-    Line l = (Line)src->data;
-    int id = line_get_id(l);
-    double dx = line_get_x2(l) - line_get_x1(l);
-    double dy = line_get_y2(l) - line_get_y1(l);
-    const char *c = line_get_color(l);
-    char *inv = invert_color(c);
-    if (inv == NULL)
-      return NULL;
-    Line nl = line_create(id, x, y, x + dx, y + dy, inv);
-    free(inv);
-    cloned = make_shape_wrapper(LINE, nl);
+    Line line = (Line)data;
+    collider->kind = COLLIDER_SEGMENT;
+    collider->x1 = s->x;
+    collider->y1 = s->y;
+    collider->x2 = s->x + (line_fast_get_x2(line) - line_fast_get_x1(line));
+    collider->y2 = s->y + (line_fast_get_y2(line) - line_fast_get_y1(line));
+    collider->radius = 1.0;
     break;
   }
+  case TEXT:
+    // Horizontal segment through the anchor; the box adds 1.0 at each end
+    collider->kind = COLLIDER_SEGMENT;
+    collider->x1 = s->x + (minX + 1.0);
+    collider->y1 = s->y;
+    collider->x2 = s->x + (maxX - 1.0);
+    collider->y2 = s->y;
+    collider->radius = 1.0;
+    break;
+  case RECTANGLE:
   case TEXT_STYLE:
-    return NULL;
+  default:
+    collider->kind = COLLIDER_BOX;
+    collider->x1 = s->x + minX;
+    collider->y1 = s->y + minY;
+    collider->x2 = s->x + maxX;
+    collider->y2 = s->y + maxY;
+    collider->radius = 0.0;
+    break;
   }
+}
 
-  // Add cloned shape to shapesStackToFree for proper cleanup
-  if (cloned != NULL && ground != NULL) {
-    stack_push(get_ground_shapes_stack_to_free(ground), cloned);
+// Narrowphase: exact overlap of two records whose boxes already overlap
+static bool shapes_touch(const ShapePositionOnArena_t *a,
+                         const ShapePositionOnArena_t *b) {
+  Collider_t first, second;
+  make_collider(a, &first);
+  make_collider(b, &second);
+  // Order the pair by kind so each combination has a single case
+  Collider_t *p = first.kind <= second.kind ? &first : &second;
+  Collider_t *q = first.kind <= second.kind ? &second : &first;
+
+  switch (p->kind) {
+  case COLLIDER_CIRCLE:
+    if (q->kind == COLLIDER_CIRCLE)
+      return collision_circle_circle(p->x1, p->y1, p->radius, q->x1, q->y1,
+                                     q->radius);
+    if (q->kind == COLLIDER_BOX)
+      return collision_circle_box(p->x1, p->y1, p->radius, q->x1, q->y1,
+                                  q->x2, q->y2);
+    return collision_segment_circle(q->x1, q->y1, q->x2, q->y2, q->radius,
+                                    p->x1, p->y1, p->radius);
+  case COLLIDER_BOX:
+    // Two boxes overlap exactly when their bounding boxes do
+    if (q->kind == COLLIDER_BOX)
+      return true;
+    return collision_segment_box(q->x1, q->y1, q->x2, q->y2, q->radius,
+                                 p->x1, p->y1, p->x2, p->y2);
+  case COLLIDER_SEGMENT:
+  default:
+    return collision_segment_segment(p->x1, p->y1, p->x2, p->y2, q->x1,
+                                     q->y1, q->x2, q->y2,
+                                     p->radius + q->radius);
   }
+}
+
+// Exact test of a shape against an axis-aligned window
+static bool shape_touches_window(const ShapePositionOnArena_t *s,
+                                 const double window[4]) {
+  Collider_t collider;
+  make_collider(s, &collider);
+  switch (collider.kind) {
+  case COLLIDER_CIRCLE:
+    return collision_circle_box(collider.x1, collider.y1, collider.radius,
+                                window[0], window[1], window[2], window[3]);
+  case COLLIDER_SEGMENT:
+    return collision_segment_box(collider.x1, collider.y1, collider.x2,
+                                 collider.y2, collider.radius, window[0],
+                                 window[1], window[2], window[3]);
+  case COLLIDER_BOX:
+  default:
+    return true;
+  }
+}
 
+// =====================
+// Positioning helpers
+// =====================
+
+static Shape clone_with_position(Shape src, double x, double y,
+                                 Ground ground) {
+  return track_ground_clone(shape_clone(src, x, y, NULL), ground);
+}
+
+// Makes the ground own the cloned shape
+static Shape track_ground_clone(Shape cloned, Ground ground) {
+  if (cloned != NULL && ground != NULL) {
+    track_ground_shape(ground, cloned);
+  }
   return cloned;
 }
 
@@ -1361,7 +2361,7 @@ static Shape_t *clone_with_swapped_colors_at_position(Shape_t *src, double x,
 // SVG writer implementation
 // =====================
 static void write_qry_result_svg(FileData qryFileData, FileData geoFileData,
-                                 Ground ground, Stack arena,
+                                 Ground ground, const Arena_t *arena,
                                  const char *output_path) {
   const char *geo_name_src = get_file_name(geoFileData);
   const char *qry_name_src = get_file_name(qryFileData);
@@ -1378,8 +2378,8 @@ static void write_qry_result_svg(FileData qryFileData, FileData geoFileData,
   }
   strcpy(geo_base, geo_name_src);
   strcpy(qry_base, qry_name_src);
-  strtok(geo_base, ".");
-  strtok(qry_base, ".");
+  strip_extension(geo_base);
+  strip_extension(qry_base);
 
   // geoBase-qryBase.svg
   size_t path_len = strlen(output_path);
@@ -1403,8 +2403,8 @@ static void write_qry_result_svg(FileData qryFileData, FileData geoFileData,
     return;
   }
 
-  FILE *file = fopen(output_path_with_file, "w");
-  if (file == NULL) {
+  SvgWriter svg = svg_writer_open(output_path_with_file);
+  if (svg == NULL) {
     printf("Error: Failed to open file: %s\n", output_path_with_file);
     free(output_path_with_file);
     free(geo_base);
@@ -1412,176 +2412,151 @@ static void write_qry_result_svg(FileData qryFileData, FileData geoFileData,
     return;
   }
 
-  fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-  fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 1000 "
-                "1000\">\n");
+  // Render remaining shapes from Ground, leaving them in place
+  for_each_ground_shape(ground, write_ground_shape_svg, svg);
 
-  // Render remaining shapes from Ground without destroying the queue
-  Queue groundQueue = get_ground_queue(ground);
-  Queue tempQueue = queue_create();
-  while (!queue_is_empty(groundQueue)) {
-    Shape_t *shape = (Shape_t *)queue_dequeue(groundQueue);
+  // Render shapes and annotations from arena, most recent launch first
+  for (int i = arena->count - 1; i >= 0; i--) {
+    const ShapePositionOnArena_t *s = &arena->records[i];
+    // Render the shape at its arena position
+    Shape shape = s->shape;
     if (shape != NULL) {
-      if (shape->type == CIRCLE) {
-        Circle circle = (Circle)shape->data;
-        fprintf(file,
-                "<circle cx='%.2f' cy='%.2f' r='%.2f' fill='%s' stroke='%s' "
-                "fill-opacity='0.5'/>\n",
-                circle_get_x(circle), circle_get_y(circle),
-                circle_get_radius(circle), circle_get_fill_color(circle),
-                circle_get_border_color(circle));
-      } else if (shape->type == RECTANGLE) {
-        Rectangle rectangle = (Rectangle)shape->data;
-        fprintf(file,
-                "<rect x='%.2f' y='%.2f' width='%.2f' height='%.2f' fill='%s' "
-                "stroke='%s' fill-opacity='0.5'/>\n",
-                rectangle_get_x(rectangle), rectangle_get_y(rectangle),
-                rectangle_get_width(rectangle), rectangle_get_height(rectangle),
-                rectangle_get_fill_color(rectangle),
-                rectangle_get_border_color(rectangle));
-      } else if (shape->type == LINE) {
-        Line line = (Line)shape->data;
-        fprintf(file,
-                "<line x1='%.2f' y1='%.2f' x2='%.2f' y2='%.2f' stroke='%s'/>\n",
-                line_get_x1(line), line_get_y1(line), line_get_x2(line),
-                line_get_y2(line), line_get_color(line));
-      } else if (shape->type == TEXT) {
-        Text text = (Text)shape->data;
-        char anchor = text_get_anchor(text);
-        const char *text_anchor = "start";
-        if (anchor == 'm' || anchor == 'M') {
-          text_anchor = "middle";
-        } else if (anchor == 'e' || anchor == 'E') {
-          text_anchor = "end";
-        } else if (anchor == 's' || anchor == 'S') {
-          text_anchor = "start";
-        }
-        fprintf(file,
-                "<text x='%.2f' y='%.2f' fill='%s' stroke='%s' "
-                "text-anchor='%s' fill-opacity='0.5'>%s</text>\n",
-                text_get_x(text), text_get_y(text), text_get_fill_color(text),
-                text_get_border_color(text), text_anchor, text_get_text(text));
-      }
+      svg_writers[shape_fast_get_type(shape)](svg, shape_fast_get_data(shape),
+                                               s);
     }
-    queue_enqueue(tempQueue, shape);
-  }
-  // restore ground queue
-  while (!queue_is_empty(tempQueue)) {
-    queue_enqueue(groundQueue, queue_dequeue(tempQueue));
-  }
-  queue_destroy(tempQueue);
-
-  // Render shapes and annotations from arena without destroying the stack
-  Stack tempStack = stack_create();
-  while (!stack_is_empty(arena)) {
-    ShapePositionOnArena_t *s = (ShapePositionOnArena_t *)stack_pop(arena);
-    if (s != NULL) {
-      // Render the shape at its arena position
-      Shape_t *shape = s->shape;
-      if (shape != NULL) {
-        if (shape->type == CIRCLE) {
-          Circle circle = (Circle)shape->data;
-          fprintf(file,
-                  "<circle cx='%.2f' cy='%.2f' r='%.2f' fill='%s' stroke='%s' "
-                  "fill-opacity='0.5'/>\n",
-                  s->x, s->y, circle_get_radius(circle),
-                  circle_get_fill_color(circle),
-                  circle_get_border_color(circle));
-        } else if (shape->type == RECTANGLE) {
-          Rectangle rectangle = (Rectangle)shape->data;
-          fprintf(
-              file,
-              "<rect x='%.2f' y='%.2f' width='%.2f' height='%.2f' fill='%s' "
-              "stroke='%s' fill-opacity='0.5'/>\n",
-              s->x, s->y, rectangle_get_width(rectangle),
-              rectangle_get_height(rectangle),
-              rectangle_get_fill_color(rectangle),
-              rectangle_get_border_color(rectangle));
-        } else if (shape->type == LINE) {
-          Line line = (Line)shape->data;
-          double dx = line_get_x2(line) - line_get_x1(line);
-          double dy = line_get_y2(line) - line_get_y1(line);
-          fprintf(
-              file,
-              "<line x1='%.2f' y1='%.2f' x2='%.2f' y2='%.2f' stroke='%s'/>\n",
-              s->x, s->y, s->x + dx, s->y + dy, line_get_color(line));
-        } else if (shape->type == TEXT) {
-          Text text = (Text)shape->data;
-          char anchor = text_get_anchor(text);
-          const char *text_anchor = "start";
-          if (anchor == 'm' || anchor == 'M') {
-            text_anchor = "middle";
-          } else if (anchor == 'e' || anchor == 'E') {
-            text_anchor = "end";
-          } else if (anchor == 's' || anchor == 'S') {
-            text_anchor = "start";
-          }
-          fprintf(file,
-                  "<text x='%.2f' y='%.2f' fill='%s' stroke='%s' "
-                  "text-anchor='%s' fill-opacity='0.5'>%s</text>\n",
-                  s->x, s->y, text_get_fill_color(text),
-                  text_get_border_color(text), text_anchor,
-                  text_get_text(text));
-        }
-      }
 
-      // Render annotations if enabled
-      if (s->isAnnotated) {
-        // dashed line from shooter to landed position
-        fprintf(file,
-                "<line x1='%.2f' y1='%.2f' x2='%.2f' y2='%.2f' stroke='red' "
-                "stroke-dasharray='4,2' stroke-width='1'/>\n",
-                s->shooterX, s->shooterY, s->x, s->y);
-        // small circle marker at landed position
-        fprintf(file,
-                "<circle cx='%.2f' cy='%.2f' r='3' fill='none' stroke='red' "
-                "stroke-width='1'/>\n",
-                s->x, s->y);
-
-        // dimension guides (horizontal then vertical) and labels (dx, dy)
-        double dx = s->x - s->shooterX;
-        double dy = s->y - s->shooterY;
-        double midHx = s->shooterX + dx * 0.5;
-        double midHy = s->shooterY;
-        double midVx = s->x;
-        double midVy = s->shooterY + dy * 0.5;
-
-        // horizontal guide
-        fprintf(file,
-                "<line x1='%.2f' y1='%.2f' x2='%.2f' y2='%.2f' stroke='purple' "
-                "stroke-dasharray='2,2' stroke-width='0.8'/>\n",
-                s->shooterX, s->shooterY, s->x, s->shooterY);
-        // vertical guide
-        fprintf(file,
-                "<line x1='%.2f' y1='%.2f' x2='%.2f' y2='%.2f' stroke='purple' "
-                "stroke-dasharray='2,2' stroke-width='0.8'/>\n",
-                s->x, s->shooterY, s->x, s->y);
-
-        // dx label above horizontal guide
-        fprintf(file,
-                "<text x='%.2f' y='%.2f' fill='purple' font-size='12' "
-                "text-anchor='middle'>%.2f</text>\n",
-                midHx, midHy - 5.0, dx);
-
-        // dy label rotated near vertical guide
-        fprintf(file,
-                "<text x='%.2f' y='%.2f' fill='purple' font-size='12' "
-                "text-anchor='middle' transform='rotate(-90 %.2f "
-                "%.2f)'>%.2f</text>\n",
-                midVx + 10.0, midVy, midVx + 10.0, midVy, dy);
-      }
+    // Render annotations if enabled
+    if (s->isAnnotated) {
+      // dashed line from shooter to landed position
+      svg_writer_line(svg, s->shooterX, s->shooterY, s->x, s->y, "red");
+      svg_writer_attribute(svg, "stroke-dasharray", "4,2");
+      svg_writer_attribute(svg, "stroke-width", "1");
+      svg_writer_end(svg);
+      // small circle marker at landed position
+      svg_writer_begin(svg, "circle");
+      svg_writer_number(svg, "cx", s->x);
+      svg_writer_number(svg, "cy", s->y);
+      svg_writer_attribute(svg, "r", "3");
+      svg_writer_attribute(svg, "fill", "none");
+      svg_writer_attribute(svg, "stroke", "red");
+      svg_writer_attribute(svg, "stroke-width", "1");
+      svg_writer_end(svg);
+
+      // dimension guides (horizontal then vertical) and labels (dx, dy)
+      double dx = s->x - s->shooterX;
+      double dy = s->y - s->shooterY;
+      double midHx = s->shooterX + dx * 0.5;
+      double midHy = s->shooterY;
+      double midVx = s->x;
+      double midVy = s->shooterY + dy * 0.5;
+
+      // horizontal guide
+      svg_writer_line(svg, s->shooterX, s->shooterY, s->x, s->shooterY,
+                      "purple");
+      svg_writer_attribute(svg, "stroke-dasharray", "2,2");
+      svg_writer_attribute(svg, "stroke-width", "0.8");
+      svg_writer_end(svg);
+      // vertical guide
+      svg_writer_line(svg, s->x, s->shooterY, s->x, s->y, "purple");
+      svg_writer_attribute(svg, "stroke-dasharray", "2,2");
+      svg_writer_attribute(svg, "stroke-width", "0.8");
+      svg_writer_end(svg);
+
+      // dx label above horizontal guide
+      svg_writer_begin(svg, "text");
+      svg_writer_number(svg, "x", midHx);
+      svg_writer_number(svg, "y", midHy - 5.0);
+      svg_writer_attribute(svg, "fill", "purple");
+      svg_writer_attribute(svg, "font-size", "12");
+      svg_writer_attribute(svg, "text-anchor", "middle");
+      svg_writer_number_content(svg, dx);
+
+      // dy label rotated near vertical guide
+      svg_writer_begin(svg, "text");
+      svg_writer_number(svg, "x", midVx + 10.0);
+      svg_writer_number(svg, "y", midVy);
+      svg_writer_attribute(svg, "fill", "purple");
+      svg_writer_attribute(svg, "font-size", "12");
+      svg_writer_attribute(svg, "text-anchor", "middle");
+      svg_writer_rotate(svg, -90, midVx + 10.0, midVy);
+      svg_writer_number_content(svg, dy);
     }
-    stack_push(tempStack, s);
-  }
-  // restore arena stack (original order)
-  while (!stack_is_empty(tempStack)) {
-    stack_push(arena, stack_pop(tempStack));
   }
-  stack_destroy(tempStack);
 
-  fprintf(file, "</svg>\n");
-  fclose(file);
+  svg_writer_close(svg);
   free(output_path_with_file);
   free(geo_base);
   free(qry_base);
-}
\ No newline at end of file
+}
+
+// Draws a shape of the ground at its own position
+static void write_ground_shape_svg(void *shape, void *ctx) {
+  if (shape != NULL) {
+    svg_writers[shape_fast_get_type(shape)]((SvgWriter)ctx,
+                                             shape_fast_get_data(shape), NULL);
+  }
+}
+
+static void write_circle_svg(SvgWriter svg, void *data,
+                             const ShapePositionOnArena_t *placement) {
+  Circle circle = (Circle)data;
+  double x = placement != NULL ? placement->x : circle_fast_get_x(circle);
+  double y = placement != NULL ? placement->y : circle_fast_get_y(circle);
+  svg_writer_circle(svg, x, y, circle_fast_get_radius(circle),
+                    circle_fast_get_fill_color(circle),
+                    circle_fast_get_border_color(circle));
+  svg_writer_attribute(svg, "fill-opacity", "0.5");
+  svg_writer_end(svg);
+}
+
+static void write_rectangle_svg(SvgWriter svg, void *data,
+                                const ShapePositionOnArena_t *placement) {
+  Rectangle rectangle = (Rectangle)data;
+  double x = placement != NULL ? placement->x : rectangle_fast_get_x(rectangle);
+  double y = placement != NULL ? placement->y : rectangle_fast_get_y(rectangle);
+  svg_writer_rect(svg, x, y, rectangle_fast_get_width(rectangle),
+                  rectangle_fast_get_height(rectangle),
+                  rectangle_fast_get_fill_color(rectangle),
+                  rectangle_fast_get_border_color(rectangle));
+  svg_writer_attribute(svg, "fill-opacity", "0.5");
+  svg_writer_end(svg);
+}
+
+static void write_line_svg(SvgWriter svg, void *data,
+                           const ShapePositionOnArena_t *placement) {
+  Line line = (Line)data;
+  double x1 = line_fast_get_x1(line);
+  double y1 = line_fast_get_y1(line);
+  double x2 = line_fast_get_x2(line);
+  double y2 = line_fast_get_y2(line);
+  if (placement != NULL) {
+    // Keep the line vector, starting at the arena position
+    double dx = x2 - x1;
+    double dy = y2 - y1;
+    x1 = placement->x;
+    y1 = placement->y;
+    x2 = placement->x + dx;
+    y2 = placement->y + dy;
+  }
+  svg_writer_line(svg, x1, y1, x2, y2, line_fast_get_color(line));
+  svg_writer_end(svg);
+}
+
+static void write_text_svg(SvgWriter svg, void *data,
+                           const ShapePositionOnArena_t *placement) {
+  Text text = (Text)data;
+  double x = placement != NULL ? placement->x : text_fast_get_x(text);
+  double y = placement != NULL ? placement->y : text_fast_get_y(text);
+  svg_writer_text(svg, x, y, text_fast_get_fill_color(text),
+                  text_fast_get_border_color(text), text_fast_get_anchor(text));
+  svg_writer_attribute(svg, "fill-opacity", "0.5");
+  svg_writer_content(svg, text_fast_get_text(text));
+}
+
+static void write_text_style_svg(SvgWriter svg, void *data,
+                                 const ShapePositionOnArena_t *placement) {
+  // Style descriptors are not drawn
+  (void)svg;
+  (void)data;
+  (void)placement;
+}
@@ -10,6 +10,7 @@
 #define QRY_HANDLER_H
 #include "../file_reader/file_reader.h"
 #include "../geo_handler/geo_handler.h"
+#include "../qry_program/qry_program.h"
 
 /**
  * @brief Opaque pointer type for query instances
@@ -17,15 +18,111 @@
 typedef void *Qry;
 
 /**
- * @brief Executes commands from a .qry file and processes queries
- * @param qryFileData File data containing .qry file lines
+ * @brief Executes a compiled .qry program and processes queries
+ * @param program Program compiled from the .qry file; it is only read, so
+ *        it may run again against other scenes
+ * @param qryFileData File data of the .qry file, used to name the outputs
  * @param geoFileData File data containing .geo file lines
  * @param ground Ground instance with all geometric shapes
  * @param output_path Path to the output file
  * @return Qry instance or NULL on error
  */
-Qry execute_qry_commands(FileData qryFileData, FileData geoFileData,
-                         Ground ground, const char *output_path);
+Qry execute_qry_program(QryProgram program, FileData qryFileData,
+                        FileData geoFileData, Ground ground,
+                        const char *output_path);
+
+/**
+ * @brief Executes a compiled .qry program, saving snapshots of its state
+ *
+ * Every interval instructions the state of the run (ground queue, shooters,
+ * loaders, arena and running totals) is saved to checkpoint_path, along
+ * with the size of the .txt report by then. A run given resume_path starts
+ * from the instruction after that snapshot instead of the first one: the
+ * ground must be empty (see create_ground) and receives the saved shapes,
+ * and the report is cut back to its saved size before the run goes on.
+ *
+ * @param program Program compiled from the .qry file
+ * @param qryFileData File data of the .qry file, used to name the outputs
+ * @param geoFileData File data of the .geo file, used to name the outputs
+ * @param ground Ground instance, empty when resuming
+ * @param output_path Path to the output file
+ * @param resume_path Snapshot to resume from, or NULL to start from the
+ *        first command
+ * @param checkpoint_path Snapshot file to save, or NULL to save none
+ * @param interval Instructions run between two snapshots
+ * @return Qry instance or NULL on error
+ */
+Qry execute_qry_program_checkpointed(QryProgram program, FileData qryFileData,
+                                     FileData geoFileData, Ground ground,
+                                     const char *output_path,
+                                     const char *resume_path,
+                                     const char *checkpoint_path,
+                                     int interval);
+
+/**
+ * @brief Runs several compiled .qry programs against the same ground
+ *
+ * Each run gets its own view of the ground (see fork_ground) and writes the
+ * outputs execute_qry_program would, so the .qry files should have distinct
+ * names. Runs are spread over worker threads, each thread taking the next
+ * pending run, and the ground itself is left unchanged.
+ *
+ * @param programs Programs compiled from the .qry files
+ * @param qryFileDatas File data of each .qry file, used to name the outputs
+ * @param count Number of programs
+ * @param geoFileData File data containing .geo file lines
+ * @param ground Ground instance shared by every run
+ * @param output_path Path to the output file
+ */
+void execute_qry_matches(QryProgram *programs, FileData *qryFileDatas,
+                         int count, FileData geoFileData, Ground ground,
+                         const char *output_path);
+
+/**
+ * @brief Continues a finished run with another program, on a fork of it
+ *
+ * The branch starts from the state base ended with: its shooters, loaders,
+ * arena and running totals. Shapes are shared with base, and so are the
+ * loader stacks until a command of the branch changes them, so forking
+ * costs about the size of the arena. The report of the branch only covers
+ * its own commands. base and the ground it ran against must outlive the
+ * branch and stay unchanged while it exists; branches of the same run may
+ * run on different threads, and a branch may be continued again.
+ *
+ * @param base Run returned by execute_qry_program or execute_qry_branch
+ * @param program Program compiled by qry_program_compile_continuation from
+ *        the program of base
+ * @param qryFileData File data of the .qry file, used to name the outputs
+ * @param geoFileData File data of the .geo file, used to name the outputs
+ * @param ground View of the ground of base (see fork_ground)
+ * @param output_path Path to the output file
+ * @return Qry instance of the branch, or NULL if program does not continue
+ *         the program of base
+ */
+Qry execute_qry_branch(Qry base, QryProgram program, FileData qryFileData,
+                       FileData geoFileData, Ground ground,
+                       const char *output_path);
+
+/**
+ * @brief Runs several branches of a finished run concurrently
+ *
+ * Each program runs as execute_qry_branch would, on its own fork of base
+ * and its own view of ground, spread over worker threads like
+ * execute_qry_matches. base and ground are left unchanged.
+ *
+ * @param base Run the programs continue
+ * @param programs Programs compiled by qry_program_compile_continuation
+ *        from the program of base
+ * @param qryFileDatas File data of each .qry file, used to name the outputs
+ * @param count Number of programs
+ * @param geoFileData File data of the .geo file, used to name the outputs
+ * @param ground Ground base ran against
+ * @param output_path Path to the output file
+ */
+void execute_qry_branches(Qry base, QryProgram *programs,
+                          FileData *qryFileDatas, int count,
+                          FileData geoFileData, Ground ground,
+                          const char *output_path);
 
 /**
  * @brief Destroys the query instance and frees all associated memory
@@ -0,0 +1,607 @@
+#include "qry_program.h"
+#include "../commons/int_map/int_map.h"
+#include "../commons/queue/queue.h"
+#include "qry_program_internal.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bump when the instruction layout or the meaning of its fields changes
+#define QRY_PROGRAM_VERSION 1
+
+// Fixed-size start of a cache file; the instructions, the shooter ids, the
+// loader ids and the strings follow, in this order
+typedef struct {
+  char magic[4]; // "QRYP"
+  int version;
+  int instructionSize; // sizeof(QryInstruction) in the build that wrote it
+  uint64_t sourceHash;
+  int lineCount;
+  int count;
+  int shooterCount;
+  int loaderCount;
+  int stringsSize;
+} QryProgramHeader;
+
+// State of a compilation; ids are mapped to slot + 1, so that NULL means
+// an id not seen yet
+typedef struct {
+  struct QryProgram *program;
+  IntMap shooterSlots;
+  IntMap loaderSlots;
+  char *line; // copy of the line being compiled, tokenized in place
+  size_t lineCapacity;
+} QryCompiler;
+
+// private functions
+static struct QryProgram *qry_program_alloc(void);
+static QryProgram compile_program(const struct QryProgram *prefix,
+                                  FileData qryFileData);
+static void compile_line(void *data, void *ctx);
+static bool compile_command(QryCompiler *compiler, const char *command,
+                           QryInstruction *in);
+static QryInstruction *append_instruction(struct QryProgram *program);
+static int slot_of(IntMap slots, int id, int **ids, int *count,
+                   int *capacity);
+static QryButton parse_button(const char *button);
+static int add_text(struct QryProgram *program, const char *first,
+                    const char *second);
+static void hash_line(void *data, void *ctx);
+static uint64_t hash_source(FileData qryFileData);
+static bool read_array(FILE *file, void **array, size_t size, int count);
+static bool is_valid_program(const struct QryProgram *program);
+
+/**
+ * Compiles the lines of a .qry file
+ * @param qryFileData File data containing .qry file lines
+ * @return New program or NULL on error
+ */
+QryProgram qry_program_compile(FileData qryFileData) {
+  return compile_program(NULL, qryFileData);
+}
+
+/**
+ * Compiles the lines of a .qry file continuing another program
+ * @param prefix Program whose slots are kept
+ * @param qryFileData File data containing .qry file lines
+ * @return New program or NULL on error
+ */
+QryProgram qry_program_compile_continuation(QryProgram prefix,
+                                            FileData qryFileData) {
+  if (prefix == NULL) {
+    return NULL;
+  }
+  return compile_program((const struct QryProgram *)prefix, qryFileData);
+}
+
+/**
+ * Loads a program saved by qry_program_save
+ * @param path Path of the cache file
+ * @param qryFileData File data of the .qry the program must come from
+ * @return Loaded program, or NULL if missing, unreadable or stale
+ */
+QryProgram qry_program_load(const char *path, FileData qryFileData) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  QryProgramHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, "QRYP", 4) != 0 ||
+      header.version != QRY_PROGRAM_VERSION ||
+      header.instructionSize != (int)sizeof(QryInstruction) ||
+      header.sourceHash != hash_source(qryFileData) || header.count < 0 ||
+      header.shooterCount < 0 || header.loaderCount < 0 ||
+      header.stringsSize < 0) {
+    fclose(file);
+    return NULL;
+  }
+
+  struct QryProgram *program = qry_program_alloc();
+  if (program == NULL) {
+    fclose(file);
+    return NULL;
+  }
+  program->sourceHash = header.sourceHash;
+  program->lineCount = header.lineCount;
+  bool loaded =
+      read_array(file, (void **)&program->code, sizeof(QryInstruction),
+                 header.count) &&
+      read_array(file, (void **)&program->shooterIds, sizeof(int),
+                 header.shooterCount) &&
+      read_array(file, (void **)&program->loaderIds, sizeof(int),
+                 header.loaderCount) &&
+      read_array(file, (void **)&program->strings, 1, header.stringsSize);
+  fclose(file);
+  program->count = program->capacity = header.count;
+  program->shooterCount = program->shooterCapacity = header.shooterCount;
+  program->loaderCount = program->loaderCapacity = header.loaderCount;
+  program->stringsSize = program->stringsCapacity = header.stringsSize;
+
+  if (!loaded || !is_valid_program(program)) {
+    qry_program_destroy(program);
+    return NULL;
+  }
+  return program;
+}
+
+/**
+ * Saves a program to a cache file
+ * @param program Program instance
+ * @param path Path of the cache file
+ * @return true if successful, false if the file could not be written
+ */
+bool qry_program_save(QryProgram program, const char *path) {
+  if (program == NULL) {
+    return false;
+  }
+
+  struct QryProgram *p = (struct QryProgram *)program;
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  QryProgramHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "QRYP", 4);
+  header.version = QRY_PROGRAM_VERSION;
+  header.instructionSize = (int)sizeof(QryInstruction);
+  header.sourceHash = p->sourceHash;
+  header.lineCount = p->lineCount;
+  header.count = p->count;
+  header.shooterCount = p->shooterCount;
+  header.loaderCount = p->loaderCount;
+  header.stringsSize = p->stringsSize;
+
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(p->code, sizeof(QryInstruction), (size_t)p->count, file) ==
+          (size_t)p->count &&
+      fwrite(p->shooterIds, sizeof(int), (size_t)p->shooterCount, file) ==
+          (size_t)p->shooterCount &&
+      fwrite(p->loaderIds, sizeof(int), (size_t)p->loaderCount, file) ==
+          (size_t)p->loaderCount &&
+      fwrite(p->strings, 1, (size_t)p->stringsSize, file) ==
+          (size_t)p->stringsSize;
+  if (fclose(file) != 0) {
+    written = false;
+  }
+  if (!written) {
+    remove(path);
+  }
+  return written;
+}
+
+/**
+ * Gets the number of instructions of a program
+ * @param program Program instance
+ * @return Number of instructions, 0 if program is NULL
+ */
+int qry_program_size(QryProgram program) {
+  if (program == NULL) {
+    return 0;
+  }
+  return ((struct QryProgram *)program)->count;
+}
+
+/**
+ * Destroys a program and frees its memory
+ * @param program Program instance to destroy
+ */
+void qry_program_destroy(QryProgram program) {
+  if (program == NULL) {
+    return;
+  }
+
+  struct QryProgram *p = (struct QryProgram *)program;
+  free(p->code);
+  free(p->shooterIds);
+  free(p->loaderIds);
+  free(p->strings);
+  free(p);
+}
+
+/**
+ * *** Private functions ***
+ */
+
+static struct QryProgram *qry_program_alloc(void) {
+  struct QryProgram *program = malloc(sizeof(struct QryProgram));
+  if (program == NULL) {
+    return NULL;
+  }
+  *program = (struct QryProgram){.code = NULL,
+                                 .count = 0,
+                                 .capacity = 0,
+                                 .shooterIds = NULL,
+                                 .shooterCount = 0,
+                                 .shooterCapacity = 0,
+                                 .loaderIds = NULL,
+                                 .loaderCount = 0,
+                                 .loaderCapacity = 0,
+                                 .strings = NULL,
+                                 .stringsSize = 0,
+                                 .stringsCapacity = 0,
+                                 .lineCount = 0,
+                                 .sourceHash = 0};
+  return program;
+}
+
+// Compiles the lines of a .qry; the slots of prefix, if any, are given to
+// the same ids first and its lines are counted before these
+static QryProgram compile_program(const struct QryProgram *prefix,
+                                  FileData qryFileData) {
+  struct QryProgram *program = qry_program_alloc();
+  if (program == NULL) {
+    return NULL;
+  }
+
+  QryCompiler compiler = {.program = program,
+                          .shooterSlots = int_map_create(),
+                          .loaderSlots = int_map_create(),
+                          .line = NULL,
+                          .lineCapacity = 0};
+  if (compiler.shooterSlots == NULL || compiler.loaderSlots == NULL) {
+    printf("Error: Failed to allocate memory for QryProgram\n");
+    exit(1);
+  }
+  if (prefix != NULL) {
+    program->lineCount = prefix->lineCount;
+    for (int slot = 0; slot < prefix->shooterCount; slot++) {
+      slot_of(compiler.shooterSlots, prefix->shooterIds[slot],
+              &program->shooterIds, &program->shooterCount,
+              &program->shooterCapacity);
+    }
+    for (int slot = 0; slot < prefix->loaderCount; slot++) {
+      slot_of(compiler.loaderSlots, prefix->loaderIds[slot],
+              &program->loaderIds, &program->loaderCount,
+              &program->loaderCapacity);
+    }
+  }
+  program->sourceHash = hash_source(qryFileData);
+  queue_for_each(get_file_lines_queue(qryFileData), compile_line, &compiler);
+
+  free(compiler.line);
+  int_map_destroy(compiler.shooterSlots, NULL);
+  int_map_destroy(compiler.loaderSlots, NULL);
+  return program;
+}
+
+// Compiles one line of the .qry; blank lines only count as lines
+static void compile_line(void *data, void *ctx) {
+  QryCompiler *compiler = (QryCompiler *)ctx;
+  const char *source = (const char *)data;
+  compiler->program->lineCount++;
+
+  size_t length = strlen(source) + 1;
+  if (length > compiler->lineCapacity) {
+    char *line = realloc(compiler->line, length);
+    if (line == NULL) {
+      printf("Error: Failed to allocate memory for QryProgram\n");
+      exit(1);
+    }
+    compiler->line = line;
+    compiler->lineCapacity = length;
+  }
+  memcpy(compiler->line, source, length);
+
+  char *command = strtok(compiler->line, " \t\r\n");
+  if (command == NULL || *command == '\0') {
+    return;
+  }
+
+  QryInstruction *in = append_instruction(compiler->program);
+  if (!compile_command(compiler, command, in) && in->op != QRY_OP_ERROR) {
+    const char *usage = "";
+    switch (in->op) {
+    case QRY_OP_PD:
+      usage = "pd expects an id, x and y";
+      break;
+    case QRY_OP_LC:
+      usage = "lc expects a loader id and a shape count";
+      break;
+    case QRY_OP_ATCH:
+      usage = "atch expects a shooter id and two loader ids";
+      break;
+    case QRY_OP_SHFT:
+      usage = "shft expects a shooter id, a button and a count";
+      break;
+    case QRY_OP_DSP:
+      usage = "dsp expects a shooter id, dx, dy and v or i";
+      break;
+    case QRY_OP_RJD:
+      usage = "rjd expects a shooter id, a button, dx, dy and increments";
+      break;
+    case QRY_OP_SEL:
+      usage = "sel expects x, y, width and height";
+      break;
+    case QRY_OP_PROX:
+      usage = "prox expects a shooter id, k and optionally dx and dy";
+      break;
+    default:
+      break;
+    }
+    in->op = QRY_OP_ERROR;
+    in->text = add_text(compiler->program, "Error: ", usage);
+  }
+}
+
+// Decodes the arguments of a command into in, tokenizing them as each
+// command always did. Returns false if arguments are missing, with in->op
+// telling the command; unknown commands become QRY_OP_ERROR.
+static bool compile_command(QryCompiler *compiler, const char *command,
+                            QryInstruction *in) {
+  struct QryProgram *p = compiler->program;
+
+  if (strcmp(command, "pd") == 0) {
+    in->op = QRY_OP_PD;
+    char *id = strtok(NULL, " ");
+    char *x = strtok(NULL, " ");
+    char *y = strtok(NULL, " ");
+    if (id == NULL || x == NULL || y == NULL) {
+      return false;
+    }
+    in->shooter = slot_of(compiler->shooterSlots, atoi(id), &p->shooterIds,
+                          &p->shooterCount, &p->shooterCapacity);
+    in->operand[0] = atof(x);
+    in->operand[1] = atof(y);
+  } else if (strcmp(command, "lc") == 0) {
+    in->op = QRY_OP_LC;
+    char *id = strtok(NULL, " ");
+    char *count = strtok(NULL, " ");
+    if (id == NULL || count == NULL) {
+      return false;
+    }
+    in->loader = slot_of(compiler->loaderSlots, atoi(id), &p->loaderIds,
+                         &p->loaderCount, &p->loaderCapacity);
+    in->count = atoi(count);
+  } else if (strcmp(command, "atch") == 0) {
+    in->op = QRY_OP_ATCH;
+    char *id = strtok(NULL, " ");
+    char *left = strtok(NULL, " ");
+    char *right = strtok(NULL, " ");
+    if (id == NULL || left == NULL || right == NULL) {
+      return false;
+    }
+    in->shooter = slot_of(compiler->shooterSlots, atoi(id), &p->shooterIds,
+                          &p->shooterCount, &p->shooterCapacity);
+    in->loader = slot_of(compiler->loaderSlots, atoi(left), &p->loaderIds,
+                         &p->loaderCount, &p->loaderCapacity);
+    in->rightLoader = slot_of(compiler->loaderSlots, atoi(right),
+                              &p->loaderIds, &p->loaderCount,
+                              &p->loaderCapacity);
+  } else if (strcmp(command, "shft") == 0) {
+    in->op = QRY_OP_SHFT;
+    char *id = strtok(NULL, " ");
+    char *button = strtok(NULL, " ");
+    char *times = strtok(NULL, " ");
+    if (id == NULL || button == NULL || times == NULL) {
+      return false;
+    }
+    in->shooter = slot_of(compiler->shooterSlots, atoi(id), &p->shooterIds,
+                          &p->shooterCount, &p->shooterCapacity);
+    in->button = parse_button(button);
+    in->text = add_text(p, button, "");
+    in->count = atoi(times);
+  } else if (strcmp(command, "dsp") == 0) {
+    in->op = QRY_OP_DSP;
+    char *id = strtok(NULL, " ");
+    char *dx = strtok(NULL, " ");
+    char *dy = strtok(NULL, " ");
+    char *annotate = strtok(NULL, " "); // this can be "v" or "i"
+    if (id == NULL || dx == NULL || dy == NULL || annotate == NULL) {
+      return false;
+    }
+    in->shooter = slot_of(compiler->shooterSlots, atoi(id), &p->shooterIds,
+                          &p->shooterCount, &p->shooterCapacity);
+    in->operand[0] = atof(dx);
+    in->operand[1] = atof(dy);
+    in->annotate = strcmp(annotate, "v") == 0;
+    in->text = add_text(p, annotate, "");
+  } else if (strcmp(command, "rjd") == 0) {
+    in->op = QRY_OP_RJD;
+    char *id = strtok(NULL, " ");
+    char *button = strtok(NULL, " ");
+    char *operands[4];
+    for (int i = 0; i < 4; i++) {
+      operands[i] = strtok(NULL, " ");
+    }
+    if (id == NULL || button == NULL || operands[3] == NULL) {
+      return false;
+    }
+    in->shooter = slot_of(compiler->shooterSlots, atoi(id), &p->shooterIds,
+                          &p->shooterCount, &p->shooterCapacity);
+    in->button = parse_button(button);
+    for (int i = 0; i < 4; i++) {
+      in->operand[i] = atof(operands[i]);
+    }
+  } else if (strcmp(command, "calc") == 0) {
+    in->op = QRY_OP_CALC;
+  } else if (strcmp(command, "sel") == 0) {
+    in->op = QRY_OP_SEL;
+    char *operands[4];
+    for (int i = 0; i < 4; i++) {
+      operands[i] = strtok(NULL, " \t\r\n");
+    }
+    if (operands[3] == NULL) {
+      return false;
+    }
+    for (int i = 0; i < 4; i++) {
+      in->operand[i] = atof(operands[i]);
+    }
+  } else if (strcmp(command, "prox") == 0) {
+    in->op = QRY_OP_PROX;
+    char *id = strtok(NULL, " \t\r\n");
+    char *k = strtok(NULL, " \t\r\n");
+    char *dx = strtok(NULL, " \t\r\n");
+    char *dy = strtok(NULL, " \t\r\n");
+    if (id == NULL || k == NULL || (dx != NULL && dy == NULL)) {
+      return false;
+    }
+    in->shooter = slot_of(compiler->shooterSlots, atoi(id), &p->shooterIds,
+                          &p->shooterCount, &p->shooterCapacity);
+    in->count = atoi(k);
+    in->operand[0] = dx != NULL ? atof(dx) : 0.0;
+    in->operand[1] = dy != NULL ? atof(dy) : 0.0;
+  } else if (strcmp(command, "sob") == 0) {
+    in->op = QRY_OP_SOB;
+  } else {
+    in->op = QRY_OP_ERROR;
+    in->text = add_text(p, "Unknown command: ", command);
+    return false;
+  }
+  return true;
+}
+
+static QryInstruction *append_instruction(struct QryProgram *program) {
+  if (program->count == program->capacity) {
+    int capacity = program->capacity > 0 ? program->capacity * 2 : 64;
+    QryInstruction *code =
+        realloc(program->code, (size_t)capacity * sizeof(QryInstruction));
+    if (code == NULL) {
+      printf("Error: Failed to allocate memory for QryProgram\n");
+      exit(1);
+    }
+    program->code = code;
+    program->capacity = capacity;
+  }
+
+  // Zeroed as a whole, padding included, so saved programs are
+  // reproducible
+  QryInstruction *in = &program->code[program->count++];
+  memset(in, 0, sizeof(QryInstruction));
+  in->shooter = -1;
+  in->loader = -1;
+  in->rightLoader = -1;
+  in->button = QRY_BUTTON_NONE;
+  in->text = -1;
+  return in;
+}
+
+// Returns the slot of id, giving it the next slot the first time it is seen
+static int slot_of(IntMap slots, int id, int **ids, int *count,
+                   int *capacity) {
+  intptr_t known = (intptr_t)int_map_get(slots, id);
+  if (known != 0) {
+    return (int)known - 1;
+  }
+
+  if (*count == *capacity) {
+    int newCapacity = *capacity > 0 ? *capacity * 2 : 16;
+    int *grown = realloc(*ids, (size_t)newCapacity * sizeof(int));
+    if (grown == NULL) {
+      printf("Error: Failed to allocate memory for QryProgram\n");
+      exit(1);
+    }
+    *ids = grown;
+    *capacity = newCapacity;
+  }
+  int slot = (*count)++;
+  (*ids)[slot] = id;
+  if (!int_map_put(slots, id, (void *)(intptr_t)(slot + 1))) {
+    printf("Error: Failed to allocate memory for QryProgram\n");
+    exit(1);
+  }
+  return slot;
+}
+
+static QryButton parse_button(const char *button) {
+  if (strcmp(button, "e") == 0) {
+    return QRY_BUTTON_LEFT;
+  }
+  if (strcmp(button, "d") == 0) {
+    return QRY_BUTTON_RIGHT;
+  }
+  return QRY_BUTTON_NONE;
+}
+
+// Stores first followed by second as one string and returns its offset
+static int add_text(struct QryProgram *program, const char *first,
+                    const char *second) {
+  int firstLength = (int)strlen(first);
+  int secondLength = (int)strlen(second);
+  int needed = program->stringsSize + firstLength + secondLength + 1;
+  if (needed > program->stringsCapacity) {
+    int capacity =
+        program->stringsCapacity > 0 ? program->stringsCapacity * 2 : 256;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    char *strings = realloc(program->strings, (size_t)capacity);
+    if (strings == NULL) {
+      printf("Error: Failed to allocate memory for QryProgram\n");
+      exit(1);
+    }
+    program->strings = strings;
+    program->stringsCapacity = capacity;
+  }
+
+  int offset = program->stringsSize;
+  memcpy(program->strings + offset, first, (size_t)firstLength);
+  memcpy(program->strings + offset + firstLength, second,
+         (size_t)secondLength + 1);
+  program->stringsSize = needed;
+  return offset;
+}
+
+// 64-bit FNV-1a over the lines, each followed by a line break
+static void hash_line(void *data, void *ctx) {
+  uint64_t *hash = (uint64_t *)ctx;
+  for (const unsigned char *c = data; *c != '\0'; c++) {
+    *hash = (*hash ^ *c) * 1099511628211ULL;
+  }
+  *hash = (*hash ^ '\n') * 1099511628211ULL;
+}
+
+static uint64_t hash_source(FileData qryFileData) {
+  uint64_t hash = 14695981039346656037ULL;
+  queue_for_each(get_file_lines_queue(qryFileData), hash_line, &hash);
+  return hash;
+}
+
+// Reads count elements of size bytes into a new array; an empty array is
+// left NULL
+static bool read_array(FILE *file, void **array, size_t size, int count) {
+  if (count == 0) {
+    return true;
+  }
+  *array = malloc(size * (size_t)count);
+  return *array != NULL && fread(*array, size, (size_t)count, file) ==
+                               (size_t)count;
+}
+
+// Checks that every slot and text of a loaded program is in range and
+// present where its command needs it, so a damaged cache file is rejected
+// instead of being run
+static bool is_valid_program(const struct QryProgram *program) {
+  if (program->stringsSize > 0 &&
+      program->strings[program->stringsSize - 1] != '\0') {
+    return false;
+  }
+  for (int i = 0; i < program->count; i++) {
+    const QryInstruction *in = &program->code[i];
+    if ((int)in->op < QRY_OP_PD || in->op > QRY_OP_ERROR ||
+        (int)in->button < QRY_BUTTON_NONE || in->button > QRY_BUTTON_RIGHT ||
+        in->shooter < -1 || in->shooter >= program->shooterCount ||
+        in->loader < -1 || in->loader >= program->loaderCount ||
+        in->rightLoader < -1 || in->rightLoader >= program->loaderCount ||
+        in->text < -1 || in->text >= program->stringsSize) {
+      return false;
+    }
+
+    bool needsShooter = in->op == QRY_OP_PD || in->op == QRY_OP_ATCH ||
+                        in->op == QRY_OP_SHFT || in->op == QRY_OP_DSP ||
+                        in->op == QRY_OP_RJD || in->op == QRY_OP_PROX;
+    bool needsText = in->op == QRY_OP_SHFT || in->op == QRY_OP_DSP ||
+                     in->op == QRY_OP_ERROR;
+    if ((needsShooter && in->shooter < 0) || (needsText && in->text < 0) ||
+        ((in->op == QRY_OP_LC || in->op == QRY_OP_ATCH) && in->loader < 0) ||
+        (in->op == QRY_OP_ATCH && in->rightLoader < 0)) {
+      return false;
+    }
+  }
+  return true;
+}
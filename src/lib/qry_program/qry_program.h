@@ -0,0 +1,82 @@
+/**
+ * @file qry_program.h
+ * @brief Compiled .qry programs
+ *
+ * This module lowers the lines of a .qry file into an array of typed
+ * instructions: numeric operands are decoded, shooter and loader ids are
+ * replaced by dense slots and buttons by enumerators, so the commands run
+ * without reading text again. A program does not depend on the scene it
+ * runs against, and it can be saved to a cache file and loaded back
+ * instead of compiling the same .qry again.
+ */
+
+#ifndef QRY_PROGRAM_H
+#define QRY_PROGRAM_H
+
+#include "../file_reader/file_reader.h"
+#include <stdbool.h>
+
+/**
+ * @brief Opaque pointer type for compiled .qry programs
+ */
+typedef void *QryProgram;
+
+/**
+ * @brief Compiles the lines of a .qry file
+ *
+ * The lines are left untouched. A line with an unknown command or missing
+ * arguments compiles to an instruction printing the error when the program
+ * runs, in the place the command had.
+ *
+ * @param qryFileData File data containing .qry file lines
+ * @return New program or NULL on error
+ */
+QryProgram qry_program_compile(FileData qryFileData);
+
+/**
+ * @brief Compiles the lines of a .qry file that continues another program
+ *
+ * Shooter and loader ids keep the slots they have in prefix, and ids seen
+ * for the first time get the slots after them, so the program can run on
+ * a branch of a run of prefix (see execute_qry_branch). The lines of prefix
+ * count as lines of the program too, so the reports of a branch are those
+ * of the .qry made of both files.
+ *
+ * @param prefix Program whose run this one continues
+ * @param qryFileData File data containing .qry file lines
+ * @return New program or NULL on error
+ */
+QryProgram qry_program_compile_continuation(QryProgram prefix,
+                                            FileData qryFileData);
+
+/**
+ * @brief Loads a program saved by qry_program_save
+ * @param path Path of the cache file
+ * @param qryFileData File data of the .qry the program must come from
+ * @return Loaded program, or NULL if the file is missing, unreadable,
+ *         written by another build or compiled from different lines
+ */
+QryProgram qry_program_load(const char *path, FileData qryFileData);
+
+/**
+ * @brief Saves a program to a cache file
+ * @param program Program instance
+ * @param path Path of the cache file, overwritten if it exists
+ * @return true if successful, false if the file could not be written
+ */
+bool qry_program_save(QryProgram program, const char *path);
+
+/**
+ * @brief Gets the number of instructions of a program
+ * @param program Program instance
+ * @return Number of instructions, 0 if program is NULL
+ */
+int qry_program_size(QryProgram program);
+
+/**
+ * @brief Destroys a program and frees its memory
+ * @param program Program instance to destroy
+ */
+void qry_program_destroy(QryProgram program);
+
+#endif // QRY_PROGRAM_H
@@ -0,0 +1,108 @@
+/**
+ * Qry program internals - Library-private instruction layout
+ *
+ * Inline access to the instructions and tables of a compiled program for
+ * the interpreter loop. No NULL or range checks are performed.
+ */
+#ifndef QRY_PROGRAM_INTERNAL_H
+#define QRY_PROGRAM_INTERNAL_H
+
+#include "qry_program.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+  QRY_OP_PD,
+  QRY_OP_LC,
+  QRY_OP_ATCH,
+  QRY_OP_SHFT,
+  QRY_OP_DSP,
+  QRY_OP_RJD,
+  QRY_OP_CALC,
+  QRY_OP_SEL,
+  QRY_OP_PROX,
+  QRY_OP_SOB,
+  QRY_OP_ERROR // prints its text: unknown command or missing arguments
+} QryOpcode;
+
+// Buttons of shft and rjd; the left button ("e") takes from the right
+// loader and the right button ("d") from the left one
+typedef enum {
+  QRY_BUTTON_NONE, // anything else, as written in the text
+  QRY_BUTTON_LEFT,
+  QRY_BUTTON_RIGHT
+} QryButton;
+
+typedef struct {
+  QryOpcode op;
+  int shooter;     // shooter slot: pd, atch, shft, dsp, rjd, prox
+  int loader;      // loader slot: lc; left loader slot: atch
+  int rightLoader; // loader slot: atch
+  int count;       // shapes taken by lc, presses of shft, k of prox
+  QryButton button;
+  bool annotate; // dsp with "v"
+  // pd: x, y; dsp: dx, dy; rjd: dx, dy, incrementX, incrementY;
+  // sel: x, y, width, height; prox: dx, dy
+  double operand[4];
+  int text; // offset in the strings of the program, or -1: button of shft
+            // and annotation of dsp as written, message of QRY_OP_ERROR
+} QryInstruction;
+
+/**
+ * Internal QryProgram structure
+ */
+struct QryProgram {
+  QryInstruction *code;
+  int count;
+  int capacity;
+  int *shooterIds; // shooter slot -> id
+  int shooterCount;
+  int shooterCapacity;
+  int *loaderIds; // loader slot -> id
+  int loaderCount;
+  int loaderCapacity;
+  char *strings; // NUL-terminated texts referenced by the instructions
+  int stringsSize;
+  int stringsCapacity;
+  int lineCount;       // lines of the .qry, blank ones included
+  uint64_t sourceHash; // hash of those lines, checked by qry_program_load
+};
+
+static inline const QryInstruction *qry_program_fast_code(QryProgram program) {
+  return ((struct QryProgram *)program)->code;
+}
+
+static inline int qry_program_fast_count(QryProgram program) {
+  return ((struct QryProgram *)program)->count;
+}
+
+static inline int qry_program_fast_shooter_count(QryProgram program) {
+  return ((struct QryProgram *)program)->shooterCount;
+}
+
+static inline int qry_program_fast_shooter_id(QryProgram program, int slot) {
+  return ((struct QryProgram *)program)->shooterIds[slot];
+}
+
+static inline int qry_program_fast_loader_count(QryProgram program) {
+  return ((struct QryProgram *)program)->loaderCount;
+}
+
+static inline int qry_program_fast_loader_id(QryProgram program, int slot) {
+  return ((struct QryProgram *)program)->loaderIds[slot];
+}
+
+static inline const char *qry_program_fast_text(QryProgram program,
+                                                int offset) {
+  return offset < 0 ? NULL : ((struct QryProgram *)program)->strings + offset;
+}
+
+static inline int qry_program_fast_line_count(QryProgram program) {
+  return ((struct QryProgram *)program)->lineCount;
+}
+
+static inline uint64_t qry_program_fast_source_hash(QryProgram program) {
+  return ((struct QryProgram *)program)->sourceHash;
+}
+
+#endif // QRY_PROGRAM_INTERNAL_H
@@ -1,18 +1,8 @@
 #include "circle.h"
+#include "circle_internal.h"
 #include "../../commons/utils/utils.h"
 #include <stdlib.h>
 #include <string.h>
-/**
- * Internal Circle structure
- */
-struct Circle {
-  int id;
-  double x;
-  double y;
-  double radius;
-  char *border_color;
-  char *fill_color;
-};
 
 void *circle_create(int id, double x, double y, double radius,
                     const char *border_color, const char *fill_color) {
@@ -0,0 +1,51 @@
+/**
+ * Circle internals - Library-private fast access to circle fields
+ *
+ * Shares the circle layout with the library modules that read circles in hot
+ * loops (collision checks and SVG rendering). The static inline accessors
+ * below compile down to plain field loads and, unlike the public getters,
+ * do not check for NULL. Only include this header from inside src/lib.
+ */
+#ifndef CIRCLE_INTERNAL_H
+#define CIRCLE_INTERNAL_H
+
+#include "../../commons/scalar/scalar.h"
+#include "circle.h"
+
+/**
+ * Internal Circle structure
+ */
+struct Circle {
+  int id;
+  Scalar x;
+  Scalar y;
+  Scalar radius;
+  char *border_color;
+  char *fill_color;
+};
+
+static inline int circle_fast_get_id(Circle circle) {
+  return ((struct Circle *)circle)->id;
+}
+
+static inline Scalar circle_fast_get_x(Circle circle) {
+  return ((struct Circle *)circle)->x;
+}
+
+static inline Scalar circle_fast_get_y(Circle circle) {
+  return ((struct Circle *)circle)->y;
+}
+
+static inline Scalar circle_fast_get_radius(Circle circle) {
+  return ((struct Circle *)circle)->radius;
+}
+
+static inline const char *circle_fast_get_border_color(Circle circle) {
+  return ((struct Circle *)circle)->border_color;
+}
+
+static inline const char *circle_fast_get_fill_color(Circle circle) {
+  return ((struct Circle *)circle)->fill_color;
+}
+
+#endif // CIRCLE_INTERNAL_H
@@ -1,20 +1,9 @@
 #include "line.h"
+#include "line_internal.h"
 #include "../../commons/utils/utils.h"
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * Internal Line structure
- */
-struct Line {
-  int id;
-  double x1;
-  double y1;
-  double x2;
-  double y2;
-  char *color;
-};
-
 void *line_create(int id, double x1, double y1, double x2, double y2,
                   const char *color) {
   if (!color) {
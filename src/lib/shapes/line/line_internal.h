@@ -0,0 +1,49 @@
+/**
+ * Line internals - Library-private line layout
+ *
+ * Inline endpoint and color loads for the collision and rendering loops.
+ * The instance must not be NULL.
+ */
+#ifndef LINE_INTERNAL_H
+#define LINE_INTERNAL_H
+
+#include "../../commons/scalar/scalar.h"
+#include "line.h"
+
+/**
+ * Internal Line structure
+ */
+struct Line {
+  int id;
+  Scalar x1;
+  Scalar y1;
+  Scalar x2;
+  Scalar y2;
+  char *color;
+};
+
+static inline int line_fast_get_id(Line line) {
+  return ((struct Line *)line)->id;
+}
+
+static inline Scalar line_fast_get_x1(Line line) {
+  return ((struct Line *)line)->x1;
+}
+
+static inline Scalar line_fast_get_y1(Line line) {
+  return ((struct Line *)line)->y1;
+}
+
+static inline Scalar line_fast_get_x2(Line line) {
+  return ((struct Line *)line)->x2;
+}
+
+static inline Scalar line_fast_get_y2(Line line) {
+  return ((struct Line *)line)->y2;
+}
+
+static inline const char *line_fast_get_color(Line line) {
+  return ((struct Line *)line)->color;
+}
+
+#endif // LINE_INTERNAL_H
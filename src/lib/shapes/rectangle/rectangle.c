@@ -1,21 +1,9 @@
 #include "rectangle.h"
+#include "rectangle_internal.h"
 #include "../../commons/utils/utils.h"
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * Internal Rectangle structure
- */
-struct Rectangle {
-  int id;
-  double x;
-  double y;
-  double width;
-  double height;
-  char *border_color;
-  char *fill_color;
-};
-
 void *rectangle_create(int id, double x, double y, double width, double height,
                        const char *border_color, const char *fill_color) {
   if (!border_color || !fill_color) {
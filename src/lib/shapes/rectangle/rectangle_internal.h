@@ -0,0 +1,54 @@
+/**
+ * Rectangle internals - Library-private rectangle layout
+ *
+ * Unchecked inline accessors for hot loops; see circle_internal.h for the
+ * rules that apply to these headers.
+ */
+#ifndef RECTANGLE_INTERNAL_H
+#define RECTANGLE_INTERNAL_H
+
+#include "../../commons/scalar/scalar.h"
+#include "rectangle.h"
+
+/**
+ * Internal Rectangle structure
+ */
+struct Rectangle {
+  int id;
+  Scalar x;
+  Scalar y;
+  Scalar width;
+  Scalar height;
+  char *border_color;
+  char *fill_color;
+};
+
+static inline int rectangle_fast_get_id(Rectangle rectangle) {
+  return ((struct Rectangle *)rectangle)->id;
+}
+
+static inline Scalar rectangle_fast_get_x(Rectangle rectangle) {
+  return ((struct Rectangle *)rectangle)->x;
+}
+
+static inline Scalar rectangle_fast_get_y(Rectangle rectangle) {
+  return ((struct Rectangle *)rectangle)->y;
+}
+
+static inline Scalar rectangle_fast_get_width(Rectangle rectangle) {
+  return ((struct Rectangle *)rectangle)->width;
+}
+
+static inline Scalar rectangle_fast_get_height(Rectangle rectangle) {
+  return ((struct Rectangle *)rectangle)->height;
+}
+
+static inline const char *rectangle_fast_get_border_color(Rectangle rectangle) {
+  return ((struct Rectangle *)rectangle)->border_color;
+}
+
+static inline const char *rectangle_fast_get_fill_color(Rectangle rectangle) {
+  return ((struct Rectangle *)rectangle)->fill_color;
+}
+
+#endif // RECTANGLE_INTERNAL_H
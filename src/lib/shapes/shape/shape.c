@@ -0,0 +1,600 @@
+#include "shape.h"
+#include "shape_internal.h"
+#include "../../commons/utils/utils.h"
+#include "../circle/circle.h"
+#include "../line/line.h"
+#include "../rectangle/rectangle.h"
+#include "../text/text.h"
+#include "../text_style/text_style.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Per-type operations. Each shape type listed in SHAPE_TYPE_LIST provides
+ * prefix_destroy in its own module and the prefix_shape_* functions below.
+ */
+typedef struct {
+  void (*destroy)(void *data);
+  double (*area)(void *data);
+  void (*bounds)(void *data, struct Shape *s);
+  void *(*clone)(void *data, double x, double y, const char *border_color);
+  void *(*clone_swapped)(void *data, double x, double y);
+  const char *(*fill_color)(void *data);
+  int (*id)(void *data);
+  void (*position)(void *data, double *x, double *y);
+  bool (*write)(void *data, FILE *file);
+  void *(*read)(FILE *file);
+} ShapeOps;
+
+#define SHAPE_DECLARE_OPS(type, prefix, command)                               \
+  static double prefix##_shape_area(void *data);                               \
+  static void prefix##_shape_bounds(void *data, struct Shape *s);              \
+  static void *prefix##_shape_clone(void *data, double x, double y,            \
+                                    const char *border_color);                 \
+  static void *prefix##_shape_clone_swapped(void *data, double x, double y);   \
+  static const char *prefix##_shape_fill_color(void *data);                    \
+  static int prefix##_shape_id(void *data);                                    \
+  static void prefix##_shape_position(void *data, double *x, double *y);      \
+  static bool prefix##_shape_write(void *data, FILE *file);                    \
+  static void *prefix##_shape_read(FILE *file);
+SHAPE_TYPE_LIST(SHAPE_DECLARE_OPS)
+#undef SHAPE_DECLARE_OPS
+
+static const ShapeOps shape_ops[] = {
+#define SHAPE_OPS_ENTRY(type, prefix, command)                                 \
+  [type] = {prefix##_destroy,           prefix##_shape_area,                   \
+            prefix##_shape_bounds,      prefix##_shape_clone,                  \
+            prefix##_shape_clone_swapped, prefix##_shape_fill_color,           \
+            prefix##_shape_id,          prefix##_shape_position,               \
+            prefix##_shape_write,       prefix##_shape_read},
+    SHAPE_TYPE_LIST(SHAPE_OPS_ENTRY)
+#undef SHAPE_OPS_ENTRY
+};
+
+// private functions
+static struct Shape *shape_wrap_clone(const struct Shape *src, void *data);
+static bool write_string(FILE *file, const char *s);
+static bool read_string(FILE *file, char **s);
+
+void *shape_create(ShapeType type, void *data) {
+  struct Shape *shape = malloc(sizeof(struct Shape));
+  if (!shape) {
+    return NULL;
+  }
+
+  shape->type = type;
+  shape->data = data;
+  shape->area = shape_ops[type].area(data);
+  shape->minX = shape->minY = shape->maxX = shape->maxY = 0.0;
+  shape->ownerSlot = -1;
+  shape_ops[type].bounds(data, shape);
+
+  return shape;
+}
+
+void *shape_clone(void *shape, double x, double y, const char *border_color) {
+  if (!shape)
+    return NULL;
+
+  struct Shape *src = (struct Shape *)shape;
+  return shape_wrap_clone(
+      src, shape_ops[src->type].clone(src->data, x, y, border_color));
+}
+
+void *shape_clone_swapped(void *shape, double x, double y) {
+  if (!shape)
+    return NULL;
+
+  struct Shape *src = (struct Shape *)shape;
+  return shape_wrap_clone(src,
+                          shape_ops[src->type].clone_swapped(src->data, x, y));
+}
+
+void shape_destroy(void *shape) {
+  if (!shape)
+    return;
+
+  struct Shape *s = (struct Shape *)shape;
+  shape_ops[s->type].destroy(s->data);
+  free(s);
+}
+
+ShapeType shape_get_type(void *shape) {
+  return ((struct Shape *)shape)->type;
+}
+
+void *shape_get_data(void *shape) {
+  if (!shape)
+    return NULL;
+  return ((struct Shape *)shape)->data;
+}
+
+const char *shape_get_fill_color(void *shape) {
+  if (!shape)
+    return NULL;
+  struct Shape *s = (struct Shape *)shape;
+  return shape_ops[s->type].fill_color(s->data);
+}
+
+double shape_get_area(void *shape) {
+  if (!shape)
+    return 0.0;
+  return ((struct Shape *)shape)->area;
+}
+
+void shape_get_local_bounds(void *shape, double *minX, double *minY,
+                            double *maxX, double *maxY) {
+  struct Shape *s = (struct Shape *)shape;
+  *minX = s->minX;
+  *minY = s->minY;
+  *maxX = s->maxX;
+  *maxY = s->maxY;
+}
+
+int shape_get_id(void *shape) {
+  struct Shape *s = (struct Shape *)shape;
+  return shape_ops[s->type].id(s->data);
+}
+
+void shape_get_position(void *shape, double *x, double *y) {
+  struct Shape *s = (struct Shape *)shape;
+  shape_ops[s->type].position(s->data, x, y);
+}
+
+// Geometry cached by a shape, saved with it so a shape read back is exactly
+// the one written, even when a clone's cache came from its source
+typedef struct {
+  int type;
+  double area;
+  double bounds[4]; // minX, minY, maxX, maxY
+} ShapeRecord;
+
+bool shape_write(void *shape, FILE *file) {
+  if (!shape || !file)
+    return false;
+
+  struct Shape *s = (struct Shape *)shape;
+  ShapeRecord record;
+  memset(&record, 0, sizeof(record));
+  record.type = (int)s->type;
+  record.area = s->area;
+  record.bounds[0] = s->minX;
+  record.bounds[1] = s->minY;
+  record.bounds[2] = s->maxX;
+  record.bounds[3] = s->maxY;
+  return fwrite(&record, sizeof(record), 1, file) == 1 &&
+         shape_ops[s->type].write(s->data, file);
+}
+
+void *shape_read(FILE *file) {
+  ShapeRecord record;
+  size_t typeCount = sizeof(shape_ops) / sizeof(shape_ops[0]);
+  if (!file || fread(&record, sizeof(record), 1, file) != 1 ||
+      record.type < 0 || (size_t)record.type >= typeCount) {
+    return NULL;
+  }
+
+  void *data = shape_ops[record.type].read(file);
+  if (!data)
+    return NULL;
+  struct Shape *shape = shape_create((ShapeType)record.type, data);
+  if (!shape) {
+    shape_ops[record.type].destroy(data);
+    return NULL;
+  }
+  shape->area = record.area;
+  shape->minX = record.bounds[0];
+  shape->minY = record.bounds[1];
+  shape->maxX = record.bounds[2];
+  shape->maxY = record.bounds[3];
+  return shape;
+}
+
+/**
+**************************
+* Private functions
+**************************
+*/
+
+// Strings are saved as their length followed by their characters
+static bool write_string(FILE *file, const char *s) {
+  int length = (int)strlen(s);
+  return fwrite(&length, sizeof(int), 1, file) == 1 &&
+         fwrite(s, 1, (size_t)length, file) == (size_t)length;
+}
+
+// Reads a string saved by write_string into a new allocation
+static bool read_string(FILE *file, char **s) {
+  int length;
+  *s = NULL;
+  if (fread(&length, sizeof(int), 1, file) != 1 || length < 0) {
+    return false;
+  }
+  *s = malloc((size_t)length + 1);
+  if (*s == NULL || fread(*s, 1, (size_t)length, file) != (size_t)length) {
+    free(*s);
+    *s = NULL;
+    return false;
+  }
+  (*s)[length] = '\0';
+  return true;
+}
+
+// Wraps a cloned element; clones keep the geometry of their source, so the
+// cached area and bounds are copied instead of recomputed
+static struct Shape *shape_wrap_clone(const struct Shape *src, void *data) {
+  if (!data)
+    return NULL;
+
+  struct Shape *shape = malloc(sizeof(struct Shape));
+  if (!shape) {
+    shape_ops[src->type].destroy(data);
+    return NULL;
+  }
+
+  *shape = *src;
+  shape->data = data;
+  shape->ownerSlot = -1;
+  return shape;
+}
+
+// Circle
+static double circle_shape_area(void *data) {
+  double r = circle_get_radius((Circle)data);
+  return 3.141592653589793 * r * r;
+}
+
+static void circle_shape_bounds(void *data, struct Shape *s) {
+  double r = circle_get_radius((Circle)data);
+  s->minX = -r;
+  s->minY = -r;
+  s->maxX = r;
+  s->maxY = r;
+}
+
+static void *circle_shape_clone(void *data, double x, double y,
+                                const char *border_color) {
+  Circle c = (Circle)data;
+  return circle_create(
+      circle_get_id(c), x, y, circle_get_radius(c),
+      border_color != NULL ? border_color : circle_get_border_color(c),
+      circle_get_fill_color(c));
+}
+
+static void *circle_shape_clone_swapped(void *data, double x, double y) {
+  Circle c = (Circle)data;
+  return circle_create(circle_get_id(c), x, y, circle_get_radius(c),
+                       circle_get_fill_color(c), circle_get_border_color(c));
+}
+
+static const char *circle_shape_fill_color(void *data) {
+  return circle_get_fill_color((Circle)data);
+}
+
+static int circle_shape_id(void *data) { return circle_get_id((Circle)data); }
+
+static void circle_shape_position(void *data, double *x, double *y) {
+  *x = circle_get_x((Circle)data);
+  *y = circle_get_y((Circle)data);
+}
+
+static bool circle_shape_write(void *data, FILE *file) {
+  Circle c = (Circle)data;
+  int id = circle_get_id(c);
+  double values[3] = {circle_get_x(c), circle_get_y(c), circle_get_radius(c)};
+  return fwrite(&id, sizeof(int), 1, file) == 1 &&
+         fwrite(values, sizeof(double), 3, file) == 3 &&
+         write_string(file, circle_get_border_color(c)) &&
+         write_string(file, circle_get_fill_color(c));
+}
+
+static void *circle_shape_read(FILE *file) {
+  int id;
+  double values[3];
+  char *border = NULL;
+  char *fill = NULL;
+  void *circle = NULL;
+  if (fread(&id, sizeof(int), 1, file) == 1 &&
+      fread(values, sizeof(double), 3, file) == 3 &&
+      read_string(file, &border) && read_string(file, &fill)) {
+    circle = circle_create(id, values[0], values[1], values[2], border, fill);
+  }
+  free(border);
+  free(fill);
+  return circle;
+}
+
+// Rectangle
+static double rectangle_shape_area(void *data) {
+  double w = rectangle_get_width((Rectangle)data);
+  double h = rectangle_get_height((Rectangle)data);
+  return w * h;
+}
+
+static void rectangle_shape_bounds(void *data, struct Shape *s) {
+  s->maxX = rectangle_get_width((Rectangle)data);
+  s->maxY = rectangle_get_height((Rectangle)data);
+}
+
+static void *rectangle_shape_clone(void *data, double x, double y,
+                                   const char *border_color) {
+  Rectangle r = (Rectangle)data;
+  return rectangle_create(
+      rectangle_get_id(r), x, y, rectangle_get_width(r),
+      rectangle_get_height(r),
+      border_color != NULL ? border_color : rectangle_get_border_color(r),
+      rectangle_get_fill_color(r));
+}
+
+static void *rectangle_shape_clone_swapped(void *data, double x, double y) {
+  Rectangle r = (Rectangle)data;
+  return rectangle_create(rectangle_get_id(r), x, y, rectangle_get_width(r),
+                          rectangle_get_height(r), rectangle_get_fill_color(r),
+                          rectangle_get_border_color(r));
+}
+
+static const char *rectangle_shape_fill_color(void *data) {
+  return rectangle_get_fill_color((Rectangle)data);
+}
+
+static int rectangle_shape_id(void *data) {
+  return rectangle_get_id((Rectangle)data);
+}
+
+static void rectangle_shape_position(void *data, double *x, double *y) {
+  *x = rectangle_get_x((Rectangle)data);
+  *y = rectangle_get_y((Rectangle)data);
+}
+
+static bool rectangle_shape_write(void *data, FILE *file) {
+  Rectangle r = (Rectangle)data;
+  int id = rectangle_get_id(r);
+  double values[4] = {rectangle_get_x(r), rectangle_get_y(r),
+                      rectangle_get_width(r), rectangle_get_height(r)};
+  return fwrite(&id, sizeof(int), 1, file) == 1 &&
+         fwrite(values, sizeof(double), 4, file) == 4 &&
+         write_string(file, rectangle_get_border_color(r)) &&
+         write_string(file, rectangle_get_fill_color(r));
+}
+
+static void *rectangle_shape_read(FILE *file) {
+  int id;
+  double values[4];
+  char *border = NULL;
+  char *fill = NULL;
+  void *rectangle = NULL;
+  if (fread(&id, sizeof(int), 1, file) == 1 &&
+      fread(values, sizeof(double), 4, file) == 4 &&
+      read_string(file, &border) && read_string(file, &fill)) {
+    rectangle = rectangle_create(id, values[0], values[1], values[2],
+                                 values[3], border, fill);
+  }
+  free(border);
+  free(fill);
+  return rectangle;
+}
+
+// Line (anchored at its start point)
+static double line_shape_area(void *data) {
+  double dx = line_get_x2((Line)data) - line_get_x1((Line)data);
+  double dy = line_get_y2((Line)data) - line_get_y1((Line)data);
+  double len = (dx * dx + dy * dy) > 0.0 ? sqrt(dx * dx + dy * dy) : 0.0;
+  return 2.0 * len;
+}
+
+static void line_shape_bounds(void *data, struct Shape *s) {
+  double dx = line_get_x2((Line)data) - line_get_x1((Line)data);
+  double dy = line_get_y2((Line)data) - line_get_y1((Line)data);
+  // thickness 2.0 => inflate by 1 on each side
+  s->minX = ((dx < 0.0) ? dx : 0.0) - 1.0;
+  s->maxX = ((dx > 0.0) ? dx : 0.0) + 1.0;
+  s->minY = ((dy < 0.0) ? dy : 0.0) - 1.0;
+  s->maxY = ((dy > 0.0) ? dy : 0.0) + 1.0;
+}
+
+static void *line_shape_clone(void *data, double x, double y,
+                              const char *border_color) {
+  Line l = (Line)data;
+  double dx = line_get_x2(l) - line_get_x1(l);
+  double dy = line_get_y2(l) - line_get_y1(l);
+  return line_create(line_get_id(l), x, y, x + dx, y + dy,
+                     border_color != NULL ? border_color : line_get_color(l));
+}
+
+static void *line_shape_clone_swapped(void *data, double x, double y) {
+  // A line has a single color, so swapping inverts it
+  char *inv = invert_color(line_get_color((Line)data));
+  if (inv == NULL)
+    return NULL;
+  void *clone = line_shape_clone(data, x, y, inv);
+  free(inv);
+  return clone;
+}
+
+static const char *line_shape_fill_color(void *data) {
+  (void)data;
+  return NULL;
+}
+
+static int line_shape_id(void *data) { return line_get_id((Line)data); }
+
+static void line_shape_position(void *data, double *x, double *y) {
+  *x = line_get_x1((Line)data);
+  *y = line_get_y1((Line)data);
+}
+
+static bool line_shape_write(void *data, FILE *file) {
+  Line l = (Line)data;
+  int id = line_get_id(l);
+  double values[4] = {line_get_x1(l), line_get_y1(l), line_get_x2(l),
+                      line_get_y2(l)};
+  return fwrite(&id, sizeof(int), 1, file) == 1 &&
+         fwrite(values, sizeof(double), 4, file) == 4 &&
+         write_string(file, line_get_color(l));
+}
+
+static void *line_shape_read(FILE *file) {
+  int id;
+  double values[4];
+  char *color = NULL;
+  void *line = NULL;
+  if (fread(&id, sizeof(int), 1, file) == 1 &&
+      fread(values, sizeof(double), 4, file) == 4 &&
+      read_string(file, &color)) {
+    line = line_create(id, values[0], values[1], values[2], values[3], color);
+  }
+  free(color);
+  return line;
+}
+
+// Text
+static double text_shape_area(void *data) {
+  return 20.0 * (double)text_get_length((Text)data);
+}
+
+static void text_shape_bounds(void *data, struct Shape *s) {
+  // Treat text as a horizontal segment based on anchor, with length 10.0 *
+  // |t|, inflated by 1 on each side (same rule as LINE)
+  Text t = (Text)data;
+  double segLen = 10.0 * (double)text_get_length(t);
+  char anchor = text_get_anchor(t);
+  double x1 = 0.0;
+  double x2 = segLen; // start anchor ('i') or unknown: to the right
+  if (anchor == 'f' || anchor == 'F' || anchor == 'e' || anchor == 'E') {
+    // end anchor to the left (Portuguese 'f'inal / 'e'nd)
+    x1 = -segLen;
+    x2 = 0.0;
+  } else if (anchor == 'm' || anchor == 'M') {
+    x1 = -segLen * 0.5;
+    x2 = segLen * 0.5;
+  }
+  s->minX = x1 - 1.0;
+  s->maxX = x2 + 1.0;
+  s->minY = -1.0;
+  s->maxY = 1.0;
+}
+
+static void *text_shape_clone(void *data, double x, double y,
+                              const char *border_color) {
+  Text t = (Text)data;
+  return text_clone(t, x, y,
+                    border_color != NULL ? border_color
+                                         : text_get_border_color(t),
+                    text_get_fill_color(t));
+}
+
+static void *text_shape_clone_swapped(void *data, double x, double y) {
+  Text t = (Text)data;
+  return text_clone(t, x, y, text_get_fill_color(t), text_get_border_color(t));
+}
+
+static const char *text_shape_fill_color(void *data) {
+  return text_get_fill_color((Text)data);
+}
+
+static int text_shape_id(void *data) { return text_get_id((Text)data); }
+
+static void text_shape_position(void *data, double *x, double *y) {
+  *x = text_get_x((Text)data);
+  *y = text_get_y((Text)data);
+}
+
+static bool text_shape_write(void *data, FILE *file) {
+  Text t = (Text)data;
+  int id = text_get_id(t);
+  double values[2] = {text_get_x(t), text_get_y(t)};
+  char anchor = text_get_anchor(t);
+  return fwrite(&id, sizeof(int), 1, file) == 1 &&
+         fwrite(values, sizeof(double), 2, file) == 2 &&
+         fwrite(&anchor, 1, 1, file) == 1 &&
+         write_string(file, text_get_border_color(t)) &&
+         write_string(file, text_get_fill_color(t)) &&
+         write_string(file, text_get_text(t));
+}
+
+static void *text_shape_read(FILE *file) {
+  int id;
+  double values[2];
+  char anchor;
+  char *border = NULL;
+  char *fill = NULL;
+  char *body = NULL;
+  void *text = NULL;
+  if (fread(&id, sizeof(int), 1, file) == 1 &&
+      fread(values, sizeof(double), 2, file) == 2 &&
+      fread(&anchor, 1, 1, file) == 1 && read_string(file, &border) &&
+      read_string(file, &fill) && read_string(file, &body)) {
+    text = text_create(id, values[0], values[1], border, fill, anchor, body);
+  }
+  free(border);
+  free(fill);
+  free(body);
+  return text;
+}
+
+// Text style: a style descriptor has no geometry and is never cloned
+static double text_style_shape_area(void *data) {
+  (void)data;
+  return 0.0;
+}
+
+static void text_style_shape_bounds(void *data, struct Shape *s) {
+  // No extent, treat as empty box
+  (void)data;
+  (void)s;
+}
+
+static void *text_style_shape_clone(void *data, double x, double y,
+                                    const char *border_color) {
+  (void)data;
+  (void)x;
+  (void)y;
+  (void)border_color;
+  return NULL;
+}
+
+static void *text_style_shape_clone_swapped(void *data, double x, double y) {
+  (void)data;
+  (void)x;
+  (void)y;
+  return NULL;
+}
+
+static const char *text_style_shape_fill_color(void *data) {
+  (void)data;
+  return NULL;
+}
+
+static int text_style_shape_id(void *data) {
+  (void)data;
+  return -1;
+}
+
+static void text_style_shape_position(void *data, double *x, double *y) {
+  (void)data;
+  *x = 0.0;
+  *y = 0.0;
+}
+
+static bool text_style_shape_write(void *data, FILE *file) {
+  TextStyle ts = (TextStyle)data;
+  char weight = text_style_get_font_weight(ts);
+  int size = text_style_get_font_size(ts);
+  return fwrite(&weight, 1, 1, file) == 1 &&
+         fwrite(&size, sizeof(int), 1, file) == 1 &&
+         write_string(file, text_style_get_font_family(ts));
+}
+
+static void *text_style_shape_read(FILE *file) {
+  char weight;
+  int size;
+  char *family = NULL;
+  void *text_style = NULL;
+  if (fread(&weight, 1, 1, file) == 1 &&
+      fread(&size, sizeof(int), 1, file) == 1 && read_string(file, &family)) {
+    text_style = text_style_create(family, weight, size);
+  }
+  free(family);
+  return text_style;
+}
@@ -0,0 +1,127 @@
+/**
+ * Shape ADT - Typed wrapper around a geometric element
+ *
+ * This module pairs a shape payload (Circle, Rectangle, Line, Text or
+ * TextStyle) with its type and caches the geometry derived from it: the
+ * area and the local-space bounding box. Local space has its origin at the
+ * shape anchor (circle center, rectangle corner, line start point or text
+ * position), so the box of a shape placed anywhere is the cached box plus
+ * the placement offset.
+ */
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include "../shapes.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef void *Shape;
+
+/**
+ * Creates a new shape wrapper and computes its cached geometry
+ * @param type Type of the wrapped element
+ * @param data Wrapped element (ownership is transferred to the shape)
+ * @return Pointer to new shape or NULL on error
+ */
+Shape shape_create(ShapeType type, void *data);
+
+/**
+ * Creates a copy of a shape placed at a new anchor position
+ * @param shape Source shape instance
+ * @param x X coordinate of the clone anchor
+ * @param y Y coordinate of the clone anchor
+ * @param border_color Border color of the clone (the line color for lines),
+ *                     or NULL to keep the source colors
+ * @return Pointer to new shape or NULL if the type cannot be cloned
+ */
+Shape shape_clone(Shape shape, double x, double y, const char *border_color);
+
+/**
+ * Creates a copy of a shape at a new anchor position with its border and
+ * fill colors swapped (lines get their color inverted instead)
+ * @param shape Source shape instance
+ * @param x X coordinate of the clone anchor
+ * @param y Y coordinate of the clone anchor
+ * @return Pointer to new shape or NULL if the type cannot be cloned
+ */
+Shape shape_clone_swapped(Shape shape, double x, double y);
+
+/**
+ * Destroys a shape wrapper and the element it wraps
+ * @param shape Shape instance to destroy
+ */
+void shape_destroy(Shape shape);
+
+/**
+ * Gets the shape type
+ * @param shape Shape instance
+ * @return Shape type
+ */
+ShapeType shape_get_type(Shape shape);
+
+/**
+ * Gets the wrapped element
+ * @param shape Shape instance
+ * @return Wrapped element (do not free)
+ */
+void *shape_get_data(Shape shape);
+
+/**
+ * Gets the fill color of the wrapped element
+ * @param shape Shape instance
+ * @return Fill color string (do not free) or NULL if the type has no fill
+ */
+const char *shape_get_fill_color(Shape shape);
+
+/**
+ * Gets the cached shape area
+ * @param shape Shape instance
+ * @return Shape area
+ */
+double shape_get_area(Shape shape);
+
+/**
+ * Gets the cached local-space bounding box, relative to the shape anchor
+ * @param shape Shape instance
+ * @param minX Output for the minimum X offset
+ * @param minY Output for the minimum Y offset
+ * @param maxX Output for the maximum X offset
+ * @param maxY Output for the maximum Y offset
+ */
+void shape_get_local_bounds(Shape shape, double *minX, double *minY,
+                            double *maxX, double *maxY);
+
+/**
+ * Gets the id of the wrapped element
+ * @param shape Shape instance
+ * @return Element id, or -1 for types without one (text styles)
+ */
+int shape_get_id(Shape shape);
+
+/**
+ * Gets the anchor of the wrapped element: the center of a circle, the corner
+ * of a rectangle, the start of a line or the anchor of a text
+ * @param shape Shape instance
+ * @param x Output for the anchor X
+ * @param y Output for the anchor Y
+ */
+void shape_get_position(Shape shape, double *x, double *y);
+
+/**
+ * Writes a shape to a binary file, to be read back by shape_read in a
+ * build with the same shape types
+ * @param shape Shape instance
+ * @param file File open for binary writing
+ * @return true if successful, false on a write error
+ */
+bool shape_write(Shape shape, FILE *file);
+
+/**
+ * Reads a shape saved by shape_write, with the same element and cached
+ * geometry
+ * @param file File open for binary reading
+ * @return New shape, or NULL if the file holds no valid shape
+ */
+Shape shape_read(FILE *file);
+
+#endif // SHAPE_H
@@ -0,0 +1,58 @@
+/**
+ * Shape internals - Library-private shape layout
+ *
+ * Inline access to the shape type, payload and cached geometry for the
+ * collision and rendering loops. No NULL checks are performed.
+ */
+#ifndef SHAPE_INTERNAL_H
+#define SHAPE_INTERNAL_H
+
+#include "../../commons/scalar/scalar.h"
+#include "shape.h"
+
+/**
+ * Internal Shape structure
+ */
+struct Shape {
+  void *data;
+  ShapeType type;
+  Scalar area;
+  Scalar minX;
+  Scalar minY;
+  Scalar maxX;
+  Scalar maxY;
+  int ownerSlot; // position in the shapes owned by a ground, -1 if none
+};
+
+static inline ShapeType shape_fast_get_type(Shape shape) {
+  return ((struct Shape *)shape)->type;
+}
+
+static inline void *shape_fast_get_data(Shape shape) {
+  return ((struct Shape *)shape)->data;
+}
+
+static inline Scalar shape_fast_get_area(Shape shape) {
+  return ((struct Shape *)shape)->area;
+}
+
+static inline void shape_fast_get_local_bounds(Shape shape, Scalar *minX,
+                                               Scalar *minY, Scalar *maxX,
+                                               Scalar *maxY) {
+  struct Shape *s = (struct Shape *)shape;
+  *minX = s->minX;
+  *minY = s->minY;
+  *maxX = s->maxX;
+  *maxY = s->maxY;
+}
+
+// The slot is only a hint: an owner checks that it holds the shape there
+static inline int shape_fast_get_owner_slot(Shape shape) {
+  return ((struct Shape *)shape)->ownerSlot;
+}
+
+static inline void shape_fast_set_owner_slot(Shape shape, int slot) {
+  ((struct Shape *)shape)->ownerSlot = slot;
+}
+
+#endif // SHAPE_INTERNAL_H
@@ -1,23 +1,39 @@
 /**
  * @file shapes.h
- * @brief Shape type enumeration
+ * @brief Shape type enumeration and registry
  *
  * This module defines the enumeration of all geometric shape types
- * supported in the system.
+ * supported in the system, generated from a single shape registry.
  */
 
 #ifndef SHAPES_H
 #define SHAPES_H
 
+/**
+ * @brief Registry of all shape types
+ *
+ * Expands X(type, prefix, command) once per shape type, where type is the
+ * enumerator, prefix is the name prefix of the shape module functions
+ * (prefix_create, prefix_destroy, ...) and command is the .geo command that
+ * creates the shape. Per-type dispatch (destroy, area, bounds, cloning,
+ * SVG output and .geo parsing) is generated from this list, so adding a
+ * shape type means adding a row here and implementing its per-type
+ * functions.
+ */
+#define SHAPE_TYPE_LIST(X)                                                     \
+  X(CIRCLE, circle, "c")         /**< Circle shape */                          \
+  X(RECTANGLE, rectangle, "r")   /**< Rectangle shape */                       \
+  X(LINE, line, "l")             /**< Line shape */                            \
+  X(TEXT, text, "t")             /**< Text shape */                            \
+  X(TEXT_STYLE, text_style, "ts") /**< Text style shape */
+
 /**
  * @brief Enumeration of geometric shape types
  */
 enum ShapeType {
-    CIRCLE,      /**< Circle shape */
-    RECTANGLE,   /**< Rectangle shape */
-    LINE,        /**< Line shape */
-    TEXT,        /**< Text shape */
-    TEXT_STYLE   /**< Text style shape */
+#define SHAPE_TYPE_ENUMERATOR(type, prefix, command) type,
+  SHAPE_TYPE_LIST(SHAPE_TYPE_ENUMERATOR)
+#undef SHAPE_TYPE_ENUMERATOR
 };
 
 /**
@@ -26,4 +42,3 @@ enum ShapeType {
 typedef enum ShapeType ShapeType;
 
 #endif // SHAPES_H
-
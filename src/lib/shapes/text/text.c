@@ -1,20 +1,15 @@
 #include "text.h"
+#include "text_internal.h"
+#include "../../commons/shared_string/shared_string.h"
 #include "../../commons/utils/utils.h"
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * Internal Text structure
- */
-struct Text {
-  int id;
-  double x;
-  double y;
-  char *border_color;
-  char *fill_color;
-  char anchor;
-  char *text;
-};
+// private functions
+static struct Text *text_alloc(int id, double x, double y,
+                               const char *border_color,
+                               const char *fill_color, char anchor,
+                               SharedString body);
 
 void *text_create(int id, double x, double y, const char *border_color,
                   const char *fill_color, char anchor, const char *text) {
@@ -22,38 +17,26 @@ void *text_create(int id, double x, double y, const char *border_color,
     return NULL;
   }
 
-  struct Text *t = malloc(sizeof(struct Text));
-  if (!t) {
-    return NULL;
-  }
-
-  t->id = id;
-  t->x = x;
-  t->y = y;
-  t->anchor = anchor;
-
-  t->border_color = duplicate_string(border_color);
-  if (!t->border_color) {
-    free(t);
+  SharedString body = shared_string_create(text);
+  if (!body) {
     return NULL;
   }
 
-  t->fill_color = duplicate_string(fill_color);
-  if (!t->fill_color) {
-    free(t->border_color);
-    free(t);
-    return NULL;
-  }
+  struct Text *t = text_alloc(id, x, y, border_color, fill_color, anchor, body);
+  // text_alloc took its own reference on success
+  shared_string_release(body);
+  return t;
+}
 
-  t->text = duplicate_string(text);
-  if (!t->text) {
-    free(t->border_color);
-    free(t->fill_color);
-    free(t);
+void *text_clone(void *text, double x, double y, const char *border_color,
+                 const char *fill_color) {
+  if (!text || !border_color || !fill_color) {
     return NULL;
   }
 
-  return t;
+  struct Text *src = (struct Text *)text;
+  return text_alloc(src->id, x, y, border_color, fill_color, src->anchor,
+                    src->body);
 }
 
 void text_destroy(void *text) {
@@ -63,7 +46,7 @@ void text_destroy(void *text) {
   struct Text *t = (struct Text *)text;
   free(t->border_color);
   free(t->fill_color);
-  free(t->text);
+  shared_string_release(t->body);
   free(t);
 }
 
@@ -108,3 +91,44 @@ const char *text_get_text(void *text) {
     return NULL;
   return ((struct Text *)text)->text;
 }
+
+size_t text_get_length(void *text) {
+  if (!text)
+    return 0;
+  return ((struct Text *)text)->length;
+}
+
+// Allocates a text referencing body, which gains one reference on success
+static struct Text *text_alloc(int id, double x, double y,
+                               const char *border_color,
+                               const char *fill_color, char anchor,
+                               SharedString body) {
+  struct Text *t = malloc(sizeof(struct Text));
+  if (!t) {
+    return NULL;
+  }
+
+  t->id = id;
+  t->x = x;
+  t->y = y;
+  t->anchor = anchor;
+
+  t->border_color = duplicate_string(border_color);
+  if (!t->border_color) {
+    free(t);
+    return NULL;
+  }
+
+  t->fill_color = duplicate_string(fill_color);
+  if (!t->fill_color) {
+    free(t->border_color);
+    free(t);
+    return NULL;
+  }
+
+  t->body = shared_string_retain(body);
+  t->text = shared_string_get(body);
+  t->length = shared_string_length(body);
+
+  return t;
+}
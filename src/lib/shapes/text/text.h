@@ -7,6 +7,8 @@
 #ifndef TEXT_H
 #define TEXT_H
 
+#include <stddef.h>
+
 typedef void* Text;
 
 /**
@@ -23,6 +25,22 @@ typedef void* Text;
 Text text_create(int id, double x, double y, const char *border_color,
                   const char *fill_color, char anchor, const char *text);
 
+/**
+ * Creates a copy of a text at a new position with new colors
+ *
+ * The text content is not copied: the clone shares the immutable body of
+ * the source text.
+ *
+ * @param text Source text instance
+ * @param x X coordinate of the clone position
+ * @param y Y coordinate of the clone position
+ * @param border_color Border color string of the clone
+ * @param fill_color Fill color string of the clone
+ * @return Pointer to new text or NULL on error
+ */
+Text text_clone(Text text, double x, double y, const char *border_color,
+                const char *fill_color);
+
 /**
  * Destroys a text instance and frees all memory
  * @param text Text instance to destroy
@@ -78,4 +96,11 @@ char text_get_anchor(Text text);
  */
 const char *text_get_text(Text text);
 
+/**
+ * Gets the length of the text content string
+ * @param text Text instance
+ * @return Number of characters in the text content
+ */
+size_t text_get_length(Text text);
+
 #endif // TEXT_H
@@ -0,0 +1,61 @@
+/**
+ * Text internals - Library-private text layout
+ *
+ * Inline accessors used when rendering texts and cloning them during calc.
+ * No NULL checks are performed.
+ */
+#ifndef TEXT_INTERNAL_H
+#define TEXT_INTERNAL_H
+
+#include "../../commons/scalar/scalar.h"
+#include "../../commons/shared_string/shared_string.h"
+#include "text.h"
+
+/**
+ * Internal Text structure
+ */
+struct Text {
+  int id;
+  Scalar x;
+  Scalar y;
+  char *border_color;
+  char *fill_color;
+  char anchor;
+  SharedString body;  // shared with clones of this text
+  const char *text;   // characters of body
+  size_t length;      // cached length of body
+};
+
+static inline int text_fast_get_id(Text text) {
+  return ((struct Text *)text)->id;
+}
+
+static inline Scalar text_fast_get_x(Text text) {
+  return ((struct Text *)text)->x;
+}
+
+static inline Scalar text_fast_get_y(Text text) {
+  return ((struct Text *)text)->y;
+}
+
+static inline const char *text_fast_get_border_color(Text text) {
+  return ((struct Text *)text)->border_color;
+}
+
+static inline const char *text_fast_get_fill_color(Text text) {
+  return ((struct Text *)text)->fill_color;
+}
+
+static inline char text_fast_get_anchor(Text text) {
+  return ((struct Text *)text)->anchor;
+}
+
+static inline const char *text_fast_get_text(Text text) {
+  return ((struct Text *)text)->text;
+}
+
+static inline size_t text_fast_get_length(Text text) {
+  return ((struct Text *)text)->length;
+}
+
+#endif // TEXT_INTERNAL_H
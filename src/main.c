@@ -1,4 +1,6 @@
 #include "lib/args_handler/args_handler.h"
+#include "lib/commons/queue/queue.h"
+#include "lib/commons/utils/utils.h"
 #include "lib/file_reader/file_reader.h"
 #include "lib/geo_handler/geo_handler.h"
 #include "lib/qry_handler/qry_handler.h"
@@ -6,9 +8,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Instructions run between two snapshots when -k is given without -n
+#define QRY_CHECKPOINT_INTERVAL 10000
+
+// private functions
+static char *join_prefix(const char *prefix_path, const char *path);
+static void run_qry_list(const char *list_path, const char *prefix_path,
+                         FileData geo_file, Ground ground,
+                         QryProgram base_program, Qry base,
+                         const char *output_path);
+
 int main(int argc, char *argv[]) {
 
-  if (argc > 10) { // program -e path -f .geo -o output -q .qry suffix
+  // program -e path -f .geo -o output -q .qry -c cache -k snapshot
+  // -n interval -r snapshot suffix
+  if (argc > 20) {
     printf("Error: Too many arguments\n");
     exit(1);
   }
@@ -18,37 +32,33 @@ int main(int argc, char *argv[]) {
   const char *geo_input_path = get_option_value(argc, argv, "f");
   const char *prefix_path = get_option_value(argc, argv, "e");
   const char *qry_input_path = get_option_value(argc, argv, "q");
+  const char *qry_cache_path = get_option_value(argc, argv, "c");
+  const char *qry_list_path = get_option_value(argc, argv, "m");
+  const char *checkpoint_path = get_option_value(argc, argv, "k");
+  const char *checkpoint_interval = get_option_value(argc, argv, "n");
+  const char *resume_path = get_option_value(argc, argv, "r");
   const char *command_suffix = get_command_suffix(argc, argv);
 
-  // Apply prefix_path if it exists (only to -f and -q, not -o)
+  // Apply prefix_path if it exists (only to -f, -q and -m, not -o)
   char *full_geo_path = NULL;
   char *full_qry_path = NULL;
+  char *full_list_path = NULL;
 
   if (prefix_path != NULL) {
-    size_t prefix_len = strlen(prefix_path);
-    int needs_slash = (prefix_len > 0 && prefix_path[prefix_len - 1] != '/');
-
     if (geo_input_path != NULL) {
-      size_t geo_len = strlen(geo_input_path);
-      full_geo_path = (char *)malloc(prefix_len + geo_len + 2);
-      if (needs_slash) {
-        sprintf(full_geo_path, "%s/%s", prefix_path, geo_input_path);
-      } else {
-        sprintf(full_geo_path, "%s%s", prefix_path, geo_input_path);
-      }
+      full_geo_path = join_prefix(prefix_path, geo_input_path);
       geo_input_path = full_geo_path;
     }
 
     if (qry_input_path != NULL) {
-      size_t qry_len = strlen(qry_input_path);
-      full_qry_path = (char *)malloc(prefix_len + qry_len + 2);
-      if (needs_slash) {
-        sprintf(full_qry_path, "%s/%s", prefix_path, qry_input_path);
-      } else {
-        sprintf(full_qry_path, "%s%s", prefix_path, qry_input_path);
-      }
+      full_qry_path = join_prefix(prefix_path, qry_input_path);
       qry_input_path = full_qry_path;
     }
+
+    if (qry_list_path != NULL) {
+      full_list_path = join_prefix(prefix_path, qry_list_path);
+      qry_list_path = full_list_path;
+    }
   }
 
   
@@ -57,16 +67,31 @@ int main(int argc, char *argv[]) {
     printf("Error: -f and -o are required\n");
     exit(1);
   }
-  FileData geo_file = file_data_create(geo_input_path);
+  if ((checkpoint_path != NULL || resume_path != NULL) &&
+      qry_input_path == NULL) {
+    printf("Error: -k and -r require -q\n");
+    exit(1);
+  }
+
+  // A resumed run gets its ground from the snapshot, so the .geo is neither
+  // read nor rendered again; it only names the outputs
+  FileData geo_file = resume_path != NULL
+                          ? file_data_create_unread(geo_input_path)
+                          : file_data_create(geo_input_path);
   if (geo_file == NULL) {
     printf("Error: Failed to create FileData\n");
     exit(1);
   }
   
   
-  Ground ground = execute_geo_commands(geo_file, output_path, command_suffix);
+  Ground ground = resume_path != NULL
+                      ? create_ground()
+                      : execute_geo_commands(geo_file, output_path,
+                                             command_suffix);
 
   // If a .qry file was provided, execute its commands on the same ground
+  QryProgram program = NULL;
+  Qry qry = NULL;
   if (qry_input_path != NULL) {
     FileData qry_file = file_data_create(qry_input_path);
     if (qry_file == NULL) {
@@ -75,10 +100,54 @@ int main(int argc, char *argv[]) {
       exit(1);
     }
 
-    Qry qry = execute_qry_commands(qry_file, geo_file, ground, output_path);
+    // A cache file keeps the compiled .qry for the next runs; it is only used
+    // while it matches the .qry lines
+    if (qry_cache_path != NULL) {
+      program = qry_program_load(qry_cache_path, qry_file);
+    }
+    if (program == NULL) {
+      program = qry_program_compile(qry_file);
+      if (program == NULL) {
+        printf("Error: Failed to compile .qry\n");
+        destroy_geo_waste(ground);
+        exit(1);
+      }
+      if (qry_cache_path != NULL &&
+          !qry_program_save(program, qry_cache_path)) {
+        printf("Error: Failed to write .qry cache %s\n", qry_cache_path);
+      }
+    }
+
+    // Snapshots are saved every checkpoint_interval instructions
+    if (checkpoint_path != NULL || resume_path != NULL) {
+      int interval = checkpoint_interval != NULL ? atoi(checkpoint_interval)
+                                                 : QRY_CHECKPOINT_INTERVAL;
+      qry = execute_qry_program_checkpointed(program, qry_file, geo_file,
+                                             ground, output_path, resume_path,
+                                             checkpoint_path, interval);
+    } else {
+      qry = execute_qry_program(program, qry_file, geo_file, ground,
+                                output_path);
+    }
     file_data_destroy(qry_file);
+    if (qry == NULL) {
+      printf("Error: Failed to run .qry\n");
+      destroy_geo_waste(ground);
+      exit(1);
+    }
+  }
+
+  // Every .qry named in the list runs against its own view of the same
+  // ground, so the .geo is parsed once for all of them; after a -q run, each
+  // one continues from the state that run ended with
+  if (qry_list_path != NULL) {
+    run_qry_list(qry_list_path, prefix_path, geo_file, ground, program, qry,
+                 output_path);
+  }
+  if (qry != NULL) {
     destroy_qry_waste(qry);
   }
+  qry_program_destroy(program);
 
   file_data_destroy(geo_file);
   destroy_geo_waste(ground);
@@ -86,6 +155,105 @@ int main(int argc, char *argv[]) {
   // Free allocated memory for paths
   if (full_geo_path != NULL) free(full_geo_path);
   if (full_qry_path != NULL) free(full_qry_path);
+  if (full_list_path != NULL) free(full_list_path);
 
   return 0;
-}
\ No newline at end of file
+}
+
+/**
+**************************
+* Private functions
+**************************
+*/
+
+// Joins prefix_path and path with a single slash; the result must be freed
+static char *join_prefix(const char *prefix_path, const char *path) {
+  size_t prefix_len = strlen(prefix_path);
+  int needs_slash = (prefix_len > 0 && prefix_path[prefix_len - 1] != '/');
+  char *full_path = (char *)malloc(prefix_len + strlen(path) + 2);
+  if (full_path == NULL) {
+    printf("Error: Memory allocation failed\n");
+    exit(1);
+  }
+  if (needs_slash) {
+    sprintf(full_path, "%s/%s", prefix_path, path);
+  } else {
+    sprintf(full_path, "%s%s", prefix_path, path);
+  }
+  return full_path;
+}
+
+// Reads the .qry paths listed one per line in list_path (relative to
+// prefix_path, if any), compiles each one and runs them all concurrently,
+// as branches of base if it is not NULL
+static void run_qry_list(const char *list_path, const char *prefix_path,
+                         FileData geo_file, Ground ground,
+                         QryProgram base_program, Qry base,
+                         const char *output_path) {
+  FileData list_file = file_data_create(list_path);
+  if (list_file == NULL) {
+    printf("Error: Failed to create FileData for the .qry list\n");
+    destroy_geo_waste(ground);
+    exit(1);
+  }
+
+  Queue lines = get_file_lines_queue(list_file);
+  int capacity = queue_size(lines) > 0 ? queue_size(lines) : 1;
+  char **paths = malloc((size_t)capacity * sizeof(char *));
+  FileData *qry_files = malloc((size_t)capacity * sizeof(FileData));
+  QryProgram *programs = malloc((size_t)capacity * sizeof(QryProgram));
+  if (paths == NULL || qry_files == NULL || programs == NULL) {
+    printf("Error: Memory allocation failed\n");
+    exit(1);
+  }
+
+  // Programs are compiled here, one after another; only the runs share
+  // the worker threads
+  int count = 0;
+  while (!queue_is_empty(lines)) {
+    const char *line = (const char *)queue_dequeue(lines);
+    if (line[0] == '\0') {
+      continue;
+    }
+    paths[count] = prefix_path != NULL ? join_prefix(prefix_path, line)
+                                       : duplicate_string(line);
+    if (paths[count] == NULL) {
+      printf("Error: Memory allocation failed\n");
+      exit(1);
+    }
+    qry_files[count] = file_data_create(paths[count]);
+    if (qry_files[count] == NULL) {
+      printf("Error: Failed to create FileData for .qry %s\n", paths[count]);
+      destroy_geo_waste(ground);
+      exit(1);
+    }
+    programs[count] =
+        base != NULL
+            ? qry_program_compile_continuation(base_program, qry_files[count])
+            : qry_program_compile(qry_files[count]);
+    if (programs[count] == NULL) {
+      printf("Error: Failed to compile .qry %s\n", paths[count]);
+      destroy_geo_waste(ground);
+      exit(1);
+    }
+    count++;
+  }
+
+  if (base != NULL) {
+    execute_qry_branches(base, programs, qry_files, count, geo_file, ground,
+                         output_path);
+  } else {
+    execute_qry_matches(programs, qry_files, count, geo_file, ground,
+                        output_path);
+  }
+
+  for (int i = 0; i < count; i++) {
+    qry_program_destroy(programs[i]);
+    file_data_destroy(qry_files[i]);
+    free(paths[i]);
+  }
+  free(programs);
+  free(qry_files);
+  free(paths);
+  file_data_destroy(list_file);
+}